@@ -1563,6 +1563,127 @@ bool __CFBinaryPlistCreateObject(const uint8_t *databytes, uint64_t datalen, uin
     return __CFBinaryPlistCreateObjectFiltered(databytes, datalen, startOffset, trailer, allocator, mutabilityOption, objects, NULL, 0, NULL, plist);
 }
 
+#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS
+// Binary plists smaller than this are always decoded on the calling thread
+#define PARALLEL_DECODE_MIN_LENGTH (4 * 1024 * 1024)
+
+// The offset table makes every object independently addressable, so the children of a large top-level array or dictionary can be decoded on several threads, each with its own uniquing table, and assembled in order afterwards. Returns false without creating anything when that does not apply or when any child fails to decode; the caller then decodes sequentially, which also produces the proper failure.
+static bool __CFBinaryPlistCreateObjectConcurrently(const uint8_t *databytes, uint64_t datalen, uint64_t startOffset, const CFBinaryPlistTrailer *trailer, CFAllocatorRef allocator, CFOptionFlags mutabilityOption, CFPropertyListRef *plist) {
+    CFIndex ncores = __CFActiveProcessorCount();
+    if (ncores < 2 || datalen < PARALLEL_DECODE_MIN_LENGTH) return false;
+    uint64_t objectsRangeStart = 8, objectsRangeEnd = trailer->_offsetTableOffset - 1;
+    if (startOffset < objectsRangeStart || objectsRangeEnd < startOffset) return false;
+    uint8_t marker = *(databytes + startOffset);
+    bool isDict = ((marker & 0xf0) == kCFBinaryPlistMarkerDict);
+    if (!isDict && (marker & 0xf0) != kCFBinaryPlistMarkerArray) return false;
+
+    const uint8_t *ptr = databytes + startOffset + 1;
+    CFIndex count = marker & 0x0f;
+    if (0xf == count) {
+        uint64_t bigint = 0;
+        if (!_readInt(ptr, databytes + objectsRangeEnd, &bigint, &ptr)) return false;
+        if (LONG_MAX / 2 < bigint) return false;
+        count = (CFIndex)bigint;
+    }
+    CFIndex refCount = isDict ? 2 * count : count;
+    if (refCount < 4 * ncores) return false;
+    int32_t err = CF_NO_ERROR;
+    size_t byte_cnt = check_size_t_mul(refCount, trailer->_objectRefSize, &err);
+    if (CF_NO_ERROR != err) return false;
+    const uint8_t *extent = check_ptr_add(ptr, byte_cnt, &err) - 1;
+    if (CF_NO_ERROR != err || databytes + objectsRangeEnd < extent) return false;
+    byte_cnt = check_size_t_mul(refCount, sizeof(CFPropertyListRef), &err);
+    if (CF_NO_ERROR != err) return false;
+    CFPropertyListRef *list = (CFPropertyListRef *)CFAllocatorAllocate(kCFAllocatorSystemDefault, byte_cnt, __kCFAllocatorGCScannedMemory);
+    if (!list) return false;
+
+    CFIndex nchunks = 4 * ncores;
+    CFIndex perChunk = (refCount + nchunks - 1) / nchunks;
+    nchunks = (refCount + perChunk - 1) / perChunk;
+    bool *chunkOK = (bool *)calloc(nchunks, sizeof(bool));
+    const uint8_t *refs = ptr;
+    dispatch_apply(nchunks, __CFDispatchQueueGetGenericMatchingCurrent(), ^(size_t chunk) {
+        CFIndex first = chunk * perChunk;
+        CFIndex last = (first + perChunk < refCount) ? first + perChunk : refCount;
+        // same callbacks as the table in __CFTryParseBinaryPlist(), see the comment there
+        CFMutableDictionaryRef objects = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        CFIndex idx;
+        for (idx = first; idx < last; idx++) {
+            CFPropertyListRef pl = NULL;
+            uint64_t off = _getOffsetOfRefAt(databytes, refs + idx * trailer->_objectRefSize, trailer);
+            if (!__CFBinaryPlistCreateObjectFiltered(databytes, datalen, off, trailer, allocator, mutabilityOption, objects, NULL, 1, NULL, &pl)) break;
+            if (isDict && idx < count && !_plistIsPrimitive(pl)) {
+                CFRelease(pl);
+                break;
+            }
+            __CFAssignWithWriteBarrier((void **)list + idx, (void *)pl);
+        }
+        chunkOK[chunk] = (idx == last);
+        if (!chunkOK[chunk]) {
+            while (first < idx--) CFRelease(list[idx]);
+        }
+        CFRelease(objects);
+    });
+
+    bool success = true;
+    for (CFIndex chunk = 0; chunk < nchunks; chunk++) {
+        if (!chunkOK[chunk]) success = false;
+    }
+    if (!success) {
+        for (CFIndex chunk = 0; chunk < nchunks; chunk++) {
+            CFIndex first = chunk * perChunk;
+            CFIndex last = (first + perChunk < refCount) ? first + perChunk : refCount;
+            if (!chunkOK[chunk]) continue;
+            for (CFIndex idx = first; idx < last; idx++) CFRelease(list[idx]);
+        }
+        free(chunkOK);
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, list);
+        return false;
+    }
+    free(chunkOK);
+
+    if (isDict) {
+        if (mutabilityOption != kCFPropertyListImmutable) {
+            *plist = CFDictionaryCreateMutable(allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+            for (CFIndex idx = 0; idx < count; idx++) {
+                CFDictionaryAddValue((CFMutableDictionaryRef)*plist, list[idx], list[idx + count]);
+            }
+            for (CFIndex idx = 0; idx < refCount; idx++) {
+                CFRelease(list[idx]);
+            }
+        } else if (!kCFUseCollectableAllocator) {
+            *plist = __CFDictionaryCreateTransfer(allocator, list, list + count, count);
+        } else {
+            *plist = CFDictionaryCreate(allocator, list, list + count, count, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+            for (CFIndex idx = 0; idx < refCount; idx++) {
+                CFRelease(list[idx]);
+            }
+        }
+    } else {
+        if (mutabilityOption != kCFPropertyListImmutable) {
+            *plist = CFArrayCreateMutable(allocator, 0, &kCFTypeArrayCallBacks);
+            CFArrayReplaceValues((CFMutableArrayRef)*plist, CFRangeMake(0, 0), list, count);
+            for (CFIndex idx = 0; idx < count; idx++) {
+                CFRelease(list[idx]);
+            }
+        } else if (!kCFUseCollectableAllocator) {
+            *plist = __CFArrayCreateTransfer(allocator, list, count);
+        } else {
+            *plist = CFArrayCreate(allocator, list, count, &kCFTypeArrayCallBacks);
+            for (CFIndex idx = 0; idx < count; idx++) {
+                CFRelease(list[idx]);
+            }
+        }
+    }
+    CFAllocatorDeallocate(kCFAllocatorSystemDefault, list);
+    return (*plist) ? true : false;
+}
+#else
+static bool __CFBinaryPlistCreateObjectConcurrently(const uint8_t *databytes, uint64_t datalen, uint64_t startOffset, const CFBinaryPlistTrailer *trailer, CFAllocatorRef allocator, CFOptionFlags mutabilityOption, CFPropertyListRef *plist) {
+    return false;
+}
+#endif
+
 CF_PRIVATE bool __CFTryParseBinaryPlist(CFAllocatorRef allocator, CFDataRef data, CFOptionFlags option, CFPropertyListRef *plist, CFStringRef *errorString) {
     uint8_t marker;    
     CFBinaryPlistTrailer trailer;
@@ -1581,7 +1702,7 @@ CF_PRIVATE bool __CFTryParseBinaryPlist(CFAllocatorRef allocator, CFDataRef data
 	_CFDictionarySetCapacity(objects, trailer._numObjects);
 	CFPropertyListRef pl = NULL;
         bool result = true;
-        if (__CFBinaryPlistCreateObjectFiltered(databytes, datalen, offset, &trailer, allocator, option, objects, NULL, 0, NULL, &pl)) {
+        if (__CFBinaryPlistCreateObjectConcurrently(databytes, datalen, offset, &trailer, allocator, option, &pl) || __CFBinaryPlistCreateObjectFiltered(databytes, datalen, offset, &trailer, allocator, option, objects, NULL, 0, NULL, &pl)) {
 	    if (plist) *plist = pl;
 #if 0
 // code to check the 1.5 version code against any binary plist successfully parsed above
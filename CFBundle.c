@@ -155,7 +155,7 @@ static pthread_mutex_t CFBundleGlobalDataLock = PTHREAD_MUTEX_INITIALIZER;
 static CFMutableDictionaryRef _bundlesByIdentifier = NULL;
 #if AVOID_WEAK_COLLECTIONS
 static CFMutableDictionaryRef _bundlesByURL = NULL;
-static CFMutableArrayRef _allBundles = NULL;
+static CFMutableSetRef _allBundles = NULL;
 static CFMutableSetRef _bundlesToUnload = NULL;
 #else /* AVOID_WEAK_COLLECTIONS */
 static __CFHashTable *_allBundles = nil;
@@ -186,14 +186,12 @@ static void _CFBundleAddToTables(CFBundleRef bundle, Boolean alreadyLocked) {
 
     if (!alreadyLocked) pthread_mutex_lock(&CFBundleGlobalDataLock);
     
-    // Add to the _allBundles list
+    // Add to the _allBundles set; it is hashed by identity so that removal does not have to search
     if (!_allBundles) {
-        CFArrayCallBacks nonRetainingArrayCallbacks = kCFTypeArrayCallBacks;
-        nonRetainingArrayCallbacks.retain = NULL;
-        nonRetainingArrayCallbacks.release = NULL;
-        _allBundles = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &nonRetainingArrayCallbacks);
+        CFSetCallBacks nonRetainingSetCallbacks = {0, NULL, NULL, NULL, NULL, NULL};
+        _allBundles = CFSetCreateMutable(kCFAllocatorSystemDefault, 0, &nonRetainingSetCallbacks);
     }
-    CFArrayAppendValue(_allBundles, bundle);
+    CFSetAddValue(_allBundles, bundle);
     
     // Add to the table that maps urls to bundles
     if (!_bundlesByURL) {
@@ -238,10 +236,7 @@ static void _CFBundleAddToTables(CFBundleRef bundle, Boolean alreadyLocked) {
 static void _CFBundleRemoveFromTables(CFBundleRef bundle, CFURLRef bundleURL, CFStringRef bundleID) {
     pthread_mutex_lock(&CFBundleGlobalDataLock);
     // Remove from the various lists
-    if (_allBundles) {
-        CFIndex i = CFArrayGetFirstIndexOfValue(_allBundles, CFRangeMake(0, CFArrayGetCount(_allBundles)), bundle);
-        if (i >= 0) CFArrayRemoveValueAtIndex(_allBundles, i);
-    }
+    if (_allBundles) CFSetRemoveValue(_allBundles, bundle);
 
     // Remove from the table that maps urls to bundles
     if (bundleURL && _bundlesByURL) {
@@ -1203,6 +1198,18 @@ CFArrayRef CFBundleCreateBundlesFromDirectory(CFAllocatorRef alloc, CFURLRef dir
     return bundles;
 }
 
+// Reads the Info.plist and locates the executable of each bundle, spreading the bundles over the available processors. Each bundle's caches are filled under its own lock, so the bundles do not contend with one another. Nothing is loaded; code is only mapped and symbols only looked up when the bundle is first asked for them.
+CF_EXPORT void _CFBundlesPrewarm(CFArrayRef bundles) {
+    CFIndex count = bundles ? CFArrayGetCount(bundles) : 0;
+    if (count == 0) return;
+    dispatch_apply(count, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^(size_t idx) {
+        CFBundleRef bundle = (CFBundleRef)CFArrayGetValueAtIndex(bundles, idx);
+        CFBundleGetInfoDictionary(bundle);
+        CFURLRef executableURL = CFBundleCopyExecutableURL(bundle);
+        if (executableURL) CFRelease(executableURL);
+    });
+}
+
 CFURLRef CFBundleCopyBundleURL(CFBundleRef bundle) {
     if (bundle->_url) CFRetain(bundle->_url);
     return bundle->_url;
@@ -1458,7 +1465,7 @@ Boolean _CFBundleGetStringsFilesShared(CFBundleRef bundle) {
 
 static Boolean _urlExists(CFURLRef url) {
     Boolean exists;
-    return url && (0 == _CFGetFileProperties(kCFAllocatorSystemDefault, url, &exists, NULL, NULL, NULL, NULL, NULL)) && exists;
+    return url && (0 == _CFGetCachedFileProperties(url, &exists, NULL)) && exists;
 }
 
 // This is here because on iPhoneOS with the dyld shared cache, we remove binaries from their
@@ -2300,7 +2307,7 @@ CF_PRIVATE Boolean _CFBundleCouldBeBundle(CFURLRef url) {
     Boolean result = false;
     Boolean exists;
     SInt32 mode;
-    if (_CFGetFileProperties(kCFAllocatorSystemDefault, url, &exists, &mode, NULL, NULL, NULL, NULL) == 0) result = (exists && (mode & S_IFMT) == S_IFDIR && (mode & 0444) != 0);
+    if (_CFGetCachedFileProperties(url, &exists, &mode) == 0) result = (exists && (mode & S_IFMT) == S_IFDIR && (mode & 0444) != 0);
     return result;
 }
 
@@ -2499,17 +2506,18 @@ static void _CFBundleEnsureAllBundlesUpToDateAlreadyLocked(void) {
     }
 }
 
+#if AVOID_WEAK_COLLECTIONS
+static void _CFBundleAppendToArray(const void *value, void *context) {
+    CFArrayAppendValue((CFMutableArrayRef)context, value);
+}
+#endif /* AVOID_WEAK_COLLECTIONS */
+
 CFArrayRef CFBundleGetAllBundles(void) {
     // To answer this properly, we have to have created the static bundles!
-#if !AVOID_WEAK_COLLECTIONS
     static CFMutableArrayRef externalAllBundles = NULL;
-#endif /* AVOID_WEAK_COLLECTIONS */
     CFArrayRef bundles;
     pthread_mutex_lock(&CFBundleGlobalDataLock);
     _CFBundleEnsureAllBundlesUpToDateAlreadyLocked();
-#if AVOID_WEAK_COLLECTIONS
-    bundles = _allBundles;
-#else /* AVOID_WEAK_COLLECTIONS */
     if (!externalAllBundles) {
         CFArrayCallBacks nonRetainingArrayCallbacks = kCFTypeArrayCallBacks;
         nonRetainingArrayCallbacks.retain = NULL;
@@ -2517,9 +2525,12 @@ CFArrayRef CFBundleGetAllBundles(void) {
         externalAllBundles = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &nonRetainingArrayCallbacks);
     }
     CFArrayRemoveAllValues(externalAllBundles);
+#if AVOID_WEAK_COLLECTIONS
+    if (_allBundles) CFSetApplyFunction(_allBundles, _CFBundleAppendToArray, externalAllBundles);
+#else /* AVOID_WEAK_COLLECTIONS */
     for (id value in _allBundles) CFArrayAppendValue(externalAllBundles, value);
-    bundles = externalAllBundles;
 #endif /* AVOID_WEAK_COLLECTIONS */
+    bundles = externalAllBundles;
     pthread_mutex_unlock(&CFBundleGlobalDataLock);
     return bundles;
 }
@@ -2528,10 +2539,10 @@ CF_EXPORT CFArrayRef _CFBundleCopyAllBundles(void) {
     // To answer this properly, we have to have created the static bundles!
     pthread_mutex_lock(&CFBundleGlobalDataLock);
     _CFBundleEnsureAllBundlesUpToDateAlreadyLocked();
+    CFMutableArrayRef bundles = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeArrayCallBacks);
 #if AVOID_WEAK_COLLECTIONS
-    CFArrayRef bundles = CFArrayCreateCopy(kCFAllocatorSystemDefault, _allBundles);
+    if (_allBundles) CFSetApplyFunction(_allBundles, _CFBundleAppendToArray, bundles);
 #else /* AVOID_WEAK_COLLECTIONS */
-    CFMutableArrayRef bundles = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeArrayCallBacks);
     for (id value in _allBundles) CFArrayAppendValue(bundles, value);
 #endif /* AVOID_WEAK_COLLECTIONS */
     pthread_mutex_unlock(&CFBundleGlobalDataLock);
@@ -48,7 +48,10 @@
 #include <unistd.h>
 #include <sys/sysctl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <sys/file.h>
+#define BUNDLE_RESOURCE_INDEX 1
 #endif
 
 #if DEPLOYMENT_TARGET_WINDOWS
@@ -90,7 +93,7 @@ CF_PRIVATE void _CFBundleFlushQueryTableCache(CFBundleRef bundle) {
 static Boolean _CFIsResourceCommon(char *path, Boolean *isDir) {
     Boolean exists;
     SInt32 mode;
-    if (_CFGetPathProperties(kCFAllocatorSystemDefault, path, &exists, &mode, NULL, NULL, NULL, NULL) == 0) {
+    if (_CFGetCachedPathProperties(path, &exists, &mode) == 0) {
         if (isDir) *isDir = ((exists && ((mode & S_IFMT) == S_IFDIR)) ? true : false);
         return (exists && (mode & 0444));
     }
@@ -748,7 +751,10 @@ static Boolean _CFBundleReadDirectory(CFStringRef pathOfDir, CFStringRef subdire
 }
 
 
-static CFDictionaryRef _CFBundleCreateQueryTableAtPath(CFStringRef inPath, CFArrayRef languages, CFStringRef resourcesDirectory, CFStringRef subdirectory)
+static void _CFBundleRecordDirectoryStamp(CFMutableDictionaryRef stamps, CFStringRef path);
+
+// If stamps is not NULL, every directory read is recorded in it along with a stamp of its current state
+static CFDictionaryRef _CFBundleCreateQueryTableAtPath(CFStringRef inPath, CFArrayRef languages, CFStringRef resourcesDirectory, CFStringRef subdirectory, CFMutableDictionaryRef stamps)
 {
     
     CFMutableDictionaryRef queryTable = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, &kCFCopyStringDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
@@ -776,6 +782,7 @@ static CFDictionaryRef _CFBundleCreateQueryTableAtPath(CFStringRef inPath, CFArr
         _CFAppendPathComponent2(path, subdirectory);
     }
     // read the content in sub dir and put them into query table
+    if (stamps) _CFBundleRecordDirectoryStamp(stamps, path);
     _CFBundleReadDirectory(path, subdirectory, allFiles, false, queryTable, typeDir, NULL, false, product, platform, NULL, false);
     CFStringDelete(path, CFRangeMake(basePathLen, CFStringGetLength(path) - basePathLen));    // Strip the string back to the base path
     
@@ -795,6 +802,7 @@ static CFDictionaryRef _CFBundleCreateQueryTableAtPath(CFStringRef inPath, CFArr
         if (subdirectory) {
             _CFAppendPathComponent2(path, subdirectory);
         }
+        if (stamps) _CFBundleRecordDirectoryStamp(stamps, path);
         _CFBundleReadDirectory(path, subdirectory, allFiles, hasFileAdded, queryTable, typeDir, addedTypes, firstLproj, product, platform, lprojTarget, true);
         CFStringDelete(path, CFRangeMake(basePathLen, CFStringGetLength(path) - basePathLen));         // Strip the string back to the base path
 
@@ -810,6 +818,7 @@ static CFDictionaryRef _CFBundleCreateQueryTableAtPath(CFStringRef inPath, CFArr
     if (subdirectory) {
         _CFAppendPathComponent2(path, subdirectory);
     }
+    if (stamps) _CFBundleRecordDirectoryStamp(stamps, path);
     _CFBundleReadDirectory(path, subdirectory, allFiles, hasFileAdded, queryTable, typeDir, addedTypes, YES, product, platform, _CFBundleBaseDirectory, true);
     CFStringDelete(path, CFRangeMake(basePathLen, CFStringGetLength(path) - basePathLen));    // Strip the string back to the base path
     
@@ -827,6 +836,7 @@ static CFDictionaryRef _CFBundleCreateQueryTableAtPath(CFStringRef inPath, CFArr
             if (subdirectory) {
                 _CFAppendPathComponent2(path, subdirectory);
             }
+            if (stamps) _CFBundleRecordDirectoryStamp(stamps, path);
             _CFBundleReadDirectory(path, subdirectory, allFiles, hasFileAdded, queryTable, typeDir, addedTypes, false, product, platform, lprojTarget, true);
             CFStringDelete(path, CFRangeMake(basePathLen, CFStringGetLength(path) - basePathLen));         // Strip the string back to the base path
             
@@ -852,6 +862,354 @@ static CFDictionaryRef _CFBundleCreateQueryTableAtPath(CFStringRef inPath, CFArr
     return queryTable;
 }   
 
+#pragma mark -
+#pragma mark Resource Index
+
+static void _CFBundleRecordDirectoryStamp(CFMutableDictionaryRef stamps, CFStringRef path) {
+#if BUNDLE_RESOURCE_INDEX
+    // Taken before the directory is read, so that a change made while reading it shows up as a different stamp next time. The change time is part of it because nothing can set it back, unlike the modification time, which copies often preserve.
+    char cpath[CFMaxPathSize];
+    struct stat statBuf;
+    CFStringRef stamp;
+    if (CFStringGetFileSystemRepresentation(path, cpath, sizeof(cpath)) && stat(cpath, &statBuf) == 0) {
+#if DEPLOYMENT_TARGET_LINUX
+        struct timespec mtime = statBuf.st_mtim, ctime = statBuf.st_ctim;
+#else
+        struct timespec mtime = statBuf.st_mtimespec, ctime = statBuf.st_ctimespec;
+#endif
+        stamp = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("%llu:%llu:%lld.%09ld:%lld.%09ld"), (unsigned long long)statBuf.st_dev, (unsigned long long)statBuf.st_ino, (long long)mtime.tv_sec, (long)mtime.tv_nsec, (long long)ctime.tv_sec, (long)ctime.tv_nsec);
+    } else {
+        stamp = (CFStringRef)CFRetain(CFSTR("-"));
+    }
+    CFDictionarySetValue(stamps, path, stamp);
+    CFRelease(stamp);
+#endif
+}
+
+#if BUNDLE_RESOURCE_INDEX
+/*
+ Query tables can be kept on disk between runs, one binary property list per bundle in ~/Library/Caches/com.apple.CFBundle.ResourceIndex, so that a cold lookup does not have to list and split every file of the bundle again. The index is off until _CFBundleSetResourceIndexLimit() turns it on, and is left alone altogether when that directory cannot be written; whether it can is found out once per process. Each entry holds the table along with a stamp of every directory that went into it (device, inode, modification and change times, or "-" for those which did not exist); an entry is used only if all of them still match, which costs a stat() per directory instead of reading it. Entries are keyed by the hash of everything the table depends on, and only the entry asked for is decoded out of the mapped file.
+ 
+ Tables built on misses are collected per bundle and written together a moment later, so a burst of misses costs one write of the index. Writers hold an flock() on the directory's lock file across the read, merge and rename, and a writer that finds it taken drops its entries; they are only a cache. An index keeps at most the limit's number of entries, the oldest written going first, and the directory at most _CFBundleResourceIndexMaxFiles indexes.
+*/
+#define _CFBundleResourceIndexTableKey CFSTR("table")
+#define _CFBundleResourceIndexStampsKey CFSTR("stamps")
+#define _CFBundleResourceIndexNameKey CFSTR("key")
+#define _CFBundleResourceIndexTimeKey CFSTR("time")
+#define _CFBundleResourceIndexMaxFiles 256
+#define _CFBundleResourceIndexWriteDelay 1.0
+
+CF_PRIVATE Boolean _CFReadMappedFromFile(CFStringRef path, Boolean map, Boolean uncached, void **outBytes, CFIndex *outLength, CFErrorRef *errorPtr);
+
+static CFLock_t _CFBundleResourceIndexLock = CFLockInit;
+static CFIndex _CFBundleResourceIndexLimit = 0;
+static Boolean _CFBundleResourceIndexDirectoryChecked = false;
+static CFStringRef _CFBundleResourceIndexDirectory = NULL; // Only set if it could be written
+static CFMutableDictionaryRef _CFBundleResourceIndexPending = NULL; // Bundle path to the entries built for it and not written yet, by hash key
+
+// Returns the index directory, or NULL if the index is off or the directory cannot be written
+static CFStringRef _CFBundleCopyResourceIndexDirectory(void) {
+    CFStringRef result = NULL;
+    __CFLock(&_CFBundleResourceIndexLock);
+    if (_CFBundleResourceIndexLimit > 0 && !_CFBundleResourceIndexDirectoryChecked) {
+        _CFBundleResourceIndexDirectoryChecked = true;
+        CFURLRef home = CFCopyHomeDirectoryURLForUser(NULL);
+        CFStringRef homePath = home ? CFURLCopyFileSystemPath(home, PLATFORM_PATH_STYLE) : NULL;
+        if (home) CFRelease(home);
+        if (homePath) {
+            CFMutableStringRef path = CFStringCreateMutableCopy(kCFAllocatorSystemDefault, 0, homePath);
+            CFRelease(homePath);
+            _CFAppendPathComponent2(path, CFSTR("Library/Caches/com.apple.CFBundle.ResourceIndex"));
+            char cpath[CFMaxPathSize];
+            if (CFStringGetFileSystemRepresentation(path, cpath, sizeof(cpath)) && (access(cpath, W_OK) == 0 || (_CFCreateDirectory(cpath) && access(cpath, W_OK) == 0))) {
+                _CFBundleResourceIndexDirectory = path;
+            } else {
+                CFRelease(path);
+            }
+        }
+    }
+    if (_CFBundleResourceIndexLimit > 0 && _CFBundleResourceIndexDirectory) result = (CFStringRef)CFRetain(_CFBundleResourceIndexDirectory);
+    __CFUnlock(&_CFBundleResourceIndexLock);
+    return result;
+}
+
+static CFStringRef _CFBundleCopyResourceIndexPath(CFStringRef directory, CFStringRef bundlePath) {
+    CFMutableStringRef path = CFStringCreateMutableCopy(kCFAllocatorSystemDefault, 0, directory);
+    CFStringRef name = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("%08lx.plist"), (unsigned long)CFHash(bundlePath));
+    _CFAppendPathComponent2(path, name);
+    CFRelease(name);
+    return path;
+}
+
+static CFStringRef _CFBundleCopyResourceIndexKey(CFStringRef bundlePath, CFArrayRef languages, CFStringRef resourcesDirectory, CFStringRef subdirectory) {
+    CFMutableStringRef key = CFStringCreateMutable(kCFAllocatorSystemDefault, 0);
+    CFStringAppendFormat(key, NULL, CFSTR("%@\n%@\n%@\n%@%@\n"), bundlePath, resourcesDirectory ? resourcesDirectory : CFSTR(""), subdirectory ? subdirectory : CFSTR(""), _CFGetProductName(), _CFGetPlatformName());
+    CFIndex count = languages ? CFArrayGetCount(languages) : 0;
+    for (CFIndex idx = 0; idx < count; idx++) {
+        if (idx > 0) CFStringAppend(key, CFSTR(","));
+        CFStringAppend(key, (CFStringRef)CFArrayGetValueAtIndex(languages, idx));
+    }
+    return key;
+}
+
+static Boolean _CFBundleResourceIndexStampsAreCurrent(CFDictionaryRef stamps) {
+    CFIndex count = CFDictionaryGetCount(stamps);
+    if (count == 0) return false;
+    CFStringRef *paths = (CFStringRef *)CFAllocatorAllocate(kCFAllocatorSystemDefault, 2 * count * sizeof(CFTypeRef), 0);
+    CFStringRef *values = paths + count;
+    CFDictionaryGetKeysAndValues(stamps, (const void **)paths, (const void **)values);
+    CFMutableDictionaryRef current = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    Boolean result = true;
+    for (CFIndex idx = 0; idx < count && result; idx++) {
+        if (CFGetTypeID(paths[idx]) != CFStringGetTypeID()) {
+            result = false;
+            break;
+        }
+        _CFBundleRecordDirectoryStamp(current, paths[idx]);
+        result = CFEqual(CFDictionaryGetValue(current, paths[idx]), values[idx]);
+    }
+    CFRelease(current);
+    CFAllocatorDeallocate(kCFAllocatorSystemDefault, paths);
+    return result;
+}
+
+// _CFReadMappedFromFile() hands back a malloced placeholder rather than a mapping for an empty file
+static void _CFBundleUnmapResourceIndex(void *bytes, CFIndex length) {
+    if (length == 0) {
+        free(bytes);
+    } else {
+        munmap(bytes, length);
+    }
+}
+
+// Returns the table stored under key if it is still current
+static CFDictionaryRef _CFBundleCopyQueryTableFromResourceIndex(CFStringRef indexPath, CFStringRef key, CFStringRef hashKey) {
+    void *bytes = NULL;
+    CFIndex length = 0;
+    CFDictionaryRef result = NULL;
+    if (!_CFReadMappedFromFile(indexPath, true, false, &bytes, &length, NULL)) return NULL;
+    CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorSystemDefault, (const UInt8 *)bytes, length, kCFAllocatorNull);
+    CFSetRef keyPaths = CFSetCreate(kCFAllocatorSystemDefault, (const void **)&hashKey, 1, &kCFTypeSetCallBacks);
+    CFPropertyListRef index = NULL;
+    if (_CFPropertyListCreateFiltered(kCFAllocatorSystemDefault, data, kCFPropertyListImmutable, keyPaths, &index, NULL) && index && CFGetTypeID(index) == CFDictionaryGetTypeID()) {
+        CFDictionaryRef entry = (CFDictionaryRef)CFDictionaryGetValue((CFDictionaryRef)index, hashKey);
+        if (entry && CFGetTypeID(entry) == CFDictionaryGetTypeID()) {
+            CFTypeRef name = CFDictionaryGetValue(entry, _CFBundleResourceIndexNameKey);
+            CFTypeRef table = CFDictionaryGetValue(entry, _CFBundleResourceIndexTableKey);
+            CFTypeRef stamps = CFDictionaryGetValue(entry, _CFBundleResourceIndexStampsKey);
+            if (name && CFEqual(name, key) && table && CFGetTypeID(table) == CFDictionaryGetTypeID() && stamps && CFGetTypeID(stamps) == CFDictionaryGetTypeID() && _CFBundleResourceIndexStampsAreCurrent((CFDictionaryRef)stamps)) {
+                result = (CFDictionaryRef)CFRetain(table);
+            }
+        }
+    }
+    if (index) CFRelease(index);
+    CFRelease(keyPaths);
+    CFRelease(data);
+    _CFBundleUnmapResourceIndex(bytes, length);
+    return result;
+}
+
+typedef struct {
+    CFAbsoluteTime time;
+    const void *key;
+} _CFBundleResourceIndexAge;
+
+static int _CFBundleCompareResourceIndexAges(const void *val1, const void *val2) {
+    CFAbsoluteTime time1 = ((const _CFBundleResourceIndexAge *)val1)->time, time2 = ((const _CFBundleResourceIndexAge *)val2)->time;
+    return (time1 < time2) ? -1 : ((time1 > time2) ? 1 : 0);
+}
+
+// Drops the entries written longest ago until at most limit are left
+static void _CFBundleTrimResourceIndex(CFMutableDictionaryRef index, CFIndex limit) {
+    CFIndex count = CFDictionaryGetCount(index);
+    if (count <= limit) return;
+    const void **keys = (const void **)CFAllocatorAllocate(kCFAllocatorSystemDefault, 2 * count * sizeof(void *), 0);
+    const void **values = keys + count;
+    _CFBundleResourceIndexAge *ages = (_CFBundleResourceIndexAge *)CFAllocatorAllocate(kCFAllocatorSystemDefault, count * sizeof(_CFBundleResourceIndexAge), 0);
+    CFDictionaryGetKeysAndValues(index, keys, values);
+    for (CFIndex idx = 0; idx < count; idx++) {
+        CFTypeRef time = (CFGetTypeID(values[idx]) == CFDictionaryGetTypeID()) ? CFDictionaryGetValue((CFDictionaryRef)values[idx], _CFBundleResourceIndexTimeKey) : NULL;
+        ages[idx].time = 0.0;
+        if (time && CFGetTypeID(time) == CFNumberGetTypeID()) CFNumberGetValue((CFNumberRef)time, kCFNumberDoubleType, &ages[idx].time);
+        ages[idx].key = CFRetain(keys[idx]);
+    }
+    qsort(ages, count, sizeof(_CFBundleResourceIndexAge), _CFBundleCompareResourceIndexAges);
+    for (CFIndex idx = 0; idx < count; idx++) {
+        if (idx < count - limit) CFDictionaryRemoveValue(index, ages[idx].key);
+        CFRelease(ages[idx].key);
+    }
+    CFAllocatorDeallocate(kCFAllocatorSystemDefault, ages);
+    CFAllocatorDeallocate(kCFAllocatorSystemDefault, keys);
+}
+
+// Removes the indexes written longest ago once the directory holds more than _CFBundleResourceIndexMaxFiles of them
+static void _CFBundleTrimResourceIndexDirectory(const char *directory) {
+    DIR *dir = opendir(directory);
+    if (!dir) return;
+    CFIndex count = 0, capacity = 0;
+    struct { time_t time; char name[32]; } *files = NULL;
+    struct dirent *dent;
+    while ((dent = readdir(dir))) {
+        size_t length = strlen(dent->d_name);
+        char path[CFMaxPathSize];
+        struct stat statBuf;
+        if (length < 6 || length >= sizeof(files->name) || strcmp(dent->d_name + length - 6, ".plist") != 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", directory, dent->d_name);
+        if (stat(path, &statBuf) != 0) continue;
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            files = CFAllocatorReallocate(kCFAllocatorSystemDefault, files, capacity * sizeof(*files), 0);
+            if (!files) HALT;
+        }
+        files[count].time = statBuf.st_mtime;
+        strlcpy(files[count].name, dent->d_name, sizeof(files->name));
+        count++;
+    }
+    closedir(dir);
+    while (count > _CFBundleResourceIndexMaxFiles) {
+        CFIndex oldest = 0;
+        for (CFIndex idx = 1; idx < count; idx++) {
+            if (files[idx].time < files[oldest].time) oldest = idx;
+        }
+        char path[CFMaxPathSize];
+        snprintf(path, sizeof(path), "%s/%s", directory, files[oldest].name);
+        unlink(path);
+        files[oldest] = files[--count];
+    }
+    if (files) CFAllocatorDeallocate(kCFAllocatorSystemDefault, files);
+}
+
+// Runs on the index queue. Merges the entries built for the bundle since the last write into its index, written to a temporary file and renamed into place so that readers never see half of it.
+static void _CFBundleWriteResourceIndex(CFStringRef directory, CFStringRef bundlePath) {
+    __CFLock(&_CFBundleResourceIndexLock);
+    CFDictionaryRef entries = (CFDictionaryRef)CFDictionaryGetValue(_CFBundleResourceIndexPending, bundlePath);
+    if (entries) CFRetain(entries);
+    CFDictionaryRemoveValue(_CFBundleResourceIndexPending, bundlePath);
+    CFIndex limit = _CFBundleResourceIndexLimit;
+    __CFUnlock(&_CFBundleResourceIndexLock);
+    if (!entries) return;
+
+    char cdir[CFMaxPathSize], lockPath[CFMaxPathSize + 16];
+    int lockFD = -1;
+    if (limit > 0 && CFStringGetFileSystemRepresentation(directory, cdir, sizeof(cdir))) {
+        snprintf(lockPath, sizeof(lockPath), "%s/.lock", cdir);
+        lockFD = open(lockPath, O_WRONLY | O_CREAT, 0600);
+    }
+    // Another process is writing; these entries are only a cache, so they are let go
+    if (lockFD >= 0 && flock(lockFD, LOCK_EX | LOCK_NB) == 0) {
+        CFStringRef indexPath = _CFBundleCopyResourceIndexPath(directory, bundlePath);
+        CFMutableDictionaryRef index = NULL;
+        void *bytes = NULL;
+        CFIndex length = 0;
+        Boolean existed = _CFReadMappedFromFile(indexPath, true, false, &bytes, &length, NULL);
+        if (existed) {
+            CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorSystemDefault, (const UInt8 *)bytes, length, kCFAllocatorNull);
+            CFPropertyListRef plist = CFPropertyListCreateWithData(kCFAllocatorSystemDefault, data, kCFPropertyListMutableContainers, NULL, NULL);
+            if (plist && CFGetTypeID(plist) == CFDictionaryGetTypeID()) {
+                index = (CFMutableDictionaryRef)plist;
+            } else if (plist) {
+                CFRelease(plist);
+            }
+            CFRelease(data);
+            _CFBundleUnmapResourceIndex(bytes, length);
+        }
+        if (!index) index = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        CFIndex count = CFDictionaryGetCount(entries);
+        const void **keys = (const void **)CFAllocatorAllocate(kCFAllocatorSystemDefault, 2 * count * sizeof(void *), 0);
+        const void **values = keys + count;
+        CFDictionaryGetKeysAndValues(entries, keys, values);
+        for (CFIndex idx = 0; idx < count; idx++) CFDictionarySetValue(index, keys[idx], values[idx]);
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, keys);
+        _CFBundleTrimResourceIndex(index, limit);
+        CFDataRef data = CFPropertyListCreateData(kCFAllocatorSystemDefault, index, kCFPropertyListBinaryFormat_v1_0, 0, NULL);
+        CFRelease(index);
+        char cpath[CFMaxPathSize], tmpPath[CFMaxPathSize + 32];
+        if (data && CFStringGetFileSystemRepresentation(indexPath, cpath, sizeof(cpath))) {
+            snprintf(tmpPath, sizeof(tmpPath), "%s.%d", cpath, (int)getpid());
+            CFURLRef tmpURL = CFURLCreateFromFileSystemRepresentation(kCFAllocatorSystemDefault, (const UInt8 *)tmpPath, strlen(tmpPath), false);
+            if (tmpURL && _CFWriteBytesToFile(tmpURL, CFDataGetBytePtr(data), CFDataGetLength(data))) {
+                if (rename(tmpPath, cpath) != 0) unlink(tmpPath);
+            }
+            if (tmpURL) CFRelease(tmpURL);
+        }
+        if (data) CFRelease(data);
+        CFRelease(indexPath);
+        if (!existed) _CFBundleTrimResourceIndexDirectory(cdir);
+    }
+    if (lockFD >= 0) close(lockFD);
+    CFRelease(entries);
+}
+
+static dispatch_queue_t _CFBundleResourceIndexQueue(void) {
+    static dispatch_queue_t queue = NULL;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        queue = dispatch_queue_create("com.apple.CFBundle.ResourceIndex", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
+// The first entry of a burst schedules the write that takes all of them
+static void _CFBundleAddToResourceIndex(CFStringRef directory, CFStringRef bundlePath, CFStringRef hashKey, CFDictionaryRef entry) {
+    Boolean schedule = false;
+    __CFLock(&_CFBundleResourceIndexLock);
+    if (!_CFBundleResourceIndexPending) _CFBundleResourceIndexPending = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, &kCFCopyStringDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CFMutableDictionaryRef entries = (CFMutableDictionaryRef)CFDictionaryGetValue(_CFBundleResourceIndexPending, bundlePath);
+    if (!entries) {
+        entries = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        CFDictionarySetValue(_CFBundleResourceIndexPending, bundlePath, entries);
+        CFRelease(entries);
+        schedule = true;
+    }
+    CFDictionarySetValue(entries, hashKey, entry);
+    __CFUnlock(&_CFBundleResourceIndexLock);
+    if (schedule) {
+        CFStringRef path = CFStringCreateCopy(kCFAllocatorSystemDefault, bundlePath);
+        CFRetain(directory);
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_CFBundleResourceIndexWriteDelay * NSEC_PER_SEC)), _CFBundleResourceIndexQueue(), ^{
+            _CFBundleWriteResourceIndex(directory, path);
+            CFRelease(path);
+            CFRelease(directory);
+        });
+    }
+}
+
+static CFDictionaryRef _CFBundleCopyIndexedQueryTable(CFStringRef bundlePath, CFArrayRef languages, CFStringRef resourcesDirectory, CFStringRef subdirectory) {
+    CFStringRef directory = _CFBundleCopyResourceIndexDirectory();
+    if (!directory) return _CFBundleCreateQueryTableAtPath(bundlePath, languages, resourcesDirectory, subdirectory, NULL);
+    CFStringRef key = _CFBundleCopyResourceIndexKey(bundlePath, languages, resourcesDirectory, subdirectory);
+    CFStringRef hashKey = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("%08lx"), (unsigned long)CFHash(key));
+    CFStringRef indexPath = _CFBundleCopyResourceIndexPath(directory, bundlePath);
+    CFDictionaryRef table = _CFBundleCopyQueryTableFromResourceIndex(indexPath, key, hashKey);
+    if (!table) {
+        CFMutableDictionaryRef stamps = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, &kCFCopyStringDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        table = _CFBundleCreateQueryTableAtPath(bundlePath, languages, resourcesDirectory, subdirectory, stamps);
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        CFNumberRef time = CFNumberCreate(kCFAllocatorSystemDefault, kCFNumberDoubleType, &now);
+        CFTypeRef keys[4] = {_CFBundleResourceIndexNameKey, _CFBundleResourceIndexStampsKey, _CFBundleResourceIndexTableKey, _CFBundleResourceIndexTimeKey};
+        CFTypeRef values[4] = {key, stamps, table, time};
+        CFDictionaryRef entry = CFDictionaryCreate(kCFAllocatorSystemDefault, keys, values, 4, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        _CFBundleAddToResourceIndex(directory, bundlePath, hashKey, entry);
+        CFRelease(entry);
+        CFRelease(time);
+        CFRelease(stamps);
+    }
+    CFRelease(indexPath);
+    CFRelease(hashKey);
+    CFRelease(key);
+    CFRelease(directory);
+    return table;
+}
+#endif
+
+void _CFBundleSetResourceIndexLimit(CFIndex limit) {
+#if BUNDLE_RESOURCE_INDEX
+    __CFLock(&_CFBundleResourceIndexLock);
+    _CFBundleResourceIndexLimit = (limit > 0) ? limit : 0;
+    __CFUnlock(&_CFBundleResourceIndexLock);
+#endif
+}
+
 // caller need to release the table
 static CFDictionaryRef _CFBundleCopyQueryTable(CFBundleRef bundle, CFURLRef bundleURL, CFArrayRef languages, CFStringRef resourcesDirectory, CFStringRef subdirectory)
 {
@@ -879,7 +1237,11 @@ static CFDictionaryRef _CFBundleCopyQueryTable(CFBundleRef bundle, CFURLRef bund
         
         if (!subTable) {
             // create the query table for the given sub dir
-            subTable = _CFBundleCreateQueryTableAtPath(bundle->_bundleBasePath, languages, resourcesDirectory, subdirectory);
+#if BUNDLE_RESOURCE_INDEX
+            subTable = _CFBundleCopyIndexedQueryTable(bundle->_bundleBasePath, languages, resourcesDirectory, subdirectory);
+#else
+            subTable = _CFBundleCreateQueryTableAtPath(bundle->_bundleBasePath, languages, resourcesDirectory, subdirectory, NULL);
+#endif
             
             CFDictionarySetValue(bundle->_queryTable, argDirStr, subTable);
         } else {
@@ -891,7 +1253,7 @@ static CFDictionaryRef _CFBundleCopyQueryTable(CFBundleRef bundle, CFURLRef bund
         CFURLRef url = CFURLCopyAbsoluteURL(bundleURL);
         CFStringRef bundlePath = CFURLCopyFileSystemPath(url, PLATFORM_PATH_STYLE);
         CFRelease(url);
-        subTable = _CFBundleCreateQueryTableAtPath(bundlePath, languages, resourcesDirectory, subdirectory);
+        subTable = _CFBundleCreateQueryTableAtPath(bundlePath, languages, resourcesDirectory, subdirectory, NULL);
         CFRelease(bundlePath);
     }
     
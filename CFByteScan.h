@@ -0,0 +1 @@
+include/CoreFoundation/./CFByteScan.h
\ No newline at end of file
@@ -34,6 +34,7 @@
 #include "CFInternal.h"
 #include <CoreFoundation/CFUniChar.h>
 #include "CFUniCharPriv.h"
+#include "CFByteScan.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -104,6 +105,7 @@ struct __CFCharacterSet {
         } _compactBitmap;
    } _variants;
    CFCharSetAnnexStruct *_annex;
+   _CFCharacterSetTable *_table;	// Compiled lazily for immutable sets
 };
 
 /* _base._info values interesting for CFCharacterSet
@@ -821,6 +823,7 @@ CF_INLINE CFMutableCharacterSetRef __CFCSetGenericCreate(CFAllocatorRef allocato
     cset->_base._cfinfo[CF_INFO_BITS] |= flags;
     cset->_hashValue = 0;
     cset->_annex = NULL;
+    cset->_table = NULL;
 
     return cset;
 }
@@ -1268,6 +1271,7 @@ static void __CFCharacterSetDeallocate(CFTypeRef cf) {
     else if (__CFCSetIsBitmap((CFCharacterSetRef)cf) && __CFCSetBitmapBits((CFCharacterSetRef)cf)) CFAllocatorDeallocate(allocator, __CFCSetBitmapBits((CFCharacterSetRef)cf));
     else if (__CFCSetIsCompactBitmap((CFCharacterSetRef)cf) && __CFCSetCompactBitmapBits((CFCharacterSetRef)cf)) CFAllocatorDeallocate(allocator, __CFCSetCompactBitmapBits((CFCharacterSetRef)cf));
     __CFCSetDeallocateAnnexPlane((CFCharacterSetRef)cf);
+    if (((CFCharacterSetRef)cf)->_table) CFAllocatorDeallocate(kCFAllocatorSystemDefault, ((CFCharacterSetRef)cf)->_table);
 }
 
 static CFTypeID __kCFCharacterSetTypeID = _kCFRuntimeNotATypeID;
@@ -2832,7 +2836,15 @@ CFRange _CFCharacterSetGetKeyedCodingRange(CFCharacterSetRef cset) { return CFRa
 CFStringRef _CFCharacterSetCreateKeyedCodingString(CFCharacterSetRef cset) { return CFStringCreateWithCharacters(kCFAllocatorSystemDefault, __CFCSetStringBuffer(cset), __CFCSetStringLength(cset)); }
 
 bool _CFCharacterSetIsInverted(CFCharacterSetRef cset) { return (__CFCSetIsInverted(cset) != 0); }
-void _CFCharacterSetSetIsInverted(CFCharacterSetRef cset, bool flag) { __CFCSetPutIsInverted((CFMutableCharacterSetRef)cset, flag); }
+void _CFCharacterSetSetIsInverted(CFCharacterSetRef cset, bool flag) {
+    __CFCSetPutIsInverted((CFMutableCharacterSetRef)cset, flag);
+    // This may be applied to an immutable set, so anything derived from its old contents goes: the lookup table compiled for it and its hash
+    if (cset->_table) {
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, cset->_table);
+        ((CFMutableCharacterSetRef)cset)->_table = NULL;
+    }
+    __CFCSetPutHasHashValue((CFMutableCharacterSetRef)cset, false);
+}
 
 /* Inline buffer support
 */
@@ -2921,3 +2933,161 @@ void CFCharacterSetInitInlineBuffer(CFCharacterSetRef cset, CFCharacterSetInline
         }
     }
 }
+
+/* Compiled membership tables
+ */
+#define __kCFCSetTableBlockSize (256 / BITSPERBYTE)
+#define __kCFCSetTableNumRuns (0x110000 >> 8)
+
+static _CFCharacterSetTable *__CFCSetCreateTable(CFCharacterSetRef cset) {
+    static const uint8_t emptyBlock[__kCFCSetTableBlockSize] = {0};
+    uint8_t fullBlock[__kCFCSetTableBlockSize];
+    CFDataRef bitmapRep = CFCharacterSetCreateBitmapRepresentation(kCFAllocatorSystemDefault, cset);
+    const uint8_t *bytes = CFDataGetBytePtr(bitmapRep);
+    CFIndex length = CFDataGetLength(bitmapRep);
+    const uint8_t *planes[MAX_ANNEX_PLANE + 1];
+    const uint8_t **runBits = (const uint8_t **)malloc(__kCFCSetTableNumRuns * sizeof(const uint8_t *));
+    CFIndex numBlocks = 0, offset, run;
+    _CFCharacterSetTable *table;
+
+    memset(planes, 0, sizeof(planes));
+    memset(fullBlock, 0xFF, sizeof(fullBlock));
+    planes[0] = bytes;
+    for (offset = __kCFBitmapSize; offset + 1 + __kCFBitmapSize <= length; offset += 1 + __kCFBitmapSize) {
+        if (bytes[offset] <= MAX_ANNEX_PLANE) planes[bytes[offset]] = bytes + offset + 1;
+    }
+
+    // The first pass only counts the distinct blocks; a run shares the block of the run before it, or the empty block, when their bits are the same
+    for (run = 0; run < __kCFCSetTableNumRuns; run++) {
+        const uint8_t *plane = planes[run >> 8];
+        runBits[run] = (plane ? plane + ((run & 0xFF) * __kCFCSetTableBlockSize) : emptyBlock);
+        if (0 == memcmp(runBits[run], emptyBlock, __kCFCSetTableBlockSize)) runBits[run] = emptyBlock;
+        if ((emptyBlock != runBits[run]) && ((0 == run) || (0 != memcmp(runBits[run], runBits[run - 1], __kCFCSetTableBlockSize)))) ++numBlocks;
+    }
+
+    table = (_CFCharacterSetTable *)CFAllocatorAllocate(kCFAllocatorSystemDefault, sizeof(_CFCharacterSetTable) + (numBlocks + 1) * __kCFCSetTableBlockSize, 0);
+    memset(table->blocks, 0, __kCFCSetTableBlockSize);	// Block 0 is the empty block
+    table->firstMember = table->firstNonMember = 0x110000;
+    numBlocks = 0;
+    for (run = 0; run < __kCFCSetTableNumRuns; run++) {
+        const uint8_t *bits = runBits[run];
+        CFIndex bit;
+
+        if (emptyBlock == bits) {
+            table->index[run] = 0;
+        } else if ((0 < run) && (0 == memcmp(bits, runBits[run - 1], __kCFCSetTableBlockSize))) {
+            table->index[run] = table->index[run - 1];
+        } else {
+            table->index[run] = (uint16_t)++numBlocks;
+            memmove(table->blocks + (numBlocks * __kCFCSetTableBlockSize), bits, __kCFCSetTableBlockSize);
+        }
+
+        if ((0x110000 != table->firstMember) && (0x110000 != table->firstNonMember)) continue;
+        if (0 == table->index[run]) {	// No members
+            if (0x110000 == table->firstNonMember) table->firstNonMember = (UTF32Char)(run << 8);
+            continue;
+        } else if (0 == memcmp(bits, fullBlock, __kCFCSetTableBlockSize)) {	// All members
+            if (0x110000 == table->firstMember) table->firstMember = (UTF32Char)(run << 8);
+            continue;
+        }
+        for (bit = 0; (bit < 256) && ((0x110000 == table->firstMember) || (0x110000 == table->firstNonMember)); bit++) {
+            UTF32Char character = (UTF32Char)((run << 8) | bit);
+            if (_CFCharacterSetTableIsMember(table, character)) {
+                if (0x110000 == table->firstMember) table->firstMember = character;
+            } else {
+                if (0x110000 == table->firstNonMember) table->firstNonMember = character;
+            }
+        }
+    }
+
+    free(runBits);
+    CFRelease(bitmapRep);
+    return table;
+}
+
+const _CFCharacterSetTable *_CFCharacterSetGetTable(CFCharacterSetRef cset) {
+    _CFCharacterSetTable *table;
+
+    if (CF_IS_OBJC(__kCFCharacterSetTypeID, cset) || __CFCSetIsMutable(cset)) return NULL;
+
+    if (NULL == (table = cset->_table)) {
+        table = __CFCSetCreateTable(cset);
+        if (!OSAtomicCompareAndSwapPtrBarrier(NULL, table, (void * volatile *)&(((CFMutableCharacterSetRef)cset)->_table))) {
+            CFAllocatorDeallocate(kCFAllocatorSystemDefault, table);
+            table = cset->_table;
+        }
+    }
+    return table;
+}
+
+// Index of the first (or, backwards, the last) character whose membership is wantMember
+static CFIndex __CFCSetFindInCharacters(CFCharacterSetRef cset, const UniChar *characters, CFIndex length, Boolean wantMember, Boolean backwards) {
+    const _CFCharacterSetTable *table = _CFCharacterSetGetTable(cset);
+    CFCharacterSetInlineBuffer buffer;
+    UniChar skipLimit = 0;	// Units below this, which are never surrogates, can't be what we are looking for
+    CFIndex idx;
+
+    if (NULL == table) {
+        CFCharacterSetInitInlineBuffer(cset, &buffer);
+    } else {
+        UTF32Char limit = (wantMember ? table->firstMember : table->firstNonMember);
+        skipLimit = (UniChar)((limit < 0xD800) ? limit : 0xD800);
+    }
+
+    // As CFStringFindCharacterFromSet() has always done, a surrogate is taken together with the unit next to it in the direction of the search; the two are looked up only if they form a pair, and are otherwise passed over (as is one left without a neighbour at the end)
+    if (backwards) {
+        for (idx = length - 1; idx >= 0; idx--) {
+            UTF32Char character = characters[idx];
+            if (character < skipLimit) continue;
+            if (CFUniCharIsSurrogateHighCharacter(character) || CFUniCharIsSurrogateLowCharacter(character)) {
+                if (idx == 0) break;
+                idx--;
+                if (CFUniCharIsSurrogateLowCharacter(character) && CFUniCharIsSurrogateHighCharacter(characters[idx])) {
+                    character = CFUniCharGetLongCharacterForSurrogatePair(characters[idx], character);
+                    if ((table ? _CFCharacterSetTableIsMember(table, character) : CFCharacterSetInlineBufferIsLongCharacterMember(&buffer, character)) == wantMember) return idx;
+                }
+                continue;
+            }
+            if ((table ? _CFCharacterSetTableIsMember(table, character) : CFCharacterSetInlineBufferIsLongCharacterMember(&buffer, character)) == wantMember) return idx;
+        }
+    } else {
+        idx = 0;
+        while (idx < length) {
+            UTF32Char character;
+
+            if (characters[idx] < skipLimit) {
+                idx = __CFByteScanFindUTF16AtLeast(characters + idx, characters + length, skipLimit) - characters;
+                if (idx == length) break;
+            }
+            character = characters[idx];
+            if (CFUniCharIsSurrogateHighCharacter(character) || CFUniCharIsSurrogateLowCharacter(character)) {
+                if (idx + 1 == length) break;
+                if (CFUniCharIsSurrogateHighCharacter(character) && CFUniCharIsSurrogateLowCharacter(characters[idx + 1])) {
+                    character = CFUniCharGetLongCharacterForSurrogatePair(character, characters[idx + 1]);
+                    if ((table ? _CFCharacterSetTableIsMember(table, character) : CFCharacterSetInlineBufferIsLongCharacterMember(&buffer, character)) == wantMember) return idx;
+                }
+                idx += 2;
+                continue;
+            }
+            if ((table ? _CFCharacterSetTableIsMember(table, character) : CFCharacterSetInlineBufferIsLongCharacterMember(&buffer, character)) == wantMember) return idx;
+            idx++;
+        }
+    }
+    return kCFNotFound;
+}
+
+CFIndex _CFCharacterSetFindFirstMember(CFCharacterSetRef cset, const UniChar *characters, CFIndex length) {
+    return __CFCSetFindInCharacters(cset, characters, length, true, false);
+}
+
+CFIndex _CFCharacterSetFindFirstNonMember(CFCharacterSetRef cset, const UniChar *characters, CFIndex length) {
+    return __CFCSetFindInCharacters(cset, characters, length, false, false);
+}
+
+CFIndex _CFCharacterSetFindLastMember(CFCharacterSetRef cset, const UniChar *characters, CFIndex length) {
+    return __CFCSetFindInCharacters(cset, characters, length, true, true);
+}
+
+CFIndex _CFCharacterSetFindLastNonMember(CFCharacterSetRef cset, const UniChar *characters, CFIndex length) {
+    return __CFCSetFindInCharacters(cset, characters, length, false, true);
+}
@@ -38,7 +38,21 @@
 #include <sys/stat.h>
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI || DEPLOYMENT_TARGET_LINUX
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#define FILE_STREAM_MAPPING 1
+#else
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+
+// A short writev() is allowed, so writing out the first non-empty buffer is enough
+static CFIndex writev(int fd, const struct iovec *iov, int iovcnt) {
+    while (0 < iovcnt && iov->iov_len == 0) iov++, iovcnt--;
+    return (0 < iovcnt) ? write(fd, iov->iov_base, (unsigned int)iov->iov_len) : 0;
+}
 #endif
 
 
@@ -47,6 +61,16 @@
 #define APPEND                (3)
 #define AT_EOF                (4)
 #define USE_RUNLOOP_ARRAY     (5)
+#define MAPPED                (6)
+
+// With _kCFStreamPropertyFileMapped set, regular files at least this big are read through a mapping
+#define FILE_MAP_MIN_LENGTH   (1024 * 1024)
+// Size of the read-ahead block used to serve CFReadStreamGetBuffer() when the file is not mapped
+#define FILE_READ_BLOCK       (256 * 1024)
+// Most buffers handed to a single writev(); well under IOV_MAX everywhere
+#define FILE_WRITE_IOV_MAX    (64)
+// Default for _kCFStreamPropertyFileWriteCoalescingInterval
+#define FILE_COALESCE_INTERVAL (0.5)
 
 
 /* File callbacks */
@@ -63,10 +87,29 @@ typedef struct {
 #endif
     CFOptionFlags flags;    
     off_t offset;
+    // Read streams only. With _kCFStreamPropertyFileMapped set, a large regular file is mapped at open and served from the mapping until its end, after which reads go back to the fd, so growth of the file is still seen. Anything else reads ahead in FILE_READ_BLOCK chunks, but only when CFReadStreamGetBuffer() asks for bytes.
+    UInt8 *map;
+    off_t mapLength;
+    off_t mapPosition;
+    UInt8 *readAhead;
+    CFIndex readAheadPosition;
+    CFIndex readAheadLength;
+    // Write streams only. With _kCFStreamPropertyFileWriteCoalescing set, writes are collected in coalesceBuffer and go out with one writev() when the next one would not fit, when the oldest of them is older than coalesceInterval, or when the stream is flushed: _CFWriteStreamFlush(), kCFStreamPropertyFileCurrentOffset, close. coalesceTimer writes out the bytes of a writer that went idle, from the coalescing queue, so the buffer is only touched with coalesceLock held.
+    UInt8 *coalesceBuffer;
+    CFIndex coalesceCapacity;
+    CFIndex coalesceLength;
+    dispatch_time_t coalesceDeadline; // When the oldest coalesced bytes are due
+    CFTimeInterval coalesceInterval;
+    CFLock_t coalesceLock;
+    dispatch_source_t coalesceTimer;
+    int coalesceError; // errno of a write made by coalesceTimer, reported by the next write or flush
 } _CFFileStreamContext;
 
 
 CONST_STRING_DECL(kCFStreamPropertyFileCurrentOffset, "kCFStreamPropertyFileCurrentOffset");
+CONST_STRING_DECL(_kCFStreamPropertyFileMapped, "_kCFStreamPropertyFileMapped");
+CONST_STRING_DECL(_kCFStreamPropertyFileWriteCoalescing, "_kCFStreamPropertyFileWriteCoalescing");
+CONST_STRING_DECL(_kCFStreamPropertyFileWriteCoalescingInterval, "_kCFStreamPropertyFileWriteCoalescingInterval");
 #if DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI
 CONST_STRING_DECL(_kCFStreamPropertyFileNativeHandle, "_kCFStreamPropertyFileNativeHandle");
 #endif
@@ -142,12 +185,49 @@ static Boolean constructFD(_CFFileStreamContext *fileStream, CFStreamError *erro
     return FALSE;
 }
 
+// Maps the file if the client asked for it with _kCFStreamPropertyFileMapped and it is a large regular file with a good part of it left to read. Mapping is opt-in because a file truncated while it is mapped raises SIGBUS instead of giving a short read.
+static void fileMapForReading(_CFFileStreamContext *ctxt) {
+#if FILE_STREAM_MAPPING
+    struct stat statbuf;
+    if (!__CFBitIsSet(ctxt->flags, MAPPED) || fstat(ctxt->fd, &statbuf) != 0 || S_IFREG != (statbuf.st_mode & S_IFMT)) return;
+    if (statbuf.st_size < FILE_MAP_MIN_LENGTH || (uint64_t)statbuf.st_size > (uint64_t)(SIZE_MAX / 2)) return;
+    off_t position = lseek(ctxt->fd, 0, SEEK_CUR);
+    if (position < 0 || statbuf.st_size - position < FILE_MAP_MIN_LENGTH) return;
+    void *map = mmap(NULL, (size_t)statbuf.st_size, PROT_READ, MAP_PRIVATE, ctxt->fd, 0);
+    if (map == MAP_FAILED) return;
+    madvise(map, (size_t)statbuf.st_size, MADV_SEQUENTIAL);
+    ctxt->map = (UInt8 *)map;
+    ctxt->mapLength = statbuf.st_size;
+    ctxt->mapPosition = position;
+#endif
+}
+
+// Drops the mapping, leaving the fd positioned where reading left off
+static void fileUnmap(_CFFileStreamContext *ctxt) {
+#if FILE_STREAM_MAPPING
+    if (!ctxt->map) return;
+    munmap(ctxt->map, (size_t)ctxt->mapLength);
+    ctxt->map = NULL;
+    if (ctxt->fd >= 0) lseek(ctxt->fd, ctxt->mapPosition, SEEK_SET);
+#endif
+}
+
+static void fileReleaseReadBuffers(_CFFileStreamContext *ctxt) {
+    fileUnmap(ctxt);
+    if (ctxt->readAhead) {
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, ctxt->readAhead);
+        ctxt->readAhead = NULL;
+    }
+    ctxt->readAheadPosition = ctxt->readAheadLength = 0;
+}
+
 static Boolean fileOpen(struct _CFStream *stream, CFStreamError *errorCode, Boolean *openComplete, void *info) {
     _CFFileStreamContext *ctxt = (_CFFileStreamContext *)info;
     Boolean forRead = (CFGetTypeID(stream) == CFReadStreamGetTypeID());
     *openComplete = TRUE;
     if (ctxt->url) {
         if (constructFD(ctxt, errorCode, forRead, stream)) {
+            if (forRead) fileMapForReading(ctxt);
 #ifndef REAL_FILE_SCHEDULING
             if (ctxt->scheduled > 0) {
                 if (forRead)
@@ -160,11 +240,13 @@ static Boolean fileOpen(struct _CFStream *stream, CFStreamError *errorCode, Bool
         } else {
             return FALSE;
         }
+    }
+    if (forRead && ctxt->fd >= 0) fileMapForReading(ctxt);
 #ifdef REAL_FILE_SCHEDULING
-    } else if (ctxt->rlInfo.rlArray != NULL) {
+    if (ctxt->rlInfo.rlArray != NULL) {
         constructCFFD(ctxt, forRead, stream);
-#endif
     }
+#endif
     return TRUE;
 }
 
@@ -181,10 +263,7 @@ CF_PRIVATE CFIndex fdRead(int fd, UInt8 *buffer, CFIndex bufferLength, CFStreamE
     }
 }
 
-static CFIndex fileRead(CFReadStreamRef stream, UInt8 *buffer, CFIndex bufferLength, CFStreamError *errorCode, Boolean *atEOF, void *info) {
-    _CFFileStreamContext *ctxt = (_CFFileStreamContext *)info;
-    CFIndex result;
-    result = fdRead(ctxt->fd, buffer, bufferLength, errorCode, atEOF);
+static void fileDidRead(CFReadStreamRef stream, _CFFileStreamContext *ctxt, Boolean *atEOF) {
 #ifdef REAL_FILE_SCHEDULING
     if (__CFBitIsSet(ctxt->flags, SCHEDULE_AFTER_READ)) {
         __CFBitClear(ctxt->flags, SCHEDULE_AFTER_READ);
@@ -192,7 +271,7 @@ static CFIndex fileRead(CFReadStreamRef stream, UInt8 *buffer, CFIndex bufferLen
             struct stat statbuf;
             int ret = fstat(ctxt->fd, &statbuf);
             if (0 <= ret && (S_IFREG == (statbuf.st_mode & S_IFMT))) {
-                off_t offset = lseek(ctxt->fd, 0, SEEK_CUR);
+                off_t offset = ctxt->map ? ctxt->mapPosition : lseek(ctxt->fd, 0, SEEK_CUR);
                 if (statbuf.st_size == offset) {
                     _CFFileDescriptorInduceFakeReadCallBack(ctxt->rlInfo.cffd);
                 }
@@ -209,6 +288,65 @@ static CFIndex fileRead(CFReadStreamRef stream, UInt8 *buffer, CFIndex bufferLen
         CFReadStreamSignalEvent(stream, kCFStreamEventHasBytesAvailable, NULL);
     }
 #endif
+}
+
+static CFIndex fileRead(CFReadStreamRef stream, UInt8 *buffer, CFIndex bufferLength, CFStreamError *errorCode, Boolean *atEOF, void *info) {
+    _CFFileStreamContext *ctxt = (_CFFileStreamContext *)info;
+    CFIndex result;
+    if (ctxt->map && ctxt->mapPosition >= ctxt->mapLength) fileUnmap(ctxt);
+    if (ctxt->map) {
+        off_t available = ctxt->mapLength - ctxt->mapPosition;
+        result = (available < bufferLength) ? (CFIndex)available : bufferLength;
+        memmove(buffer, ctxt->map + ctxt->mapPosition, result);
+        ctxt->mapPosition += result;
+        errorCode->error = 0;
+        *atEOF = FALSE;
+    } else if (ctxt->readAheadPosition < ctxt->readAheadLength) {
+        CFIndex available = ctxt->readAheadLength - ctxt->readAheadPosition;
+        result = (available < bufferLength) ? available : bufferLength;
+        memmove(buffer, ctxt->readAhead + ctxt->readAheadPosition, result);
+        ctxt->readAheadPosition += result;
+        errorCode->error = 0;
+        *atEOF = FALSE;
+    } else {
+        result = fdRead(ctxt->fd, buffer, bufferLength, errorCode, atEOF);
+    }
+    fileDidRead(stream, ctxt, atEOF);
+    return result;
+}
+
+// Hands out the mapping directly; otherwise refills the read-ahead block with a single read() when it is empty
+static const UInt8 *fileGetBuffer(CFReadStreamRef stream, CFIndex maxBytesToRead, CFIndex *numBytesRead, CFStreamError *errorCode, Boolean *atEOF, void *info) {
+    _CFFileStreamContext *ctxt = (_CFFileStreamContext *)info;
+    const UInt8 *result = NULL;
+    *numBytesRead = 0;
+    *atEOF = FALSE;
+    errorCode->error = 0;
+    if (ctxt->map && ctxt->mapPosition >= ctxt->mapLength) fileUnmap(ctxt);
+    if (ctxt->map) {
+        off_t available = ctxt->mapLength - ctxt->mapPosition;
+        // maxBytesToRead <= 0 asks for everything readily available
+        *numBytesRead = (maxBytesToRead <= 0 || available < maxBytesToRead) ? (CFIndex)available : maxBytesToRead;
+        result = ctxt->map + ctxt->mapPosition;
+        // The bytes have to stay valid until the caller's next read, so an exhausted mapping is only let go of then
+        ctxt->mapPosition += *numBytesRead;
+    } else {
+        if (ctxt->readAheadPosition == ctxt->readAheadLength) {
+            if (!ctxt->readAhead) {
+                ctxt->readAhead = (UInt8 *)CFAllocatorAllocate(kCFAllocatorSystemDefault, FILE_READ_BLOCK, 0);
+                if (!ctxt->readAhead) HALT;
+            }
+            CFIndex got = fdRead(ctxt->fd, ctxt->readAhead, FILE_READ_BLOCK, errorCode, atEOF);
+            ctxt->readAheadPosition = 0;
+            ctxt->readAheadLength = (got < 0) ? 0 : got;
+            if (got < 0) return NULL;
+        }
+        CFIndex available = ctxt->readAheadLength - ctxt->readAheadPosition;
+        *numBytesRead = (maxBytesToRead <= 0 || available < maxBytesToRead) ? available : maxBytesToRead;
+        if (*numBytesRead > 0) result = ctxt->readAhead + ctxt->readAheadPosition;
+        ctxt->readAheadPosition += *numBytesRead;
+    }
+    fileDidRead(stream, ctxt, atEOF);
     return result;
 }
 
@@ -239,6 +377,7 @@ CF_PRIVATE Boolean fdCanRead(int fd) {
 
 static Boolean fileCanRead(CFReadStreamRef stream, void *info) {
     _CFFileStreamContext *ctxt = (_CFFileStreamContext *)info;
+    if (ctxt->map || ctxt->readAheadPosition < ctxt->readAheadLength) return TRUE;
 #ifdef REAL_FILE_SCHEDULING
     return fdCanRead(ctxt->fd);
 #else
@@ -258,9 +397,160 @@ CF_PRIVATE CFIndex fdWrite(int fd, const UInt8 *buffer, CFIndex bufferLength, CF
     }
 }
 
-static CFIndex fileWrite(CFWriteStreamRef stream, const UInt8 *buffer, CFIndex bufferLength, CFStreamError *errorCode, void *info) {
-    _CFFileStreamContext *fileStream = ((_CFFileStreamContext *)info);
-    CFIndex result = fdWrite(fileStream->fd, buffer, bufferLength, errorCode);
+// Writes all of iov, retrying short writes; the array is used up in the process
+static Boolean fdWriteAll(int fd, struct iovec *iov, int iovcnt, CFStreamError *errorCode) {
+    while (0 < iovcnt) {
+        CFIndex bytesWritten = writev(fd, iov, (iovcnt < FILE_WRITE_IOV_MAX) ? iovcnt : FILE_WRITE_IOV_MAX);
+        if (bytesWritten < 0 && errno == EINTR) continue;
+        if (bytesWritten <= 0) {
+            errorCode->error = (bytesWritten < 0) ? errno : ENOSPC;
+            errorCode->domain = kCFStreamErrorDomainPOSIX;
+            return FALSE;
+        }
+        while (0 < iovcnt && (size_t)bytesWritten >= iov->iov_len) {
+            bytesWritten -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (0 < iovcnt) {
+            iov->iov_base = (UInt8 *)iov->iov_base + bytesWritten;
+            iov->iov_len -= bytesWritten;
+        }
+    }
+    errorCode->error = 0;
+    return TRUE;
+}
+
+// Writes out the coalesced bytes followed by the given buffers, in as few system calls as possible
+static Boolean fileWriteCoalesced(_CFFileStreamContext *ctxt, const UInt8 *const *buffers, const CFIndex *lengths, CFIndex count, CFStreamError *errorCode) {
+    struct iovec stackIOV[FILE_WRITE_IOV_MAX];
+    struct iovec *iov = (count < FILE_WRITE_IOV_MAX) ? stackIOV : (struct iovec *)CFAllocatorAllocate(kCFAllocatorSystemDefault, (count + 1) * sizeof(struct iovec), 0);
+    int iovcnt = 0;
+    if (!iov) HALT;
+    if (ctxt->coalesceLength) {
+        iov[iovcnt].iov_base = ctxt->coalesceBuffer;
+        iov[iovcnt++].iov_len = ctxt->coalesceLength;
+    }
+    for (CFIndex idx = 0; idx < count; idx++) {
+        if (lengths[idx] == 0) continue;
+        iov[iovcnt].iov_base = (void *)buffers[idx];
+        iov[iovcnt++].iov_len = lengths[idx];
+    }
+    Boolean result = fdWriteAll(ctxt->fd, iov, iovcnt, errorCode);
+    // On failure the stream is in error; whatever was left unwritten is dropped
+    ctxt->coalesceLength = 0;
+    if (iov != stackIOV) CFAllocatorDeallocate(kCFAllocatorSystemDefault, iov);
+    return result;
+}
+
+// Called with coalesceLock held. Hands out the error of a write made by the timer, which had nobody to report it to.
+static Boolean fileTakeCoalesceError(_CFFileStreamContext *ctxt, CFStreamError *errorCode) {
+    if (!ctxt->coalesceError) return FALSE;
+    errorCode->error = ctxt->coalesceError;
+    errorCode->domain = kCFStreamErrorDomainPOSIX;
+    ctxt->coalesceError = 0;
+    return TRUE;
+}
+
+static Boolean fileFlush(_CFFileStreamContext *ctxt, CFStreamError *errorCode) {
+    Boolean result = TRUE;
+    errorCode->error = 0;
+    __CFLock(&ctxt->coalesceLock);
+    if (fileTakeCoalesceError(ctxt, errorCode)) {
+        result = FALSE;
+    } else if (ctxt->coalesceLength && ctxt->fd >= 0) {
+        result = fileWriteCoalesced(ctxt, NULL, NULL, 0, errorCode);
+    }
+    __CFUnlock(&ctxt->coalesceLock);
+    return result;
+}
+
+static dispatch_queue_t fileCoalesceQueue(void) {
+    static dispatch_queue_t queue = NULL;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        queue = dispatch_queue_create("com.apple.CFStream.file.coalesce", DISPATCH_QUEUE_SERIAL);
+    });
+    return queue;
+}
+
+// Runs on the coalescing queue once the oldest coalesced bytes are due, in case no write comes along to send them
+static void fileCoalesceTimerFired(_CFFileStreamContext *ctxt) {
+    __CFLock(&ctxt->coalesceLock);
+    if (ctxt->coalesceLength && ctxt->fd >= 0 && ctxt->coalesceDeadline <= dispatch_time(DISPATCH_TIME_NOW, 0)) {
+        CFStreamError error;
+        if (!fileWriteCoalesced(ctxt, NULL, NULL, 0, &error)) ctxt->coalesceError = error.error;
+    }
+    __CFUnlock(&ctxt->coalesceLock);
+}
+
+// Called with coalesceLock held, as the buffer goes from empty to not
+static void fileArmCoalesceTimer(_CFFileStreamContext *ctxt) {
+    if (!ctxt->coalesceTimer) {
+        ctxt->coalesceTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, fileCoalesceQueue());
+        if (!ctxt->coalesceTimer) return;
+        dispatch_source_set_event_handler(ctxt->coalesceTimer, ^{
+            fileCoalesceTimerFired(ctxt);
+        });
+        dispatch_source_set_timer(ctxt->coalesceTimer, ctxt->coalesceDeadline, DISPATCH_TIME_FOREVER, (uint64_t)(ctxt->coalesceInterval * NSEC_PER_SEC / 10));
+        dispatch_resume(ctxt->coalesceTimer);
+    } else {
+        dispatch_source_set_timer(ctxt->coalesceTimer, ctxt->coalesceDeadline, DISPATCH_TIME_FOREVER, (uint64_t)(ctxt->coalesceInterval * NSEC_PER_SEC / 10));
+    }
+}
+
+// Stops the timer and waits out a write it may be making; the context can go away after this
+static void fileCancelCoalesceTimer(_CFFileStreamContext *ctxt) {
+    if (!ctxt->coalesceTimer) return;
+    dispatch_source_cancel(ctxt->coalesceTimer);
+    dispatch_sync(fileCoalesceQueue(), ^{});
+    dispatch_release(ctxt->coalesceTimer);
+    ctxt->coalesceTimer = NULL;
+}
+
+static CFIndex fileCoalesceWrite(_CFFileStreamContext *ctxt, const UInt8 *const *buffers, const CFIndex *lengths, CFIndex count, CFStreamError *errorCode) {
+    CFIndex total = 0, result;
+    for (CFIndex idx = 0; idx < count; idx++) total += lengths[idx];
+    __CFLock(&ctxt->coalesceLock);
+    Boolean stale = ctxt->coalesceLength && ctxt->coalesceDeadline <= dispatch_time(DISPATCH_TIME_NOW, 0);
+    if (fileTakeCoalesceError(ctxt, errorCode)) {
+        result = -1;
+    } else if (!stale && total <= ctxt->coalesceCapacity - ctxt->coalesceLength) {
+        if (ctxt->coalesceLength == 0 && total) {
+            ctxt->coalesceDeadline = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(ctxt->coalesceInterval * NSEC_PER_SEC));
+            fileArmCoalesceTimer(ctxt);
+        }
+        for (CFIndex idx = 0; idx < count; idx++) {
+            memmove(ctxt->coalesceBuffer + ctxt->coalesceLength, buffers[idx], lengths[idx]);
+            ctxt->coalesceLength += lengths[idx];
+        }
+        errorCode->error = 0;
+        result = total;
+    } else {
+        result = fileWriteCoalesced(ctxt, buffers, lengths, count, errorCode) ? total : -1;
+    }
+    __CFUnlock(&ctxt->coalesceLock);
+    return result;
+}
+
+static Boolean fileSetCoalescing(_CFFileStreamContext *ctxt, CFIndex capacity) {
+    CFStreamError error;
+    if (capacity < 0 || !fileFlush(ctxt, &error)) return FALSE;
+    __CFLock(&ctxt->coalesceLock);
+    if (capacity != ctxt->coalesceCapacity) {
+        if (ctxt->coalesceBuffer) CFAllocatorDeallocate(kCFAllocatorSystemDefault, ctxt->coalesceBuffer);
+        ctxt->coalesceBuffer = NULL;
+        if (capacity) {
+            ctxt->coalesceBuffer = (UInt8 *)CFAllocatorAllocate(kCFAllocatorSystemDefault, capacity, 0);
+            if (!ctxt->coalesceBuffer) HALT;
+        }
+        ctxt->coalesceCapacity = capacity;
+    }
+    __CFUnlock(&ctxt->coalesceLock);
+    return TRUE;
+}
+
+static void fileDidWrite(CFWriteStreamRef stream, _CFFileStreamContext *fileStream) {
 #ifdef REAL_FILE_SCHEDULING
     if (__CFBitIsSet(fileStream->flags, SCHEDULE_AFTER_WRITE)) {
         __CFBitClear(fileStream->flags, SCHEDULE_AFTER_WRITE);
@@ -273,9 +563,49 @@ static CFIndex fileWrite(CFWriteStreamRef stream, const UInt8 *buffer, CFIndex b
         CFWriteStreamSignalEvent(stream, kCFStreamEventCanAcceptBytes, NULL);
     }
 #endif
+}
+
+static CFIndex fileWrite(CFWriteStreamRef stream, const UInt8 *buffer, CFIndex bufferLength, CFStreamError *errorCode, void *info) {
+    _CFFileStreamContext *fileStream = ((_CFFileStreamContext *)info);
+    CFIndex result;
+    if (fileStream->coalesceCapacity) {
+        result = fileCoalesceWrite(fileStream, &buffer, &bufferLength, 1, errorCode);
+    } else {
+        result = fdWrite(fileStream->fd, buffer, bufferLength, errorCode);
+    }
+    fileDidWrite(stream, fileStream);
     return result;
 }
 
+// Like fileWrite(), the bytes may be taken only in part unless the stream coalesces writes
+CF_PRIVATE CFIndex __CFFileStreamWriteVector(CFWriteStreamRef stream, const UInt8 *const *buffers, const CFIndex *lengths, CFIndex count, CFStreamError *errorCode, void *info) {
+    _CFFileStreamContext *fileStream = ((_CFFileStreamContext *)info);
+    CFIndex result;
+    if (fileStream->coalesceCapacity) {
+        result = fileCoalesceWrite(fileStream, buffers, lengths, count, errorCode);
+    } else {
+        struct iovec iov[FILE_WRITE_IOV_MAX];
+        int iovcnt = 0;
+        for (CFIndex idx = 0; idx < count && iovcnt < FILE_WRITE_IOV_MAX; idx++) {
+            iov[iovcnt].iov_base = (void *)buffers[idx];
+            iov[iovcnt++].iov_len = lengths[idx];
+        }
+        result = writev(fileStream->fd, iov, iovcnt);
+        if (result < 0) {
+            errorCode->error = errno;
+            errorCode->domain = kCFStreamErrorDomainPOSIX;
+        } else {
+            errorCode->error = 0;
+        }
+    }
+    fileDidWrite(stream, fileStream);
+    return result;
+}
+
+CF_PRIVATE Boolean __CFFileStreamFlush(CFWriteStreamRef stream, CFStreamError *errorCode, void *info) {
+    return fileFlush((_CFFileStreamContext *)info, errorCode);
+}
+
 #ifdef REAL_FILE_SCHEDULING
 CF_PRIVATE Boolean fdCanWrite(int fd) {
     struct timeval timeout = {0, 0};
@@ -310,6 +640,11 @@ static Boolean fileCanWrite(CFWriteStreamRef stream, void *info) {
 
 static void fileClose(struct _CFStream *stream, void *info) {
     _CFFileStreamContext *ctxt = (_CFFileStreamContext *)info;
+    CFStreamError error;
+    fileCancelCoalesceTimer(ctxt);
+    // Close has no way to report it, so a failure here is only seen by those who flushed first
+    fileFlush(ctxt, &error);
+    fileReleaseReadBuffers(ctxt);
     if (ctxt->fd >= 0) {
         close(ctxt->fd);
         ctxt->fd = -1;
@@ -428,8 +763,15 @@ static CFTypeRef fileCopyProperty(struct _CFStream *stream, CFStringRef property
         // NOTE that this does a lseek of 0 from the current location in
         // order to populate the offset field which will then be used to
         // create the resulting value.
-        if (!__CFBitIsSet(fileStream->flags, APPEND) && fileStream->fd != -1) {
+        CFStreamError error;
+        if (!fileFlush(fileStream, &error)) {
+            fileStream->offset = -1;
+        } else if (fileStream->map) {
+            fileStream->offset = fileStream->mapPosition;
+        } else if (!__CFBitIsSet(fileStream->flags, APPEND) && fileStream->fd != -1) {
             fileStream->offset = lseek(fileStream->fd, 0, SEEK_CUR);
+            // Bytes read ahead have not been handed out yet
+            if (fileStream->offset != -1) fileStream->offset -= fileStream->readAheadLength - fileStream->readAheadPosition;
         }
         
         if (fileStream->offset != -1) {
@@ -466,13 +808,43 @@ static Boolean fileSetProperty(struct _CFStream *stream, CFStringRef prop, CFTyp
     
     else if (CFEqual(prop, kCFStreamPropertyFileCurrentOffset)) {
         
+        CFStreamError error;
         if (!__CFBitIsSet(fileStream->flags, APPEND))
         {
             result = CFNumberGetValue((CFNumberRef)val, kCFNumberSInt64Type, &(fileStream->offset));
         }
         
-        if ((fileStream->fd != -1) && (lseek(fileStream->fd, fileStream->offset, SEEK_SET) == -1)) {
+        if (!fileFlush(fileStream, &error)) {
+            result = FALSE;
+        } else if ((fileStream->fd != -1) && (lseek(fileStream->fd, fileStream->offset, SEEK_SET) == -1)) {
             result = FALSE;
+        } else if (result) {
+            if (fileStream->map) fileStream->mapPosition = fileStream->offset;
+            fileStream->readAheadPosition = fileStream->readAheadLength = 0;
+        }
+    }
+    
+    else if (CFEqual(prop, _kCFStreamPropertyFileMapped) && CFGetTypeID(stream) == CFReadStreamGetTypeID() &&
+        CFReadStreamGetStatus((CFReadStreamRef)stream) == kCFStreamStatusNotOpen)
+    {
+        if (val == kCFBooleanTrue) {
+            __CFBitSet(fileStream->flags, MAPPED);
+        } else {
+            __CFBitClear(fileStream->flags, MAPPED);
+        }
+        result = TRUE;
+    }
+    
+    else if (CFEqual(prop, _kCFStreamPropertyFileWriteCoalescing) && CFGetTypeID(stream) == CFWriteStreamGetTypeID()) {
+        CFIndex capacity = 0;
+        if (val && CFGetTypeID(val) == CFNumberGetTypeID() && CFNumberGetValue((CFNumberRef)val, kCFNumberCFIndexType, &capacity)) {
+            result = fileSetCoalescing(fileStream, capacity);
+        }
+    }
+    
+    else if (CFEqual(prop, _kCFStreamPropertyFileWriteCoalescingInterval) && CFGetTypeID(stream) == CFWriteStreamGetTypeID()) {
+        if (val && CFGetTypeID(val) == CFNumberGetTypeID()) {
+            result = CFNumberGetValue((CFNumberRef)val, kCFNumberDoubleType, &(fileStream->coalesceInterval));
         }
     }
     
@@ -495,11 +867,28 @@ static void *fileCreate(struct _CFStream *stream, void *info) {
 #endif
     newCtxt->flags = 0;
     newCtxt->offset = -1;
+    newCtxt->map = NULL;
+    newCtxt->mapLength = newCtxt->mapPosition = 0;
+    newCtxt->readAhead = NULL;
+    newCtxt->readAheadPosition = newCtxt->readAheadLength = 0;
+    newCtxt->coalesceBuffer = NULL;
+    newCtxt->coalesceCapacity = newCtxt->coalesceLength = 0;
+    newCtxt->coalesceDeadline = 0;
+    newCtxt->coalesceInterval = FILE_COALESCE_INTERVAL;
+    const CFLock_t lock = CFLockInit;
+    newCtxt->coalesceLock = lock;
+    newCtxt->coalesceTimer = NULL;
+    newCtxt->coalesceError = 0;
     return newCtxt;
 }
 
 static void	fileFinalize(struct _CFStream *stream, void *info) {
     _CFFileStreamContext *ctxt = (_CFFileStreamContext *)info;
+    CFStreamError error;
+    fileCancelCoalesceTimer(ctxt);
+    fileFlush(ctxt, &error);
+    if (ctxt->coalesceBuffer) CFAllocatorDeallocate(kCFAllocatorSystemDefault, ctxt->coalesceBuffer);
+    fileReleaseReadBuffers(ctxt);
     if (ctxt->fd > 0) {
 #ifdef REAL_FILE_SCHEDULING
         if (ctxt->rlInfo.cffd) {
@@ -794,7 +1183,11 @@ static CFStringRef writeDataCopyDescription(struct _CFStream *stream, void *info
     return CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("<CFWriteDataContext %p>"), info);
 }
 
-static const struct _CFStreamCallBacksV1 fileCallBacks = {1, fileCreate, fileFinalize, fileCopyDescription, fileOpen, NULL, fileRead, NULL, fileCanRead, fileWrite, fileCanWrite, fileClose, fileCopyProperty, fileSetProperty, NULL, fileSchedule, fileUnschedule};
+static const struct _CFStreamCallBacksV1 fileCallBacks = {1, fileCreate, fileFinalize, fileCopyDescription, fileOpen, NULL, fileRead, fileGetBuffer, fileCanRead, fileWrite, fileCanWrite, fileClose, fileCopyProperty, fileSetProperty, NULL, fileSchedule, fileUnschedule};
+
+CF_PRIVATE const struct _CFStreamCallBacks *__CFFileStreamGetCallBacks(void) {
+    return (const struct _CFStreamCallBacks *)(&fileCallBacks);
+}
 
 static struct _CFStream *_CFStreamCreateWithFile(CFAllocatorRef alloc, CFURLRef fileURL, Boolean forReading) {
     _CFFileStreamContext fileContext;
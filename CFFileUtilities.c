@@ -83,6 +83,7 @@ CF_PRIVATE Boolean _CFCreateDirectory(const char *path) {
     int no_hang_fd = openAutoFSNoWait();
     int ret = ((mkdir(path, 0777) == 0) ? true : false);
     closeAutoFSNoWait(no_hang_fd);
+    if (ret) _CFInvalidatePathPropertiesCache(path);
     return ret;
 }
 
@@ -90,6 +91,7 @@ CF_PRIVATE Boolean _CFRemoveDirectory(const char *path) {
     int no_hang_fd = openAutoFSNoWait();
     int ret = ((rmdir(path) == 0) ? true : false);
     closeAutoFSNoWait(no_hang_fd);
+    if (ret) _CFInvalidatePathPropertiesCache(path);
     return ret;
 }
 
@@ -97,6 +99,7 @@ CF_PRIVATE Boolean _CFDeleteFile(const char *path) {
     int no_hang_fd = openAutoFSNoWait();
     int ret = unlink(path) == 0;
     closeAutoFSNoWait(no_hang_fd);
+    if (ret) _CFInvalidatePathPropertiesCache(path);
     return ret;
 }
 
@@ -201,6 +204,7 @@ CF_PRIVATE Boolean _CFWriteBytesToFile(CFURLRef url, const void *bytes, CFIndex
         closeAutoFSNoWait(no_hang_fd);
         return false;
     }
+    _CFInvalidatePathPropertiesCache(path);
     if (length && write(fd, bytes, length) != length) {
         int saveerr = thread_errno();
         close(fd);
@@ -611,6 +615,103 @@ CF_PRIVATE SInt32 _CFGetFileProperties(CFAllocatorRef alloc, CFURLRef pathURL, B
     return _CFGetPathProperties(alloc, path, exists, posixMode, size, modTime, ownerID, dirContents);
 }
 
+/* A small, short-lived cache of stat() results for code that probes the same paths over and over, such as bundle and resource lookup. It only holds existence and mode, keeps an entry for PATH_PROPERTIES_CACHE_LIFETIME seconds at most, and is direct-mapped, so a colliding path simply replaces the entry. CF drops entries itself when it creates or removes files; anyone else who changes the file system under a prober calls _CFInvalidatePathPropertiesCache(). */
+#define PATH_PROPERTIES_CACHE_SIZE 256
+#define PATH_PROPERTIES_CACHE_LIFETIME 1.0
+
+typedef struct {
+    char *path;
+    CFHashCode hash;
+    uint64_t expirationTSR;
+    Boolean exists;
+    SInt32 posixMode;
+} __CFPathPropertiesEntry;
+
+static __CFPathPropertiesEntry __CFPathPropertiesCache[PATH_PROPERTIES_CACHE_SIZE];
+static uint32_t __CFPathPropertiesGeneration = 0;
+static CFLock_t __CFPathPropertiesLock = CFLockInit;
+
+static CFHashCode __CFPathPropertiesHash(const char *path) {
+    CFHashCode hash = 2166136261U;
+    while (*path) hash = (hash ^ (uint8_t)*path++) * 16777619U;
+    return hash;
+}
+
+CF_PRIVATE SInt32 _CFGetCachedPathProperties(char *path, Boolean *exists, SInt32 *posixMode) {
+    CFHashCode hash = __CFPathPropertiesHash(path);
+    __CFPathPropertiesEntry *entry = &__CFPathPropertiesCache[hash % PATH_PROPERTIES_CACHE_SIZE];
+    // The lifetime is measured on the monotonic clock, so setting the wall clock back cannot keep an entry alive
+    uint64_t now = mach_absolute_time();
+    Boolean fileExists;
+    SInt32 mode;
+    
+    __CFLock(&__CFPathPropertiesLock);
+    if (entry->path && entry->hash == hash && now < entry->expirationTSR && strcmp(entry->path, path) == 0) {
+        if (exists) *exists = entry->exists;
+        if (posixMode) *posixMode = entry->posixMode;
+        __CFUnlock(&__CFPathPropertiesLock);
+        return 0;
+    }
+    uint32_t generation = __CFPathPropertiesGeneration;
+    __CFUnlock(&__CFPathPropertiesLock);
+    
+    SInt32 result = _CFGetPathProperties(kCFAllocatorSystemDefault, path, &fileExists, &mode, NULL, NULL, NULL, NULL);
+    if (result != 0) return result;
+    if (exists) *exists = fileExists;
+    if (posixMode) *posixMode = mode;
+    
+    // Anything invalidated while stat() ran may be what it saw, so the result is only kept if nothing was
+    char *oldPath = NULL, *newPath = strdup(path);
+    __CFLock(&__CFPathPropertiesLock);
+    if (newPath && generation == __CFPathPropertiesGeneration) {
+        oldPath = entry->path;
+        entry->path = newPath;
+        entry->hash = hash;
+        entry->expirationTSR = now + __CFTimeIntervalToTSR(PATH_PROPERTIES_CACHE_LIFETIME);
+        entry->exists = fileExists;
+        entry->posixMode = mode;
+        newPath = NULL;
+    }
+    __CFUnlock(&__CFPathPropertiesLock);
+    free(oldPath);
+    free(newPath);
+    return 0;
+}
+
+CF_PRIVATE SInt32 _CFGetCachedFileProperties(CFURLRef pathURL, Boolean *exists, SInt32 *posixMode) {
+    char path[CFMaxPathSize];
+    
+    if (!CFURLGetFileSystemRepresentation(pathURL, true, (uint8_t *)path, CFMaxPathLength)) {
+        return -1;
+    }
+    
+    return _CFGetCachedPathProperties(path, exists, posixMode);
+}
+
+CF_EXPORT void _CFInvalidatePathPropertiesCache(const char *path) {
+    char *oldPaths[PATH_PROPERTIES_CACHE_SIZE];
+    CFIndex oldCount = 0;
+    
+    __CFLock(&__CFPathPropertiesLock);
+    __CFPathPropertiesGeneration++;
+    if (path) {
+        __CFPathPropertiesEntry *entry = &__CFPathPropertiesCache[__CFPathPropertiesHash(path) % PATH_PROPERTIES_CACHE_SIZE];
+        if (entry->path && strcmp(entry->path, path) == 0) {
+            oldPaths[oldCount++] = entry->path;
+            entry->path = NULL;
+        }
+    } else {
+        for (CFIndex idx = 0; idx < PATH_PROPERTIES_CACHE_SIZE; idx++) {
+            if (__CFPathPropertiesCache[idx].path) {
+                oldPaths[oldCount++] = __CFPathPropertiesCache[idx].path;
+                __CFPathPropertiesCache[idx].path = NULL;
+            }
+        }
+    }
+    __CFUnlock(&__CFPathPropertiesLock);
+    while (oldCount > 0) free(oldPaths[--oldCount]);
+}
+
 
 #if DEPLOYMENT_TARGET_WINDOWS
 #define WINDOWS_PATH_SEMANTICS
@@ -244,6 +244,18 @@ Boolean __CFPreferencesShouldWriteXML(void) {
     return __CFPreferencesWritesXML;
 }
 
+static CFTimeInterval __CFPreferencesWriteBehindQuietPeriod = 0.0;
+
+CFTimeInterval __CFPreferencesWriteBehindInterval(void) {
+    return __CFPreferencesWriteBehindQuietPeriod;
+}
+
+void _CFPreferencesSetWriteBehindInterval(CFTimeInterval quietPeriod) {
+    __CFPreferencesWriteBehindQuietPeriod = (quietPeriod > 0.0) ? quietPeriod : 0.0;
+    // Nothing should be left waiting on a mode that is off
+    if (quietPeriod <= 0.0) _CFPreferencesFlushWriteBehind();
+}
+
 static CFLock_t domainCacheLock = CFLockInit;
 static CFMutableDictionaryRef  domainCache = NULL; // mutable
 
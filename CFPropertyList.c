@@ -42,6 +42,7 @@
 #endif
 #include <CoreFoundation/CFCalendar.h>
 #include "CFLocaleInternal.h"
+#include "CFByteScan.h"
 #include <limits.h>
 #include <float.h>
 #include <string.h>
@@ -277,22 +278,6 @@ static const char CFXMLPlistTags[13][10]= {
 {'<', '!', '[', 'C', 'D', 'A', 'T', 'A', '[',       '\0'}
 };
 
-static const UniChar CFXMLPlistTagsUnicode[13][10]= {
-    {'p', 'l', 'i', 's', 't',   '\0', '\0', '\0', '\0', '\0'},
-    {'a', 'r', 'r', 'a', 'y',   '\0', '\0', '\0', '\0', '\0'},
-    {'d', 'i', 'c', 't',  '\0', '\0', '\0', '\0', '\0', '\0'},
-    {'k', 'e', 'y', '\0', '\0', '\0', '\0', '\0', '\0', '\0'},
-    {'s', 't', 'r', 'i', 'n', 'g',    '\0', '\0', '\0', '\0'},
-    {'d', 'a', 't', 'a',  '\0', '\0', '\0', '\0', '\0', '\0'},
-    {'d', 'a', 't', 'e',  '\0', '\0', '\0', '\0', '\0', '\0'},
-    {'r', 'e', 'a', 'l',  '\0', '\0', '\0', '\0', '\0', '\0'},
-    {'i', 'n', 't', 'e', 'g', 'e', 'r',     '\0', '\0', '\0'},
-    {'t', 'r', 'u', 'e',  '\0', '\0', '\0', '\0', '\0', '\0'},
-    {'f', 'a', 'l', 's', 'e',   '\0', '\0', '\0', '\0', '\0'},
-    {'D', 'O', 'C', 'T', 'Y', 'P', 'E',     '\0', '\0', '\0'},
-    {'<', '!', '[', 'C', 'D', 'A', 'T', 'A', '[',       '\0'}
-};
-
 typedef struct {
     const char *begin; // first character of the XML to be parsed
     const char *curr;  // current parse location
@@ -305,6 +290,7 @@ typedef struct {
     Boolean allowNewTypes; // Whether to allow the new types supported by XML property lists, but not by the old, OPENSTEP ASCII property lists (CFNumber, CFBoolean, CFDate)
     CFSetRef keyPaths; // if NULL, no filtering
     Boolean skip; // if true, do not create any objects.
+    Boolean allowParallel; // if true, the next <array> or <dict> may have its children parsed concurrently
 } _CFXMLPlistParseInfo;
 
 CF_PRIVATE CFTypeRef __CFCreateOldStylePropertyListOrStringsFile(CFAllocatorRef allocator, CFDataRef xmlData, CFStringRef originalString, CFStringEncoding guessedEncoding, CFOptionFlags option, CFErrorRef *outError,CFPropertyListFormat *format);
@@ -314,134 +300,95 @@ CF_INLINE void __CFPListRelease(CFTypeRef cf, CFAllocatorRef allocator) {
 }
 
 
-// The following set of _plist... functions append various things to a mutable data which is in UTF8 encoding. These are pretty general. Assumption is call characters and CFStrings can be converted to UTF8 and appeneded.
+// The following __CFXMLPlistWriter... functions append UTF-8 to a mutable data. The data is grown ahead of the writes and the bytes are stored through its byte pointer; the data is cut back to what was actually written when the property list is finished.
 
-// Null-terminated, ASCII or UTF8 string
-//
-static void _plistAppendUTF8CString(CFMutableDataRef mData, const char *cString) {
-    CFDataAppendBytes (mData, (const UInt8 *)cString, strlen(cString));
-}
+typedef struct {
+    CFMutableDataRef data;
+    UInt8 *bytes;       // CFDataGetMutableBytePtr(data)
+    CFIndex length;     // bytes written so far
+    CFIndex capacity;   // current length of data
+} __CFXMLPlistWriter;
 
-// UniChars
-//
-static void _plistAppendCharacters(CFMutableDataRef mData, const UniChar *chars, CFIndex length) {
-    CFIndex curLoc = 0;
-
-    do {	// Flush out ASCII chars, BUFLEN at a time
-        #define BUFLEN 400
-	UInt8 buf[BUFLEN], *bufPtr = buf;
-	CFIndex cnt = 0;
-        while (cnt < length && (cnt - curLoc < BUFLEN) && (chars[cnt] < 128)) *bufPtr++ = (UInt8)(chars[cnt++]);
-        if (cnt > curLoc) {	// Flush any ASCII bytes
-            CFDataAppendBytes(mData, buf, cnt - curLoc);
-            curLoc = cnt;
-        }
-    } while (curLoc < length && (chars[curLoc] < 128));	// We will exit out of here when we run out of chars or hit a non-ASCII char
-
-    if (curLoc < length) {	// Now deal with non-ASCII chars
-        CFDataRef data = NULL;
-        CFStringRef str = NULL;
-        if ((str = CFStringCreateWithCharactersNoCopy(kCFAllocatorSystemDefault, chars + curLoc, length - curLoc, kCFAllocatorNull))) {
-            if ((data = CFStringCreateExternalRepresentation(kCFAllocatorSystemDefault, str, kCFStringEncodingUTF8, 0))) {
-                CFDataAppendBytes (mData, CFDataGetBytePtr(data), CFDataGetLength(data));
-                CFRelease(data);
-            }
-            CFRelease(str);
-        }
-        CFAssert1(str && data, __kCFLogAssertion, "%s(): Error writing plist", __PRETTY_FUNCTION__); 
+// Returns room for at least n more bytes
+CF_INLINE UInt8 *__CFXMLPlistWriterReserve(__CFXMLPlistWriter *w, CFIndex n) {
+    if (w->capacity - w->length < n) {
+        CFIndex capacity = 2 * w->capacity;
+        if (capacity < w->length + n) capacity = w->length + n;
+        if (capacity < 4096) capacity = 4096;
+        CFDataSetLength(w->data, capacity);
+        w->bytes = CFDataGetMutableBytePtr(w->data);
+        w->capacity = capacity;
     }
+    return w->bytes + w->length;
 }
 
-// Append CFString
-//
-static void _plistAppendString(CFMutableDataRef mData, CFStringRef str) {
-    const UniChar *chars;
-    const char *cStr;
-    CFDataRef data;
-    if ((chars = CFStringGetCharactersPtr(str))) {
-        _plistAppendCharacters(mData, chars, CFStringGetLength(str));
-    } else if ((cStr = CFStringGetCStringPtr(str, kCFStringEncodingASCII)) || (cStr = CFStringGetCStringPtr(str, kCFStringEncodingUTF8))) {
-        _plistAppendUTF8CString(mData, cStr);
-    } else if ((data = CFStringCreateExternalRepresentation(kCFAllocatorSystemDefault, str, kCFStringEncodingUTF8, 0))) {
-        CFDataAppendBytes (mData, CFDataGetBytePtr(data), CFDataGetLength(data));
-        CFRelease(data);
-    } else {
-	CFAssert1(TRUE, __kCFLogAssertion, "%s(): Error in plist writing", __PRETTY_FUNCTION__);
-    }
+CF_INLINE void __CFXMLPlistWriterAppend(__CFXMLPlistWriter *w, const void *bytes, CFIndex length) {
+    memmove(__CFXMLPlistWriterReserve(w, length), bytes, length);
+    w->length += length;
 }
 
+#define __CFXMLPlistWriterAppendLiteral(w, s) __CFXMLPlistWriterAppend(w, s, sizeof(s) - 1)
 
-// Append CFString-style format + arguments
-//
-static void _plistAppendFormat(CFMutableDataRef mData, CFStringRef format, ...) {
-    CFStringRef fStr; 
-    va_list argList;
-
-    va_start(argList, format);
-    fStr = CFStringCreateWithFormatAndArguments(kCFAllocatorSystemDefault, NULL, format, argList);
-    va_end(argList);
-
-    CFAssert1(fStr, __kCFLogAssertion, "%s(): Error writing plist", __PRETTY_FUNCTION__);
-    _plistAppendString(mData, fStr);
-    CFRelease(fStr);
+static void __CFXMLPlistWriterAppendIndents(__CFXMLPlistWriter *w, CFIndex numIndents) {
+    if (numIndents <= 0) return;
+    memset(__CFXMLPlistWriterReserve(w, numIndents), '\t', numIndents);
+    w->length += numIndents;
 }
 
-
-
-static void _appendIndents(CFIndex numIndents, CFMutableDataRef str) {
-#define NUMTABS 4
-    static const UniChar tabs[NUMTABS] = {'\t','\t','\t','\t'};
-    for (; numIndents > 0; numIndents -= NUMTABS) _plistAppendCharacters(str, tabs, (numIndents >= NUMTABS) ? NUMTABS : numIndents);
+// Appends "<tag", "</tag" and so on; open is "<" or "</", close is ">", "/>" or ">\n" and the like
+static void __CFXMLPlistWriterAppendTag(__CFXMLPlistWriter *w, const char *open, CFIndex ix, CFIndex tagLength, const char *close) {
+    CFIndex openLength = strlen(open), closeLength = strlen(close);
+    UInt8 *p = __CFXMLPlistWriterReserve(w, openLength + tagLength + closeLength);
+    memmove(p, open, openLength);
+    memmove(p + openLength, CFXMLPlistTags[ix], tagLength);
+    memmove(p + openLength + tagLength, close, closeLength);
+    w->length += openLength + tagLength + closeLength;
 }
 
-/* Append the escaped version of origStr to mStr.
+/* Append the UTF-8 in bytes, with '<', '>' and '&' replaced by entity references.
 */
-static void _appendEscapedString(CFStringRef origStr, CFMutableDataRef mStr) {
-#define BUFSIZE 64
-    CFIndex i, length = CFStringGetLength(origStr);
-    CFIndex bufCnt = 0;
-    UniChar buf[BUFSIZE];
-    CFStringInlineBuffer inlineBuffer;
-
-    CFStringInitInlineBuffer(origStr, &inlineBuffer, CFRangeMake(0, length));
-
-    for (i = 0; i < length; i ++) {
-	UniChar ch = __CFStringGetCharacterFromInlineBufferQuick(&inlineBuffer, i);
-	if (CFStringIsSurrogateHighCharacter(ch) && (bufCnt + 2 >= BUFSIZE)) {
-	    // flush the buffer first so we have room for a low/high pair and do not split them
-	    _plistAppendCharacters(mStr, buf, bufCnt);
-	    bufCnt = 0;
-	}
-	
-        switch(ch) {
-            case '<':
-		if (bufCnt) _plistAppendCharacters(mStr, buf, bufCnt);
-		bufCnt = 0;
-	  	_plistAppendUTF8CString(mStr, "&lt;");
-                break;
-            case '>':
-		if (bufCnt) _plistAppendCharacters(mStr, buf, bufCnt);
-		bufCnt = 0;
-	  	_plistAppendUTF8CString(mStr, "&gt;");
-                break;
-            case '&':
-		if (bufCnt) _plistAppendCharacters(mStr, buf, bufCnt);
-		bufCnt = 0;
-	  	_plistAppendUTF8CString(mStr, "&amp;");
-                break;
-            default:
-		buf[bufCnt++] = ch;
-		if (bufCnt == BUFSIZE) {
-		    _plistAppendCharacters(mStr, buf, bufCnt);
-		    bufCnt = 0;
-		}
-		break;
+static void __CFXMLPlistWriterAppendEscaped(__CFXMLPlistWriter *w, const UInt8 *bytes, CFIndex length) {
+    const UInt8 *p = bytes, *end = bytes + length;
+    while (p < end) {
+        const UInt8 *special = __CFByteScanFindXMLSpecial(p, end);
+        if (special > p) __CFXMLPlistWriterAppend(w, p, special - p);
+        if (special == end) break;
+        switch (*special) {
+            case '<': __CFXMLPlistWriterAppendLiteral(w, "&lt;"); break;
+            case '>': __CFXMLPlistWriterAppendLiteral(w, "&gt;"); break;
+            default: __CFXMLPlistWriterAppendLiteral(w, "&amp;"); break;
         }
+        p = special + 1;
     }
-    if (bufCnt) _plistAppendCharacters(mStr, buf, bufCnt);
 }
 
-
+/* Append the escaped version of origStr.
+*/
+static void __CFXMLPlistWriterAppendEscapedString(__CFXMLPlistWriter *w, CFStringRef origStr) {
+#define BUFSIZE 1024
+    CFIndex length = CFStringGetLength(origStr);
+    const char *cStr = CFStringGetCStringPtr(origStr, kCFStringEncodingASCII);
+    if (!cStr) cStr = CFStringGetCStringPtr(origStr, kCFStringEncodingUTF8);
+    if (cStr) {
+        // Only ASCII is stored this way, so the storage already is the UTF-8
+        __CFXMLPlistWriterAppendEscaped(w, (const UInt8 *)cStr, length);
+        return;
+    }
+    UInt8 buf[3 * BUFSIZE];
+    CFIndex loc = 0;
+    while (loc < length) {
+        CFIndex count = __CFMin(BUFSIZE, length - loc);
+        // Do not split a surrogate pair between two conversions
+        if (loc + count < length && CFStringIsSurrogateHighCharacter(CFStringGetCharacterAtIndex(origStr, loc + count - 1))) count--;
+        CFIndex used = 0;
+        CFIndex converted = CFStringGetBytes(origStr, CFRangeMake(loc, count), kCFStringEncodingUTF8, 0, false, buf, sizeof(buf), &used);
+        if (used) __CFXMLPlistWriterAppendEscaped(w, buf, used);
+        CFAssert1(converted == count, __kCFLogAssertion, "%s(): Error writing plist", __PRETTY_FUNCTION__);
+        // Step over anything which cannot be represented in UTF-8
+        loc += (converted < count) ? converted + 1 : count;
+    }
+#undef BUFSIZE
+}
 
 /* Base-64 encoding/decoding */
 
@@ -458,111 +405,182 @@ static void _appendEscapedString(CFStringRef origStr, CFMutableDataRef mStr) {
  *      '='      => pad
  */
 
-// Write the inputData to the mData using Base 64 encoding
+static const char __CFPLDataEncodeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Encodes length bytes, which must be a multiple of three, into out
+static void __CFPLDataEncodeTriples(const uint8_t *bytes, CFIndex length, UInt8 *out) {
+    for (CFIndex i = 0; i < length; i += 3, out += 4) {
+        uint32_t v = ((uint32_t)bytes[i] << 16) | ((uint32_t)bytes[i + 1] << 8) | bytes[i + 2];
+        out[0] = __CFPLDataEncodeTable[(v >> 18) & 0x3f];
+        out[1] = __CFPLDataEncodeTable[(v >> 12) & 0x3f];
+        out[2] = __CFPLDataEncodeTable[(v >> 6) & 0x3f];
+        out[3] = __CFPLDataEncodeTable[v & 0x3f];
+    }
+}
+
+// Write the inputData using Base 64 encoding
 
-static void _XMLPlistAppendDataUsingBase64(CFMutableDataRef mData, CFDataRef inputData, CFIndex indent) {
-    static const char __CFPLDataEncodeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static void __CFXMLPlistWriterAppendBase64(__CFXMLPlistWriter *w, CFDataRef inputData, CFIndex indent) {
     #define MAXLINELEN 76
-    char buf[MAXLINELEN + 4 + 2];	// For the slop and carriage return and terminating NULL
-    
     const uint8_t *bytes = CFDataGetBytePtr(inputData);
     CFIndex length = CFDataGetLength(inputData);
-    CFIndex i, pos;
-    const uint8_t *p;
+    if (length == 0) return;
 
     if (indent > 8) indent = 8; // refuse to indent more than 64 characters
 
-    pos = 0;		// position within buf
-
-    for (i = 0, p = bytes; i < length; i++, p++) {
-        /* 3 bytes are encoded as 4 */
-        switch (i % 3) {
-            case 0:
-                buf[pos++] = __CFPLDataEncodeTable [ ((p[0] >> 2) & 0x3f)];
-                break;
-            case 1:
-                buf[pos++] = __CFPLDataEncodeTable [ ((((p[-1] << 8) | p[0]) >> 4) & 0x3f)];
-                break;
-            case 2:
-                buf[pos++] = __CFPLDataEncodeTable [ ((((p[-1] << 8) | p[0]) >> 6) & 0x3f)];
-                buf[pos++] = __CFPLDataEncodeTable [ (p[0] & 0x3f)];
-                break;
-        }
-        /* Flush the line out every 76 (or fewer) chars --- indents count against the line length*/
-        if (pos >= MAXLINELEN - 8 * indent) {
-            buf[pos++] = '\n';
-            buf[pos++] = 0;
-            _appendIndents(indent, mData);
-            _plistAppendUTF8CString(mData, buf);
-            pos = 0;
-        }
-    }
-        
-    switch (i % 3) {
-	case 0:
-            break;
-	case 1:
-            buf[pos++] = __CFPLDataEncodeTable [ ((p[-1] << 4) & 0x30)];
-            buf[pos++] = '=';
-            buf[pos++] = '=';
-            break;
-	case 2:
-            buf[pos++] =  __CFPLDataEncodeTable [ ((p[-1] << 2) & 0x3c)];
-            buf[pos++] = '=';
+    // Encode everything in one go, padding included, into the space after the first indent; the lines are then spread out from the back so that each can be given its indent and newline in place.
+    CFIndex fullLength = length - length % 3;
+    CFIndex encodedLength = 4 * ((length + 2) / 3);
+    // A line is flushed at the first byte boundary at or past lineLength characters, and byte boundaries fall on every character position but 3 mod 4. The characters that only exist because of a final partial group go on the last line.
+    CFIndex lineLength = MAXLINELEN - 8 * indent;
+    CFIndex bodyLength = length + length / 3;
+    CFIndex lineCount = 0;
+    for (CFIndex start = 0; ; lineCount++) {
+        CFIndex end = start + lineLength;
+        if (end % 4 == 3) end++;
+        if (end > bodyLength) {
+            if (start < encodedLength) lineCount++;
             break;
+        }
+        start = end;
+    }
+
+    UInt8 *out = __CFXMLPlistWriterReserve(w, encodedLength + lineCount * (indent + 1));
+    UInt8 *encoded = out + (lineCount * (indent + 1));
+    __CFPLDataEncodeTriples(bytes, fullLength, encoded);
+    if (length > fullLength) {
+        uint32_t v = (uint32_t)bytes[fullLength] << 16;
+        if (length - fullLength == 2) v |= (uint32_t)bytes[fullLength + 1] << 8;
+        UInt8 *tail = encoded + (fullLength / 3) * 4;
+        tail[0] = __CFPLDataEncodeTable[(v >> 18) & 0x3f];
+        tail[1] = __CFPLDataEncodeTable[(v >> 12) & 0x3f];
+        tail[2] = (length - fullLength == 2) ? __CFPLDataEncodeTable[(v >> 6) & 0x3f] : '=';
+        tail[3] = '=';
+    }
+    // Move each line to its final place, front to back; a line's destination never overtakes its source
+    CFIndex start = 0;
+    UInt8 *dst = out;
+    for (CFIndex line = 0; line < lineCount; line++) {
+        CFIndex end = start + lineLength;
+        if (end % 4 == 3) end++;
+        if (end > bodyLength || line == lineCount - 1) end = encodedLength;
+        memset(dst, '\t', indent);
+        dst += indent;
+        memmove(dst, encoded + start, end - start);
+        dst += end - start;
+        *dst++ = '\n';
+        start = end;
+    }
+    w->length += encodedLength + lineCount * (indent + 1);
+}
+
+// Writes the decimal digits of value, which must be less than 10^width, zero padded to width
+CF_INLINE UInt8 *__CFXMLPlistWriteDigits(UInt8 *p, uint32_t value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = '0' + value % 10;
+        value /= 10;
+    }
+    return p + width;
+}
+
+static void __CFXMLPlistWriterAppendInteger(__CFXMLPlistWriter *w, CFNumberRef number) {
+    if (CFNumberGetByteSize(number) > (CFIndex)sizeof(SInt64)) {
+        // 128-bit values keep going through CFNumber's own formatting
+        CFStringRef s = CFStringCreateWithFormat(kCFAllocatorSystemDefault, NULL, CFSTR("%@"), number);
+        __CFXMLPlistWriterAppendEscapedString(w, s);
+        CFRelease(s);
+        return;
     }
-    
-    if (pos > 0) {
-        buf[pos++] = '\n';
-        buf[pos++] = 0;
-        _appendIndents(indent, mData);
-        _plistAppendUTF8CString(mData, buf);
+    SInt64 value = 0;
+    CFNumberGetValue(number, kCFNumberSInt64Type, &value);
+    UInt8 buf[24], *p = buf + sizeof(buf);
+    uint64_t magnitude = (value < 0) ? -(uint64_t)value : (uint64_t)value;
+    do {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) *--p = '-';
+    __CFXMLPlistWriterAppend(w, p, buf + sizeof(buf) - p);
+}
+
+// Matches __CFNumberCopyFormattingDescriptionAsFloat64()
+static void __CFXMLPlistWriterAppendReal(__CFXMLPlistWriter *w, CFNumberRef number) {
+    Float64 d;
+    CFNumberGetValue(number, kCFNumberFloat64Type, &d);
+    if (isnan(d)) {
+        __CFXMLPlistWriterAppendLiteral(w, "nan");
+    } else if (isinf(d)) {
+        if (0.0 < d) {
+            __CFXMLPlistWriterAppendLiteral(w, "+infinity");
+        } else {
+            __CFXMLPlistWriterAppendLiteral(w, "-infinity");
+        }
+    } else if (0.0 == d) {
+        __CFXMLPlistWriterAppendLiteral(w, "0.0");
+    } else {
+        char buf[64];
+        int len = snprintf_l(buf, sizeof(buf), NULL, "%.*g", DBL_DIG + 2, d);
+        __CFXMLPlistWriterAppend(w, buf, len);
     }
 }
 
-extern CFStringRef __CFNumberCopyFormattingDescriptionAsFloat64(CFTypeRef cf);
-
-static void _CFAppendXML0(CFTypeRef object, UInt32 indentation, CFMutableDataRef xmlString) {
+static void __CFXMLPlistWriterAppendDate(__CFXMLPlistWriter *w, CFDateRef date) {
+    // YYYY '-' MM '-' DD 'T' hh ':' mm ':' ss 'Z'
+    CFAbsoluteTime at = CFDateGetAbsoluteTime(date);
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated"
+    CFGregorianDate gdate = CFAbsoluteTimeGetGregorianDate(at, NULL);
+#pragma GCC diagnostic pop
+    int32_t y = gdate.year, M = gdate.month, d = gdate.day, H = gdate.hour, m = gdate.minute, s = (int32_t)gdate.second;
+    if (y < 0 || 9999 < y) {
+        char buf[64];
+        int len = snprintf_l(buf, sizeof(buf), NULL, "%04d-%02d-%02dT%02d:%02d:%02dZ", y, M, d, H, m, s);
+        __CFXMLPlistWriterAppend(w, buf, len);
+        return;
+    }
+    UInt8 *p = __CFXMLPlistWriterReserve(w, 20);
+    p = __CFXMLPlistWriteDigits(p, y, 4);
+    *p++ = '-';
+    p = __CFXMLPlistWriteDigits(p, M, 2);
+    *p++ = '-';
+    p = __CFXMLPlistWriteDigits(p, d, 2);
+    *p++ = 'T';
+    p = __CFXMLPlistWriteDigits(p, H, 2);
+    *p++ = ':';
+    p = __CFXMLPlistWriteDigits(p, m, 2);
+    *p++ = ':';
+    p = __CFXMLPlistWriteDigits(p, s, 2);
+    *p++ = 'Z';
+    w->length += 20;
+}
+
+static void _CFAppendXML0(CFTypeRef object, UInt32 indentation, __CFXMLPlistWriter *w) {
     UInt32 typeID = CFGetTypeID(object);
-    _appendIndents(indentation, xmlString);
+    __CFXMLPlistWriterAppendIndents(w, indentation);
     if (typeID == stringtype) {
-        _plistAppendUTF8CString(xmlString, "<");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[STRING_IX], STRING_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">");
-	_appendEscapedString((CFStringRef)object, xmlString);
-        _plistAppendUTF8CString(xmlString, "</");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[STRING_IX], STRING_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">\n");
+        __CFXMLPlistWriterAppendTag(w, "<", STRING_IX, STRING_TAG_LENGTH, ">");
+        __CFXMLPlistWriterAppendEscapedString(w, (CFStringRef)object);
+        __CFXMLPlistWriterAppendTag(w, "</", STRING_IX, STRING_TAG_LENGTH, ">\n");
     } else if (typeID == arraytype) {
         UInt32 i, count = CFArrayGetCount((CFArrayRef)object);
         if (count == 0) {
-            _plistAppendUTF8CString(xmlString, "<");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[ARRAY_IX], ARRAY_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, "/>\n");
+            __CFXMLPlistWriterAppendTag(w, "<", ARRAY_IX, ARRAY_TAG_LENGTH, "/>\n");
             return;
         }
-        _plistAppendUTF8CString(xmlString, "<");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[ARRAY_IX], ARRAY_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">\n");
+        __CFXMLPlistWriterAppendTag(w, "<", ARRAY_IX, ARRAY_TAG_LENGTH, ">\n");
         for (i = 0; i < count; i ++) {
-            _CFAppendXML0(CFArrayGetValueAtIndex((CFArrayRef)object, i), indentation+1, xmlString);
+            _CFAppendXML0(CFArrayGetValueAtIndex((CFArrayRef)object, i), indentation+1, w);
         }
-        _appendIndents(indentation, xmlString);
-        _plistAppendUTF8CString(xmlString, "</");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[ARRAY_IX], ARRAY_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">\n");
+        __CFXMLPlistWriterAppendIndents(w, indentation);
+        __CFXMLPlistWriterAppendTag(w, "</", ARRAY_IX, ARRAY_TAG_LENGTH, ">\n");
     } else if (typeID == dicttype) {
         UInt32 i, count = CFDictionaryGetCount((CFDictionaryRef)object);
         CFMutableArrayRef keyArray;
         if (count == 0) {
-            _plistAppendUTF8CString(xmlString, "<");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[DICT_IX], DICT_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, "/>\n");
+            __CFXMLPlistWriterAppendTag(w, "<", DICT_IX, DICT_TAG_LENGTH, "/>\n");
             return;
         }
-        _plistAppendUTF8CString(xmlString, "<");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[DICT_IX], DICT_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">\n");
+        __CFXMLPlistWriterAppendTag(w, "<", DICT_IX, DICT_TAG_LENGTH, ">\n");
         new_cftype_array(keys, count);
         CFDictionaryGetKeysAndValues((CFDictionaryRef)object, keys, NULL);
         keyArray = CFArrayCreateMutable(kCFAllocatorSystemDefault, count, &kCFTypeArrayCallBacks);
@@ -572,119 +590,55 @@ static void _CFAppendXML0(CFTypeRef object, UInt32 indentation, CFMutableDataRef
         CFRelease(keyArray);
         for (i = 0; i < count; i ++) {
             CFTypeRef key = keys[i];
-            _appendIndents(indentation+1, xmlString);
-            _plistAppendUTF8CString(xmlString, "<");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[KEY_IX], KEY_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, ">");
-	    _appendEscapedString((CFStringRef)key, xmlString);
-            _plistAppendUTF8CString(xmlString, "</");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[KEY_IX], KEY_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, ">\n");
-            _CFAppendXML0(CFDictionaryGetValue((CFDictionaryRef)object, key), indentation+1, xmlString);
+            __CFXMLPlistWriterAppendIndents(w, indentation+1);
+            __CFXMLPlistWriterAppendTag(w, "<", KEY_IX, KEY_TAG_LENGTH, ">");
+            __CFXMLPlistWriterAppendEscapedString(w, (CFStringRef)key);
+            __CFXMLPlistWriterAppendTag(w, "</", KEY_IX, KEY_TAG_LENGTH, ">\n");
+            _CFAppendXML0(CFDictionaryGetValue((CFDictionaryRef)object, key), indentation+1, w);
         }
         free_cftype_array(keys);
-        _appendIndents(indentation, xmlString);
-        _plistAppendUTF8CString(xmlString, "</");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[DICT_IX], DICT_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">\n");
+        __CFXMLPlistWriterAppendIndents(w, indentation);
+        __CFXMLPlistWriterAppendTag(w, "</", DICT_IX, DICT_TAG_LENGTH, ">\n");
     } else if (typeID == datatype) {
-        _plistAppendUTF8CString(xmlString, "<");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[DATA_IX], DATA_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">\n");
-        _XMLPlistAppendDataUsingBase64(xmlString, (CFDataRef)object, indentation);       
-        _appendIndents(indentation, xmlString);
-        _plistAppendUTF8CString(xmlString, "</");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[DATA_IX], DATA_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">\n");
+        __CFXMLPlistWriterAppendTag(w, "<", DATA_IX, DATA_TAG_LENGTH, ">\n");
+        __CFXMLPlistWriterAppendBase64(w, (CFDataRef)object, indentation);
+        __CFXMLPlistWriterAppendIndents(w, indentation);
+        __CFXMLPlistWriterAppendTag(w, "</", DATA_IX, DATA_TAG_LENGTH, ">\n");
     } else if (typeID == datetype) {
-        // YYYY '-' MM '-' DD 'T' hh ':' mm ':' ss 'Z'
-	int32_t y = 0, M = 0, d = 0, H = 0, m = 0, s = 0;
-        CFAbsoluteTime at = CFDateGetAbsoluteTime((CFDateRef)object);
-#if 0
-        // Alternative to the CFAbsoluteTimeGetGregorianDate() code which works well
-        struct timeval tv;
-        struct tm mine;
-        tv.tv_sec = floor(at + kCFAbsoluteTimeIntervalSince1970);
-        gmtime_r(&tv.tv_sec, &mine);
-	y = mine.tm_year + 1900;
-	M = mine.tm_mon + 1;
-	d = mine.tm_mday;
-	H = mine.tm_hour;
-	m = mine.tm_min;
-	s = mine.tm_sec;
-#endif
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated"
-        CFGregorianDate date = CFAbsoluteTimeGetGregorianDate(at, NULL);
-#pragma GCC diagnostic pop
-
-#if 0
-if (date.year != y || date.month != M || date.day != d || date.hour != H || date.minute != m || (int32_t)date.second != s) {
-    CFLog(4, CFSTR("DATE ERROR {%d, %d, %d, %d, %d, %d} != {%d,  %d, %d, %d, %d, %d}\n"), (int)date.year, (int)date.month, (int)date.day, (int)date.hour, (int)date.minute, (int32_t)date.second, y, M, d, H, m, s);
-}
-#endif
-        y = date.year;
-        M = date.month;
-        d = date.day;
-        H = date.hour;
-        m = date.minute;
-        s = (int32_t)date.second;
-
-        _plistAppendUTF8CString(xmlString, "<");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[DATE_IX], DATE_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">");
-        _plistAppendFormat(xmlString, CFSTR("%04d-%02d-%02dT%02d:%02d:%02dZ"), y, M, d, H, m, s);
-        _plistAppendUTF8CString(xmlString, "</");
-        _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[DATE_IX], DATE_TAG_LENGTH);
-        _plistAppendUTF8CString(xmlString, ">\n");
+        __CFXMLPlistWriterAppendTag(w, "<", DATE_IX, DATE_TAG_LENGTH, ">");
+        __CFXMLPlistWriterAppendDate(w, (CFDateRef)object);
+        __CFXMLPlistWriterAppendTag(w, "</", DATE_IX, DATE_TAG_LENGTH, ">\n");
     } else if (typeID == numbertype) {
         if (CFNumberIsFloatType((CFNumberRef)object)) {
-            _plistAppendUTF8CString(xmlString, "<");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[REAL_IX], REAL_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, ">");
-                CFStringRef s = __CFNumberCopyFormattingDescriptionAsFloat64(object);
-                _plistAppendString(xmlString, s);
-                CFRelease(s);
-            _plistAppendUTF8CString(xmlString, "</");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[REAL_IX], REAL_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, ">\n");
+            __CFXMLPlistWriterAppendTag(w, "<", REAL_IX, REAL_TAG_LENGTH, ">");
+            __CFXMLPlistWriterAppendReal(w, (CFNumberRef)object);
+            __CFXMLPlistWriterAppendTag(w, "</", REAL_IX, REAL_TAG_LENGTH, ">\n");
         } else {
-            _plistAppendUTF8CString(xmlString, "<");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[INTEGER_IX], INTEGER_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, ">");
-
-            _plistAppendFormat(xmlString, CFSTR("%@"), object);
-
-            _plistAppendUTF8CString(xmlString, "</");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[INTEGER_IX], INTEGER_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, ">\n");
+            __CFXMLPlistWriterAppendTag(w, "<", INTEGER_IX, INTEGER_TAG_LENGTH, ">");
+            __CFXMLPlistWriterAppendInteger(w, (CFNumberRef)object);
+            __CFXMLPlistWriterAppendTag(w, "</", INTEGER_IX, INTEGER_TAG_LENGTH, ">\n");
         }
     } else if (typeID == booltype) {
         if (CFBooleanGetValue((CFBooleanRef)object)) {
-            _plistAppendUTF8CString(xmlString, "<");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[TRUE_IX], TRUE_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, "/>\n");
+            __CFXMLPlistWriterAppendTag(w, "<", TRUE_IX, TRUE_TAG_LENGTH, "/>\n");
         } else {
-            _plistAppendUTF8CString(xmlString, "<");
-            _plistAppendCharacters(xmlString, CFXMLPlistTagsUnicode[FALSE_IX], FALSE_TAG_LENGTH);
-            _plistAppendUTF8CString(xmlString, "/>\n");
+            __CFXMLPlistWriterAppendTag(w, "<", FALSE_IX, FALSE_TAG_LENGTH, "/>\n");
         }
     }
 }
 
 static void _CFGenerateXMLPropertyListToData(CFMutableDataRef xml, CFTypeRef propertyList) {
-    _plistAppendUTF8CString(xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!DOCTYPE ");
-    _plistAppendCharacters(xml, CFXMLPlistTagsUnicode[PLIST_IX], PLIST_TAG_LENGTH);
-    _plistAppendUTF8CString(xml, " PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n<");
-    _plistAppendCharacters(xml, CFXMLPlistTagsUnicode[PLIST_IX], PLIST_TAG_LENGTH);
-    _plistAppendUTF8CString(xml, " version=\"1.0\">\n");
+    __CFXMLPlistWriter writer = {xml, CFDataGetMutableBytePtr(xml), CFDataGetLength(xml), CFDataGetLength(xml)};
+    __CFXMLPlistWriter *w = &writer;
+    __CFXMLPlistWriterAppendLiteral(w, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!DOCTYPE ");
+    __CFXMLPlistWriterAppendTag(w, "", PLIST_IX, PLIST_TAG_LENGTH, "");
+    __CFXMLPlistWriterAppendLiteral(w, " PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n");
+    __CFXMLPlistWriterAppendTag(w, "<", PLIST_IX, PLIST_TAG_LENGTH, " version=\"1.0\">\n");
 
-    _CFAppendXML0(propertyList, 0, xml);
+    _CFAppendXML0(propertyList, 0, w);
 
-    _plistAppendUTF8CString(xml, "</");
-    _plistAppendCharacters(xml, CFXMLPlistTagsUnicode[PLIST_IX], PLIST_TAG_LENGTH);
-    _plistAppendUTF8CString(xml, ">\n");
+    __CFXMLPlistWriterAppendTag(w, "</", PLIST_IX, PLIST_TAG_LENGTH, ">\n");
+    CFDataSetLength(xml, w->length);
 }
 
 // ========================================================================
@@ -758,18 +712,7 @@ static UInt32 lineNumber(_CFXMLPlistParseInfo *pInfo) {
 
 // warning: doesn't have a good idea of Unicode white space
 CF_INLINE void skipWhitespace(_CFXMLPlistParseInfo *pInfo) {
-    while (pInfo->curr < pInfo->end) {
-        switch (*(pInfo->curr)) {
-            case ' ':
-            case '\t':
-            case '\n':
-            case '\r':
-                pInfo->curr ++;
-                continue;
-            default:
-                return;
-        }
-    }
+    pInfo->curr = (const char *)__CFByteScanSkipXMLSpace((const uint8_t *)pInfo->curr, (const uint8_t *)pInfo->end);
 }
 
 /* All of these advance to the end of the given construct and return a pointer to the first character beyond the construct.  If the construct doesn't parse properly, NULL is returned. */
@@ -1152,7 +1095,8 @@ static Boolean parseStringTag(_CFXMLPlistParseInfo *pInfo, CFStringRef *out) {
             parseEntityReference_pl(pInfo, stringData); // TODO: move to return boolean
             mark = pInfo->curr;
         } else {
-            pInfo->curr ++;
+            // Plain character data; jump straight to the next markup or entity reference
+            pInfo->curr = (const char *)__CFByteScanFind2((const uint8_t *)pInfo->curr, (const uint8_t *)pInfo->end, '<', '&');
         }
     }
 
@@ -1344,6 +1288,139 @@ CF_PRIVATE void __CFPropertyListCreateSplitKeypaths(CFAllocatorRef allocator, CF
     *nextKeys = outNextKeys;
 }
 
+#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS
+// Documents smaller than this are not worth splitting across threads
+#define PARALLEL_PARSE_MIN_LENGTH (4 * 1024 * 1024)
+
+// Finds the '<' of each child element of the container whose content starts at pInfo->curr, and the '<' of the container's close tag. Gives up on comments, processing instructions, CDATA sections and anything else malformed; the sequential parser deals with (and reports errors for) those.
+static Boolean scanContainerChildren(_CFXMLPlistParseInfo *pInfo, const char ***outStarts, CFIndex *outCount, const char **outClose) {
+    const uint8_t *p = (const uint8_t *)pInfo->curr, *end = (const uint8_t *)pInfo->end;
+    const char **starts = NULL;
+    CFIndex count = 0, capacity = 0;
+    for (;;) {
+        p = __CFByteScanSkipXMLSpace(p, end);
+        if (end - p < 2 || '<' != *p || '!' == p[1] || '?' == p[1]) goto fail;
+        if ('/' == p[1]) break;
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 1024;
+            starts = (const char **)CFAllocatorReallocate(kCFAllocatorSystemDefault, starts, capacity * sizeof(const char *), 0);
+            if (!starts) HALT;
+        }
+        starts[count++] = (const char *)p;
+        // Skip the child by counting open and close tags; character data in a plist never contains a raw '<'
+        CFIndex depth = 0;
+        for (;;) {
+            const uint8_t *gt = (const uint8_t *)memchr(p, '>', end - p);
+            if (!gt || end - p < 2 || '!' == p[1] || '?' == p[1]) goto fail;
+            if ('/' == p[1]) {
+                depth--;
+            } else if ('/' != *(gt - 1)) {
+                depth++;
+            }
+            p = gt + 1;
+            if (depth <= 0) break;
+            p = __CFByteScanFind2(p, end, '<', '<');
+            if (p >= end) goto fail;
+        }
+        if (depth < 0) goto fail;
+    }
+    *outStarts = starts;
+    *outCount = count;
+    *outClose = (const char *)p;
+    return true;
+fail:
+    if (starts) CFAllocatorDeallocate(kCFAllocatorSystemDefault, starts);
+    return false;
+}
+
+// Parses count consecutive children into values, using a private parse state (and string uniquing map) so that several ranges can be parsed at once. When keyed, every other child starting with the first must be a <key>.
+static Boolean parseChildrenInRange(_CFXMLPlistParseInfo *parent, const char *start, const char *end, CFIndex count, Boolean keyed, CFTypeRef *values) {
+    _CFXMLPlistParseInfo info = *parent;
+    info.curr = start;
+    info.end = end;
+    info.error = NULL;
+    info.keyPaths = NULL;
+    info.skip = false;
+    info.allowParallel = false;
+    _createStringMap(&info);
+    CFIndex idx;
+    for (idx = 0; idx < count; idx++) {
+        Boolean isKey = false;
+        CFTypeRef value = NULL;
+        if (!getContentObject(&info, &isKey, &value) || !value) break;
+        values[idx] = value;
+        if (keyed && 0 == (idx & 1) && !isKey) {
+            idx++;
+            break;
+        }
+    }
+    Boolean success = (idx == count) && !info.error;
+    _cleanupStringMap(&info);
+    if (info.error) CFRelease(info.error);
+    if (!success) {
+        while (idx--) __CFPListRelease(values[idx], parent->allocator);
+    }
+    return success;
+}
+
+// Parses the children of a large top-level <array> or <dict> on several threads. On success values holds the retained children in document order and pInfo->curr is left on the container's close tag; on failure nothing is consumed and the caller parses sequentially, which also produces the proper error.
+static Boolean parseContainerChildrenConcurrently(_CFXMLPlistParseInfo *pInfo, Boolean keyed, CFTypeRef **outValues, CFIndex *outCount) {
+    if (!pInfo->allowParallel) return false;
+    pInfo->allowParallel = false; // only the outermost container is split
+    CFIndex ncores = __CFActiveProcessorCount();
+    if (ncores < 2 || pInfo->end - pInfo->begin < PARALLEL_PARSE_MIN_LENGTH) return false;
+
+    const char **starts = NULL, *close = NULL;
+    CFIndex count = 0;
+    if (!scanContainerChildren(pInfo, &starts, &count, &close)) return false;
+    // Chunks hold whole key/value pairs for dictionaries
+    CFIndex unit = keyed ? 2 : 1;
+    if ((keyed && (count & 1)) || count < 4 * ncores * unit) {
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, starts);
+        return false;
+    }
+    CFIndex nchunks = 4 * ncores;
+    CFIndex perChunk = ((count / unit + nchunks - 1) / nchunks) * unit;
+    nchunks = (count + perChunk - 1) / perChunk;
+
+    CFTypeRef *values = (CFTypeRef *)CFAllocatorAllocate(kCFAllocatorSystemDefault, count * sizeof(CFTypeRef), 0);
+    if (!values) HALT;
+    Boolean *chunkOK = (Boolean *)calloc(nchunks, sizeof(Boolean));
+    const char **startsPtr = starts;
+    dispatch_apply(nchunks, __CFDispatchQueueGetGenericMatchingCurrent(), ^(size_t chunk) {
+        CFIndex first = chunk * perChunk;
+        CFIndex n = (first + perChunk <= count) ? perChunk : count - first;
+        const char *chunkEnd = (first + n < count) ? startsPtr[first + n] : close;
+        chunkOK[chunk] = parseChildrenInRange(pInfo, startsPtr[first], chunkEnd, n, keyed, values + first);
+    });
+
+    Boolean success = true;
+    for (CFIndex chunk = 0; chunk < nchunks; chunk++) {
+        if (!chunkOK[chunk]) success = false;
+    }
+    if (!success) {
+        for (CFIndex chunk = 0; chunk < nchunks; chunk++) {
+            if (!chunkOK[chunk]) continue;
+            CFIndex first = chunk * perChunk;
+            CFIndex n = (first + perChunk <= count) ? perChunk : count - first;
+            for (CFIndex idx = first; idx < first + n; idx++) __CFPListRelease(values[idx], pInfo->allocator);
+        }
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, values);
+    } else {
+        pInfo->curr = close;
+        *outValues = values;
+        *outCount = count;
+    }
+    free(chunkOK);
+    CFAllocatorDeallocate(kCFAllocatorSystemDefault, starts);
+    return success;
+}
+#else
+static Boolean parseContainerChildrenConcurrently(_CFXMLPlistParseInfo *pInfo, Boolean keyed, CFTypeRef **outValues, CFIndex *outCount) {
+    return false;
+}
+#endif
+
 static Boolean parseArrayTag(_CFXMLPlistParseInfo *pInfo, CFTypeRef *out) {
     CFTypeRef tmp = NULL;
 
@@ -1377,17 +1454,25 @@ static Boolean parseArrayTag(_CFXMLPlistParseInfo *pInfo, CFTypeRef *out) {
     CFSetRef newKeyPaths, keys;
     __CFPropertyListCreateSplitKeypaths(pInfo->allocator, pInfo->keyPaths, &keys, &newKeyPaths);
     
-    if (keys) {
-        CFStringRef countString = CFStringCreateWithFormat(pInfo->allocator, NULL, CFSTR("%ld"), count);
-        if (!CFSetContainsValue(keys, countString)) pInfo->skip = true;
-        __CFPListRelease(countString, pInfo->allocator);
-        count++;
-        pInfo->keyPaths = newKeyPaths;
-    }
-    result = getContentObject(pInfo, NULL, &tmp);
-    if (keys) {
-        pInfo->keyPaths = oldKeyPaths;
-        pInfo->skip = false;
+    CFTypeRef *values = NULL;
+    if (!keys && parseContainerChildrenConcurrently(pInfo, false, &values, &count)) {
+        CFArrayReplaceValues(array, CFRangeMake(0, 0), values, count);
+        for (CFIndex idx = 0; idx < count; idx++) __CFPListRelease(values[idx], pInfo->allocator);
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, values);
+        result = false;
+    } else {
+        if (keys) {
+            CFStringRef countString = CFStringCreateWithFormat(pInfo->allocator, NULL, CFSTR("%ld"), count);
+            if (!CFSetContainsValue(keys, countString)) pInfo->skip = true;
+            __CFPListRelease(countString, pInfo->allocator);
+            count++;
+            pInfo->keyPaths = newKeyPaths;
+        }
+        result = getContentObject(pInfo, NULL, &tmp);
+        if (keys) {
+            pInfo->keyPaths = oldKeyPaths;
+            pInfo->skip = false;
+        }
     }
 
     while (result) {
@@ -1476,7 +1561,23 @@ static Boolean parseDictTag(_CFXMLPlistParseInfo *pInfo, CFTypeRef *out) {
     
     CFMutableDictionaryRef dict = NULL;
     
-    result = getContentObject(pInfo, &gotKey, &key);
+    CFTypeRef *values = NULL;
+    CFIndex count = 0;
+    if (!theseKeyPaths && parseContainerChildrenConcurrently(pInfo, true, &values, &count)) {
+        if (0 < count) {
+            dict = CFDictionaryCreateMutable(pInfo->allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+            _CFDictionarySetCapacity(dict, count / 2);
+        }
+        for (CFIndex idx = 0; idx < count; idx += 2) {
+            CFDictionarySetValue(dict, values[idx], values[idx + 1]);
+            __CFPListRelease(values[idx], pInfo->allocator);
+            __CFPListRelease(values[idx + 1], pInfo->allocator);
+        }
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, values);
+        result = false;
+    } else {
+        result = getContentObject(pInfo, &gotKey, &key);
+    }
     while (result && key) {
         if (!gotKey) { 
             if (!pInfo->error) pInfo->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Found non-key inside <dict> at line %d"), lineNumber(pInfo)); 
@@ -1592,6 +1693,29 @@ static Boolean parseDataTag(_CFXMLPlistParseInfo *pInfo, CFTypeRef *out) {
     int cntr = 0;
     
     for (; pInfo->curr < pInfo->end; pInfo->curr++) {
+        if (0 == (cntr & 0x3)) {
+            // Runs of complete quads are the bulk of any <data>; decode them without the per-character
+            // bookkeeping and leave padding, white space, buffer growth and anything unusual to the loop below
+            const uint8_t *p = (const uint8_t *)pInfo->curr;
+            while ((const uint8_t *)pInfo->end - p >= 4 && (pInfo->skip || tmpbufpos + 2 < tmpbuflen)) {
+                uint8_t c0 = p[0], c1 = p[1], c2 = p[2], c3 = p[3];
+                if ((c0 | c1 | c2 | c3) & 0x80) break;
+                if ('=' == c0 || '=' == c1 || '=' == c2 || '=' == c3) break;
+                int d0 = dataDecodeTable[c0], d1 = dataDecodeTable[c1], d2 = dataDecodeTable[c2], d3 = dataDecodeTable[c3];
+                if ((d0 | d1 | d2 | d3) < 0) break;
+                acc = (d0 << 18) | (d1 << 12) | (d2 << 6) | d3;
+                if (!pInfo->skip) {
+                    tmpbuf[tmpbufpos++] = (acc >> 16) & 0xff;
+                    tmpbuf[tmpbufpos++] = (acc >> 8) & 0xff;
+                    tmpbuf[tmpbufpos++] = acc & 0xff;
+                }
+                numeq = 0;
+                cntr += 4;
+                p += 4;
+            }
+            pInfo->curr = (const char *)p;
+            if (pInfo->curr >= pInfo->end) break;
+        }
         signed char c = *(pInfo->curr);
         if (c == '<') {
             break;
@@ -1767,6 +1891,33 @@ static Boolean parseDateTag(_CFXMLPlistParseInfo *pInfo, CFTypeRef *out) {
 }
 
 static Boolean parseRealTag(_CFXMLPlistParseInfo *pInfo, CFTypeRef *out) {
+    if (!pInfo->skip) {
+        // Plain numeric literals are converted straight from the document bytes; nan, inf, white space,
+        // entities and CDATA fall through to the string based path below
+        char buffer[64];
+        CFIndex len = 0;
+        const char *p = pInfo->curr;
+        while (p < pInfo->end && len < (CFIndex)sizeof(buffer) - 1 && (('0' <= *p && *p <= '9') || '.' == *p || '-' == *p || '+' == *p || 'e' == *p || 'E' == *p)) {
+            buffer[len++] = *p++;
+        }
+        if (0 < len && p < pInfo->end && '<' == *p && (p + 1 >= pInfo->end || '!' != *(p + 1))) {
+            char *endp = NULL;
+            buffer[len] = '\0';
+            double val = strtod_l(buffer, &endp, NULL);
+            if (endp == buffer + len) {
+                pInfo->curr = p;
+                CFNumberRef result = CFNumberCreate(pInfo->allocator, kCFNumberDoubleType, &val);
+                if (checkForCloseTag(pInfo, CFXMLPlistTags[REAL_IX], REAL_TAG_LENGTH)) {
+                    *out = result;
+                    return true;
+                } else {
+                    __CFPListRelease(result, pInfo->allocator);
+                    return false;
+                }
+            }
+        }
+    }
+
     CFStringRef str = NULL;
     if (!parseStringTag(pInfo, &str)) {
         if (!pInfo->error) pInfo->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Encountered empty <real> on line %d"), lineNumber(pInfo));
@@ -1920,6 +2071,16 @@ static Boolean parseIntegerTag(_CFXMLPlistParseInfo *pInfo, CFTypeRef *out) {
     }
     uint64_t value = 0;
     uint32_t multiplier = (isHex ? 16 : 10);
+    if (!isHex) {
+        // No run of 18 decimal digits can overflow, so those skip the per-digit checks below
+        int digits = 0;
+        while (digits < 18 && '0' <= ch && ch <= '9') {
+            value = value * 10 + (ch - '0');
+            digits++;
+            pInfo->curr++;
+            GET_CH;
+        }
+    }
     while ('<' != ch) {
 	uint32_t new_digit = 0;
 	switch (ch) {
@@ -2391,6 +2552,7 @@ static Boolean _CFPropertyListCreateFromUTF8Data(CFAllocatorRef allocator, CFDat
     pInfo->allowNewTypes = allowNewTypes;
     pInfo->skip = false;
     pInfo->keyPaths = createTopLevelKeypaths(allocator, keyPaths);
+    pInfo->allowParallel = (NULL == pInfo->keyPaths);
     
     Boolean success = parseXMLPropertyList(pInfo, &result);
     if (success && result && format) *format = kCFPropertyListXMLFormat_v1_0;
@@ -2913,7 +3075,15 @@ static bool __convertReadStreamToBytes(CFReadStreamRef stream, CFIndex max, uint
     int32_t buflen = 0, bufsize = 0, retlen;
     uint8_t *buf = NULL, sbuf[8192];
     for (;;) {
-	retlen = CFReadStreamRead(stream, sbuf, __CFMin(8192, max));
+        // Streams which keep their own buffer (a mapped file, say) can hand out large blocks without a copy into sbuf
+        CFIndex available = 0;
+        const uint8_t *bytes = CFReadStreamGetBuffer(stream, __CFMin(max, INT32_MAX - buflen), &available);
+        if (bytes && 0 < available) {
+            retlen = (int32_t)available;
+        } else {
+            retlen = CFReadStreamRead(stream, sbuf, __CFMin(8192, max));
+            bytes = sbuf;
+        }
         if (retlen <= 0) {
             *buffer = buf;
             *length = buflen;
@@ -2940,7 +3110,7 @@ static bool __convertReadStreamToBytes(CFReadStreamRef stream, CFIndex max, uint
 	    buf = (uint8_t *)CFAllocatorReallocate(kCFAllocatorSystemDefault, buf, bufsize, 0);
 	    if (!buf) HALT;
 	}
-	memmove(buf + buflen, sbuf, retlen);
+	memmove(buf + buflen, bytes, retlen);
 	buflen += retlen;
         max -= retlen;
 	if (max <= 0) {
@@ -3007,6 +3177,442 @@ CFPropertyListRef CFPropertyListCreateFromStream(CFAllocatorRef allocator, CFRea
     return result;
 }
 
+#pragma mark -
+#pragma mark Streaming
+
+// Bytes requested from the stream per read; the buffer only grows past this to hold a single key or scalar value
+#define STREAM_READ_CHUNK (64 * 1024)
+// Uniqued strings are dropped once this many have been collected, so that memory use does not grow with the document
+#define STREAM_STRING_CACHE_LIMIT 4096
+
+typedef struct {
+    Boolean isDict;
+    Boolean filtered;       // if false, everything below this container is reported
+    CFIndex count;          // number of children seen so far; the index of the next array element
+    CFStringRef key;        // key waiting for its value
+    CFSetRef theseKeys;     // components accepted at this level when filtered
+    CFSetRef nextKeys;      // key paths for the levels below
+} __CFPlistStreamFrame;
+
+typedef struct {
+    CFAllocatorRef allocator;
+    CFReadStreamRef stream;
+    uint8_t *buffer;
+    CFIndex capacity;
+    CFIndex length;         // number of valid bytes in buffer
+    CFIndex pos;            // scan position
+    CFIndex mark;           // first byte that must survive a refill, or kCFNotFound
+    Boolean atEnd;
+    CFErrorRef error;
+    __CFPlistStreamFrame *frames;
+    CFIndex frameCount;
+    CFIndex frameCapacity;
+    CFMutableArrayRef path; // key path components of the element being reported
+    _CFPropertyListStreamCallBack callback;
+    void *info;
+    Boolean stopped;        // the callback asked us to stop
+    _CFXMLPlistParseInfo pInfo; // used to decode one key or scalar value at a time
+} __CFPlistStreamReader;
+
+// Drops consumed bytes and reads more from the stream. Returns false at the end of the stream or on a read error.
+static Boolean __CFPlistStreamRefill(__CFPlistStreamReader *r) {
+    if (r->atEnd || r->error) return false;
+    CFIndex keep = (r->mark != kCFNotFound) ? r->mark : r->pos;
+    if (keep > 0) {
+        memmove(r->buffer, r->buffer + keep, r->length - keep);
+        r->length -= keep;
+        r->pos -= keep;
+        if (r->mark != kCFNotFound) r->mark -= keep;
+    }
+    if (r->capacity - r->length < STREAM_READ_CHUNK / 2) {
+        r->capacity = (r->capacity < STREAM_READ_CHUNK) ? STREAM_READ_CHUNK : 2 * r->capacity;
+        r->buffer = (uint8_t *)CFAllocatorReallocate(kCFAllocatorSystemDefault, r->buffer, r->capacity, 0);
+        if (!r->buffer) HALT;
+    }
+    CFIndex got = CFReadStreamRead(r->stream, r->buffer + r->length, r->capacity - r->length);
+    if (got < 0) {
+        r->error = CFReadStreamCopyError(r->stream);
+        if (!r->error) r->error = __CFPropertyListCreateError(kCFPropertyListReadStreamError, CFSTR("Stream error reading a property list"));
+        return false;
+    }
+    if (got == 0) {
+        r->atEnd = true;
+        return false;
+    }
+    r->length += got;
+    return true;
+}
+
+// Makes sure there are at least n bytes after pos
+static Boolean __CFPlistStreamEnsure(__CFPlistStreamReader *r, CFIndex n) {
+    while (r->length - r->pos < n) {
+        if (!__CFPlistStreamRefill(r)) return false;
+    }
+    return true;
+}
+
+static Boolean __CFPlistStreamHasPrefix(__CFPlistStreamReader *r, CFIndex offset, const char *s, CFIndex length) {
+    return __CFPlistStreamEnsure(r, offset + length) && !memcmp(r->buffer + r->pos + offset, s, length);
+}
+
+// Returns the offset from pos of the first occurrence of s at or after pos + from, or kCFNotFound. If no mark is set, pos is moved up to the bytes still being searched so that skipped content does not accumulate in the buffer; the result is relative to the new pos.
+static CFIndex __CFPlistStreamFind(__CFPlistStreamReader *r, CFIndex from, const char *s, CFIndex length) {
+    for (;;) {
+        const uint8_t *p = r->buffer + r->pos + from, *end = r->buffer + r->length;
+        while (end - p >= length) {
+            p = (const uint8_t *)memchr(p, s[0], end - p - length + 1);
+            if (!p) break;
+            if (!memcmp(p, s, length)) return p - (r->buffer + r->pos);
+            p++;
+        }
+        from = r->length - r->pos - length + 1;
+        if (from < 0) from = 0;
+        if (r->mark == kCFNotFound) {
+            r->pos += from;
+            from = 0;
+        }
+        if (!__CFPlistStreamRefill(r)) return kCFNotFound;
+    }
+}
+
+static Boolean __CFPlistStreamSkipWhitespace(__CFPlistStreamReader *r) {
+    for (;;) {
+        r->pos = __CFByteScanSkipXMLSpace(r->buffer + r->pos, r->buffer + r->length) - r->buffer;
+        if (r->pos < r->length) return true;
+        if (!__CFPlistStreamRefill(r)) return false;
+    }
+}
+
+// With pos at the '<' of a start tag, returns the offset from pos just past the end of that element, including everything nested in it, or kCFNotFound if the stream ends first. Without a mark the element is consumed as it is scanned.
+static CFIndex __CFPlistStreamScanElement(__CFPlistStreamReader *r) {
+    CFIndex depth = 0, off = 0;
+    Boolean consume = (r->mark == kCFNotFound);
+    do {
+        off = __CFPlistStreamFind(r, off, "<", 1);
+        if (off == kCFNotFound) return kCFNotFound;
+        if (consume) {
+            r->pos += off;
+            off = 0;
+        }
+        if (__CFPlistStreamHasPrefix(r, off, "<!--", 4)) {
+            off = __CFPlistStreamFind(r, off + 4, "-->", 3);
+            if (off == kCFNotFound) return kCFNotFound;
+            off += 3;
+        } else if (__CFPlistStreamHasPrefix(r, off, "<![CDATA[", 9)) {
+            off = __CFPlistStreamFind(r, off + 9, "]]>", 3);
+            if (off == kCFNotFound) return kCFNotFound;
+            off += 3;
+        } else if (__CFPlistStreamHasPrefix(r, off, "<?", 2)) {
+            off = __CFPlistStreamFind(r, off + 2, "?>", 2);
+            if (off == kCFNotFound) return kCFNotFound;
+            off += 2;
+        } else {
+            Boolean isEndTag = __CFPlistStreamHasPrefix(r, off, "</", 2);
+            // Hold on to the tag itself so its last byte can be looked at
+            if (consume) r->mark = r->pos;
+            CFIndex close = __CFPlistStreamFind(r, off + 1, ">", 1);
+            if (consume) r->mark = kCFNotFound;
+            if (close == kCFNotFound) return kCFNotFound;
+            if (isEndTag) {
+                depth--;
+            } else if (r->buffer[r->pos + close - 1] != '/') {
+                depth++;
+            }
+            off = close + 1;
+        }
+    } while (depth > 0);
+    return off;
+}
+
+// Decodes the element spanning [mark, pos + length) with the regular parser
+static Boolean __CFPlistStreamDecode(__CFPlistStreamReader *r, CFIndex length, CFTypeRef *out) {
+    _CFXMLPlistParseInfo *pInfo = &r->pInfo;
+    if (CFArrayGetCount(pInfo->stringCache) > STREAM_STRING_CACHE_LIMIT) {
+        _cleanupStringMap(pInfo);
+        _createStringMap(pInfo);
+    }
+    pInfo->begin = (const char *)r->buffer + r->mark;
+    pInfo->curr = pInfo->begin + 1;
+    pInfo->end = (const char *)r->buffer + r->pos + length;
+    *out = NULL;
+    if (!parseXMLElement(pInfo, NULL, out) || !*out) {
+        if (*out) __CFPListRelease(*out, r->allocator);
+        *out = NULL;
+        r->error = pInfo->error ? pInfo->error : __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Encountered malformed value while streaming a property list"));
+        pInfo->error = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void __CFPlistStreamEmit(__CFPlistStreamReader *r, _CFPropertyListStreamEvent event, CFTypeRef value) {
+    if (r->stopped) return;
+    CFStringRef keyPath = CFStringCreateByCombiningStrings(r->allocator, r->path, CFSTR(":"));
+    if (!r->callback(event, keyPath, value, r->info)) r->stopped = true;
+    __CFPListRelease(keyPath, r->allocator);
+}
+
+// Called once the current child of the innermost container has been dealt with
+static void __CFPlistStreamChildDone(__CFPlistStreamReader *r) {
+    if (r->frameCount == 0) return;
+    __CFPlistStreamFrame *frame = &r->frames[r->frameCount - 1];
+    if (frame->key) __CFPListRelease(frame->key, r->allocator);
+    frame->key = NULL;
+    frame->count++;
+}
+
+static void __CFPlistStreamPushFrame(__CFPlistStreamReader *r, Boolean isDict, CFSetRef keyPaths) {
+    if (r->frameCount == r->frameCapacity) {
+        r->frameCapacity = r->frameCapacity ? 2 * r->frameCapacity : 16;
+        r->frames = (__CFPlistStreamFrame *)CFAllocatorReallocate(kCFAllocatorSystemDefault, r->frames, r->frameCapacity * sizeof(__CFPlistStreamFrame), 0);
+        if (!r->frames) HALT;
+    }
+    __CFPlistStreamFrame *frame = &r->frames[r->frameCount++];
+    frame->isDict = isDict;
+    frame->filtered = (keyPaths != NULL);
+    frame->count = 0;
+    frame->key = NULL;
+    __CFPropertyListCreateSplitKeypaths(r->allocator, keyPaths, &frame->theseKeys, &frame->nextKeys);
+}
+
+static void __CFPlistStreamPopFrame(__CFPlistStreamReader *r) {
+    __CFPlistStreamFrame *frame = &r->frames[--r->frameCount];
+    if (frame->key) __CFPListRelease(frame->key, r->allocator);
+    if (frame->theseKeys) __CFPListRelease(frame->theseKeys, r->allocator);
+    if (frame->nextKeys) __CFPListRelease(frame->nextKeys, r->allocator);
+}
+
+static Boolean __CFPlistStreamNameIs(const uint8_t *name, CFIndex length, CFIndex ix, CFIndex tagLength) {
+    return length == tagLength && !memcmp(name, CFXMLPlistTags[ix], tagLength);
+}
+
+static void __CFPlistStreamRead(__CFPlistStreamReader *r, CFSetRef keyPaths) {
+    Boolean sawPlist = false, sawRoot = false;
+    
+    if (__CFPlistStreamHasPrefix(r, 0, "\xEF\xBB\xBF", 3)) r->pos += 3;
+    if (__CFPlistStreamHasPrefix(r, 0, "bplist", 6)) {
+        r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Binary property lists cannot be streamed"));
+        return;
+    }
+    
+    while (!r->error && !r->stopped) {
+        if (!__CFPlistStreamSkipWhitespace(r)) {
+            if (!r->error && (r->frameCount || !sawRoot || sawPlist)) r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Encountered unexpected EOF"));
+            return;
+        }
+        if (r->buffer[r->pos] != '<') {
+            r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Encountered unexpected character data in property list"));
+            return;
+        }
+        
+        // Comments, processing instructions and the DOCTYPE carry nothing we report
+        if (__CFPlistStreamHasPrefix(r, 0, "<!--", 4)) {
+            CFIndex off = __CFPlistStreamFind(r, 4, "-->", 3);
+            if (off == kCFNotFound) break;
+            r->pos += off + 3;
+            continue;
+        }
+        if (__CFPlistStreamHasPrefix(r, 0, "<?", 2)) {
+            CFIndex off = __CFPlistStreamFind(r, 2, "?>", 2);
+            if (off == kCFNotFound) break;
+            r->pos += off + 2;
+            continue;
+        }
+        if (__CFPlistStreamHasPrefix(r, 0, "<!", 2)) {
+            CFIndex off = 2, brackets = 0;
+            while (__CFPlistStreamEnsure(r, off + 1)) {
+                uint8_t ch = r->buffer[r->pos + off];
+                if (ch == '[') brackets++;
+                else if (ch == ']') brackets--;
+                else if (ch == '>' && brackets <= 0) break;
+                off++;
+            }
+            if (r->length - r->pos <= off) break;
+            r->pos += off + 1;
+            continue;
+        }
+        
+        r->mark = r->pos;
+        CFIndex close = __CFPlistStreamFind(r, 1, ">", 1);
+        if (close == kCFNotFound) break;
+        const uint8_t *tag = r->buffer + r->pos;
+        Boolean isEndTag = (tag[1] == '/');
+        Boolean isEmpty = !isEndTag && (tag[close - 1] == '/');
+        const uint8_t *name = tag + (isEndTag ? 2 : 1), *nameEnd = name;
+        while (nameEnd < tag + close && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\n' && *nameEnd != '\r' && *nameEnd != '/') nameEnd++;
+        CFIndex nameLength = nameEnd - name;
+        __CFPlistStreamFrame *parent = r->frameCount ? &r->frames[r->frameCount - 1] : NULL;
+        
+        if (isEndTag) {
+            r->mark = kCFNotFound;
+            r->pos += close + 1;
+            if (__CFPlistStreamNameIs(name, nameLength, PLIST_IX, PLIST_TAG_LENGTH)) {
+                if (!sawPlist || !sawRoot || parent) break;
+                return;
+            }
+            if (!parent || !__CFPlistStreamNameIs(name, nameLength, parent->isDict ? DICT_IX : ARRAY_IX, parent->isDict ? DICT_TAG_LENGTH : ARRAY_TAG_LENGTH)) {
+                r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Encountered mismatched close tag while streaming a property list"));
+                return;
+            }
+            if (parent->key) {
+                r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Value missing for key inside <dict>"));
+                return;
+            }
+            Boolean wasDict = parent->isDict;
+            __CFPlistStreamPopFrame(r);
+            __CFPlistStreamEmit(r, wasDict ? _kCFPropertyListStreamEventEndDictionary : _kCFPropertyListStreamEventEndArray, NULL);
+            if (r->frameCount) {
+                CFArrayRemoveValueAtIndex(r->path, CFArrayGetCount(r->path) - 1);
+                __CFPlistStreamChildDone(r);
+            } else if (!sawPlist) {
+                return;
+            }
+            continue;
+        }
+        
+        if (__CFPlistStreamNameIs(name, nameLength, PLIST_IX, PLIST_TAG_LENGTH)) {
+            if (sawPlist || sawRoot || isEmpty) {
+                r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Encountered unexpected <plist> tag"));
+                return;
+            }
+            sawPlist = true;
+            r->mark = kCFNotFound;
+            r->pos += close + 1;
+            continue;
+        }
+        if (sawRoot && !parent) {
+            r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Encountered unexpected element after the top-level object"));
+            return;
+        }
+        
+        if (__CFPlistStreamNameIs(name, nameLength, KEY_IX, KEY_TAG_LENGTH)) {
+            if (!parent || !parent->isDict || parent->key) {
+                r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Found unexpected <key> while streaming a property list"));
+                return;
+            }
+            CFIndex end = __CFPlistStreamScanElement(r);
+            if (end == kCFNotFound) break;
+            CFTypeRef key;
+            if (!__CFPlistStreamDecode(r, end, &key)) return;
+            parent->key = (CFStringRef)key;
+            r->mark = kCFNotFound;
+            r->pos += end;
+            continue;
+        }
+        if (parent && parent->isDict && !parent->key) {
+            r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Found non-key inside <dict>"));
+            return;
+        }
+        
+        // Work out whether this element, and which part of what is below it, is wanted
+        CFStringRef component = NULL;
+        if (parent) component = parent->isDict ? (CFStringRef)CFRetain(parent->key) : CFStringCreateWithFormat(r->allocator, NULL, CFSTR("%ld"), (long)parent->count);
+        Boolean wanted = true;
+        CFSetRef childKeyPaths = NULL;
+        if (!parent) {
+            childKeyPaths = keyPaths;
+        } else if (parent->filtered) {
+            wanted = parent->theseKeys && CFSetContainsValue(parent->theseKeys, component);
+            childKeyPaths = parent->nextKeys;
+        }
+        
+        Boolean isDict = __CFPlistStreamNameIs(name, nameLength, DICT_IX, DICT_TAG_LENGTH);
+        Boolean isArray = __CFPlistStreamNameIs(name, nameLength, ARRAY_IX, ARRAY_TAG_LENGTH);
+        if (!wanted) {
+            r->mark = kCFNotFound;
+            CFIndex end = __CFPlistStreamScanElement(r);
+            if (component) __CFPListRelease(component, r->allocator);
+            if (end == kCFNotFound) break;
+            r->pos += end;
+            __CFPlistStreamChildDone(r);
+            continue;
+        }
+        
+        if (component) {
+            CFArrayAppendValue(r->path, component);
+            __CFPListRelease(component, r->allocator);
+        }
+        if (parent && parent->isDict) __CFPlistStreamEmit(r, _kCFPropertyListStreamEventKey, parent->key);
+        if (isDict || isArray) {
+            r->mark = kCFNotFound;
+            r->pos += close + 1;
+            __CFPlistStreamEmit(r, isDict ? _kCFPropertyListStreamEventBeginDictionary : _kCFPropertyListStreamEventBeginArray, NULL);
+            if (isEmpty) {
+                __CFPlistStreamEmit(r, isDict ? _kCFPropertyListStreamEventEndDictionary : _kCFPropertyListStreamEventEndArray, NULL);
+                if (parent) {
+                    CFArrayRemoveValueAtIndex(r->path, CFArrayGetCount(r->path) - 1);
+                    __CFPlistStreamChildDone(r);
+                } else if (!sawPlist) {
+                    return;
+                }
+            } else {
+                __CFPlistStreamPushFrame(r, isDict, childKeyPaths);
+            }
+        } else {
+            CFIndex end = __CFPlistStreamScanElement(r);
+            if (end == kCFNotFound) break;
+            CFTypeRef value;
+            if (!__CFPlistStreamDecode(r, end, &value)) return;
+            r->mark = kCFNotFound;
+            r->pos += end;
+            __CFPlistStreamEmit(r, _kCFPropertyListStreamEventValue, value);
+            __CFPListRelease(value, r->allocator);
+            if (parent) {
+                CFArrayRemoveValueAtIndex(r->path, CFArrayGetCount(r->path) - 1);
+                __CFPlistStreamChildDone(r);
+            } else if (!sawPlist) {
+                return;
+            }
+        }
+        sawRoot = true;
+    }
+    // Only the loop's breaks get here, all of which mean the document ended early
+    if (!r->error && !r->stopped) r->error = __CFPropertyListCreateError(kCFPropertyListReadCorruptError, CFSTR("Encountered unexpected EOF"));
+}
+
+bool _CFPropertyListReadStream(CFAllocatorRef allocator, CFReadStreamRef stream, CFOptionFlags option, CFSetRef keyPaths, _CFPropertyListStreamCallBack callback, void *info, CFErrorRef *error) {
+    initStatics();
+    CFAssert1(stream != NULL, __kCFLogAssertion, "%s(): NULL stream not allowed", __PRETTY_FUNCTION__);
+    CFAssert1(callback != NULL, __kCFLogAssertion, "%s(): NULL callback not allowed", __PRETTY_FUNCTION__);
+    CFAssert2(option == kCFPropertyListImmutable || option == kCFPropertyListMutableContainers || option == kCFPropertyListMutableContainersAndLeaves, __kCFLogAssertion, "%s(): Unrecognized option %d", __PRETTY_FUNCTION__, option);
+    
+    if (error) *error = NULL;
+    __CFPlistStreamReader reader;
+    __CFPlistStreamReader *r = &reader;
+    memset(r, 0, sizeof(reader));
+    r->allocator = allocator;
+    r->stream = stream;
+    r->mark = kCFNotFound;
+    r->path = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeArrayCallBacks);
+    r->callback = callback;
+    r->info = info;
+    r->pInfo.allocator = allocator;
+    r->pInfo.mutabilityOption = option;
+    r->pInfo.allowNewTypes = true;
+    _createStringMap(&r->pInfo);
+    
+    CFSetRef topLevelKeyPaths = createTopLevelKeypaths(allocator, keyPaths);
+    __CFPlistStreamRead(r, topLevelKeyPaths);
+    if (topLevelKeyPaths) __CFPListRelease(topLevelKeyPaths, allocator);
+    
+    while (r->frameCount) __CFPlistStreamPopFrame(r);
+    _cleanupStringMap(&r->pInfo);
+    CFRelease(r->path);
+    if (r->frames) CFAllocatorDeallocate(kCFAllocatorSystemDefault, r->frames);
+    if (r->buffer) CFAllocatorDeallocate(kCFAllocatorSystemDefault, r->buffer);
+    
+    if (r->error) {
+        if (error) {
+            *error = r->error;
+        } else {
+            CFRelease(r->error);
+        }
+        return false;
+    }
+    return true;
+}
+
+
 #endif //DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS
 
 #pragma mark -
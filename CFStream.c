@@ -673,57 +673,51 @@ static void _cfstream_shared_signalEventSync(void* info)
 #endif
     } else {
 	CFMutableArrayRef list = (CFMutableArrayRef) info;
-	CFIndex c, i;
-	CFOptionFlags whatToSignal = 0;
-        dispatch_queue_t queue = 0;
-	struct _CFStream* stream = NULL;
+	CFIndex c, i, pending = 0;
+        struct {
+            struct _CFStream* stream;
+            CFOptionFlags whatToSignal;
+            dispatch_queue_t queue;
+        } stackEvents[16], *events = stackEvents;
 
 	__CFLock(&sSourceLock);
 
-	/* Looks like, we grab the first stream that wants an event... */
-	/* Note that I grab an extra retain when I pull out the stream here... */
+	/* Take every stream that wants an event in one pass.  Handing out one per firing and resignalling made the latency of an event grow with the number of streams sharing the source. */
+	/* Note that I grab an extra retain on each stream I pull out here... */
 	c = CFArrayGetCount(list);
+        if ((size_t)c > sizeof(stackEvents) / sizeof(stackEvents[0])) {
+            events = CFAllocatorAllocate(kCFAllocatorSystemDefault, c * sizeof(stackEvents[0]), 0);
+            if (!events) HALT;
+        }
 	for (i = 0; i < c; i++) {
 	    struct _CFStream* s = (struct _CFStream*)CFArrayGetValueAtIndex(list, i);
 
 	    if (s->client->whatToSignal) {
-		stream = s;
-		CFRetain(stream);
-		whatToSignal = stream->client->whatToSignal;
+		CFRetain(s);
+		events[pending].stream = s;
+		events[pending].whatToSignal = s->client->whatToSignal;
 		s->client->whatToSignal = 0;
-                queue = stream->queue;
-                if (queue) dispatch_retain(queue);
-		break;
-	    }
-	}
-
-	/* And then we also signal any other streams in this array so that we get them next go? */
-	for (; i < c;  i++) {
-	    struct _CFStream* s = (struct _CFStream*)CFArrayGetValueAtIndex(list, i);
-	    if (s->client->whatToSignal) {
-                CFRunLoopSourceRef source = _CFStreamCopySource(s);
-                if (source) {
-                    CFRunLoopSourceSignal(source);
-                    CFRelease(source);
-                }
-                break;
+                events[pending].queue = s->queue;
+                if (s->queue) dispatch_retain(s->queue);
+		pending++;
 	    }
 	}
 
 	__CFUnlock(&sSourceLock);
 
-	/* We're sitting here now, possibly with a stream that needs to be processed by the common routine */
-	if (stream) {
-            if (queue == 0)
-                _signalEventSync(stream, whatToSignal);
+	/* We're sitting here now, possibly with streams that need to be processed by the common routine */
+	for (i = 0; i < pending; i++) {
+            if (events[i].queue == 0)
+                _signalEventSync(events[i].stream, events[i].whatToSignal);
             else {
-                _signalEventQueue(queue, stream, whatToSignal);
-                dispatch_release(queue);
+                _signalEventQueue(events[i].queue, events[i].stream, events[i].whatToSignal);
+                dispatch_release(events[i].queue);
             }
 
 	    /* Lose our extra retain */
-	    CFRelease(stream);
+	    CFRelease(events[i].stream);
 	}
+        if (events != stackEvents) CFAllocatorDeallocate(kCFAllocatorSystemDefault, events);
     }
 }
 
@@ -1234,6 +1228,74 @@ CF_EXPORT CFIndex CFWriteStreamWrite(CFWriteStreamRef writeStream, const UInt8 *
     }
 }
 
+CF_EXPORT CFIndex _CFWriteStreamWriteVector(CFWriteStreamRef writeStream, const UInt8 *const *buffers, const CFIndex *lengths, CFIndex count) {
+    struct _CFStream *stream = (struct _CFStream *)writeStream;
+    if (CF_IS_OBJC(__kCFWriteStreamTypeID, writeStream) || _CFStreamGetCallBackPtr(stream) != __CFFileStreamGetCallBacks()) {
+        // No gathering write underneath; hand the buffers over one after the other
+        CFIndex total = 0;
+        for (CFIndex idx = 0; idx < count; idx++) {
+            CFIndex result = CFWriteStreamWrite(writeStream, buffers[idx], lengths[idx]);
+            if (result < 0) return (total > 0) ? total : result;
+            total += result;
+            if (result < lengths[idx]) break;
+        }
+        return total;
+    }
+    CFStreamStatus status = _CFStreamGetStatus(stream);
+    if (status == kCFStreamStatusOpening) {
+        __CFBitSet(stream->flags, CALLING_CLIENT);
+        waitForOpen(stream);
+        __CFBitClear(stream->flags, CALLING_CLIENT);
+        status = _CFStreamGetStatus(stream);
+    }
+    if (status != kCFStreamStatusOpen && status != kCFStreamStatusWriting) {
+        return -1;
+    } else {
+        CFIndex result;
+        CFStreamError err = {0, 0};
+        __CFBitSet(stream->flags, CALLING_CLIENT);
+        _CFStreamSetStatusCode(stream, kCFStreamStatusWriting);
+        if (stream->client) {
+            stream->client->whatToSignal &= ~kCFStreamEventCanAcceptBytes;
+        }
+        result = __CFFileStreamWriteVector(writeStream, buffers, lengths, count, &err, _CFStreamGetInfoPointer(stream));
+        if (err.error) _CFStreamSetStreamError(stream, &err);
+        if (stream->error) {
+            _CFStreamSetStatusCode(stream, kCFStreamStatusError);
+            _CFStreamScheduleEvent(stream, kCFStreamEventErrorOccurred);
+        } else if (result == 0 && count > 0) {
+            _CFStreamSetStatusCode(stream, kCFStreamStatusAtEnd);
+            _CFStreamScheduleEvent(stream, kCFStreamEventEndEncountered);
+        } else {
+            _CFStreamSetStatusCode(stream, kCFStreamStatusOpen);
+        }
+        __CFBitClear(stream->flags, CALLING_CLIENT);
+        return result;
+    }
+}
+
+CF_EXPORT Boolean _CFWriteStreamFlush(CFWriteStreamRef writeStream) {
+    struct _CFStream *stream = (struct _CFStream *)writeStream;
+    if (CF_IS_OBJC(__kCFWriteStreamTypeID, writeStream) || _CFStreamGetCallBackPtr(stream) != __CFFileStreamGetCallBacks()) {
+        // Only file streams hold on to written bytes
+        return TRUE;
+    }
+    CFStreamStatus status = _CFStreamGetStatus(stream);
+    if (status != kCFStreamStatusOpen && status != kCFStreamStatusWriting) {
+        return (status != kCFStreamStatusError);
+    }
+    CFStreamError err = {0, 0};
+    __CFBitSet(stream->flags, CALLING_CLIENT);
+    Boolean result = __CFFileStreamFlush(writeStream, &err, _CFStreamGetInfoPointer(stream));
+    if (err.error) {
+        _CFStreamSetStreamError(stream, &err);
+        _CFStreamSetStatusCode(stream, kCFStreamStatusError);
+        _CFStreamScheduleEvent(stream, kCFStreamEventErrorOccurred);
+    }
+    __CFBitClear(stream->flags, CALLING_CLIENT);
+    return result;
+}
+
 CF_PRIVATE CFTypeRef _CFStreamCopyProperty(struct _CFStream *stream, CFStringRef propertyName) {
     const struct _CFStreamCallBacks *cb = _CFStreamGetCallBackPtr(stream);
     if (cb->copyProperty == NULL) {
@@ -1672,7 +1734,15 @@ void CFWriteStreamUnscheduleFromRunLoop(CFWriteStreamRef stream, CFRunLoopRef ru
     _CFStreamUnscheduleFromRunLoop((struct _CFStream *)stream, runLoop, runLoopMode);
 }
 
-static CFRunLoopRef sLegacyRL = NULL;
+// Streams given a dispatch queue are serviced by a few run loop threads rather than a single one, so that their events do not all wait on each other. A stream always lands on the same thread.
+#define LEGACY_STREAM_THREAD_MAX 8
+static CFRunLoopRef sLegacyRL[LEGACY_STREAM_THREAD_MAX] = {NULL};
+static CFIndex sLegacyRLCount = 0;
+
+typedef struct {
+    CFIndex index;
+    dispatch_semaphore_t sem;
+} _legacyStreamRunLoopStart;
 
 static void _perform(void* info)
 {
@@ -1681,13 +1751,15 @@ static void _perform(void* info)
 static void* _legacyStreamRunLoop_workThread(void* arg)
 {
     pthread_setname_np("com.apple.CFStream.LegacyThread");
-    sLegacyRL = CFRunLoopGetCurrent();
+    CFIndex index = ((_legacyStreamRunLoopStart*) arg)->index;
+    CFRunLoopRef rl = CFRunLoopGetCurrent();
+    sLegacyRL[index] = rl;
 
 #if defined(LOG_STREAM)
-    fprintf(stderr, "Creating Schedulingset emulation thread.  Runloop: %p\n", sLegacyRL);
+    fprintf(stderr, "Creating Schedulingset emulation thread %ld.  Runloop: %p\n", (long) index, rl);
 #endif
 
-    CFStringRef s = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("<< CFStreamLegacySource for Runloop %p >>"), sLegacyRL);
+    CFStringRef s = CFStringCreateWithFormat(kCFAllocatorDefault, NULL, CFSTR("<< CFStreamLegacySource for Runloop %p >>"), rl);
 
     CFRunLoopSourceContext ctxt = {
         0,
@@ -1705,10 +1777,10 @@ static void* _legacyStreamRunLoop_workThread(void* arg)
     CFRunLoopSourceRef rls = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &ctxt);
     CFRelease(s);
 
-    CFRunLoopAddSource(sLegacyRL, rls, kCFRunLoopDefaultMode);
+    CFRunLoopAddSource(rl, rls, kCFRunLoopDefaultMode);
     CFRelease(rls);
 
-    dispatch_semaphore_signal(*(dispatch_semaphore_t*) arg);
+    dispatch_semaphore_signal(((_legacyStreamRunLoopStart*) arg)->sem);
     arg = NULL;
 
     while (true) {
@@ -1735,29 +1807,37 @@ static void* _legacyStreamRunLoop_workThread(void* arg)
 
     return NULL;
 }
-static CFRunLoopRef _legacyStreamRunLoop()
+static CFRunLoopRef _legacyStreamRunLoop(struct _CFStream* stream)
 {
-    static dispatch_once_t sOnce = 0;
+    static dispatch_once_t sCountOnce = 0;
+    static dispatch_once_t sOnce[LEGACY_STREAM_THREAD_MAX] = {0};
+
+    dispatch_once(&sCountOnce, ^{
+        CFIndex count = __CFActiveProcessorCount();
+        sLegacyRLCount = (count < 1) ? 1 : (count < LEGACY_STREAM_THREAD_MAX) ? count : LEGACY_STREAM_THREAD_MAX;
+    });
+
+    CFIndex index = (CFIndex) ((((uintptr_t) stream >> 4) * 2654435761u) % (uintptr_t) sLegacyRLCount);
 
-    dispatch_once(&sOnce, ^{
+    dispatch_once(&sOnce[index], ^{
 
-        if (sLegacyRL == NULL) {
-            dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+        if (sLegacyRL[index] == NULL) {
+            _legacyStreamRunLoopStart start = { index, dispatch_semaphore_create(0) };
 
             pthread_attr_t attr;
             pthread_attr_init(&attr);
             pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
             pthread_attr_set_qos_class_np(&attr, qos_class_main(), 0);
             pthread_t workThread;
-            (void) pthread_create(&workThread, &attr, _legacyStreamRunLoop_workThread, &sem);
+            (void) pthread_create(&workThread, &attr, _legacyStreamRunLoop_workThread, &start);
             pthread_attr_destroy(&attr);
 
-            dispatch_semaphore_wait(sem, DISPATCH_TIME_FOREVER);
-            dispatch_release(sem);
+            dispatch_semaphore_wait(start.sem, DISPATCH_TIME_FOREVER);
+            dispatch_release(start.sem);
         }
     });
     
-    return sLegacyRL;
+    return sLegacyRL[index];
 }
 
 static dispatch_queue_t _CFStreamCopyDispatchQueue(struct _CFStream* stream)
@@ -1797,7 +1877,7 @@ static void _CFStreamSetDispatchQueue(struct _CFStream* stream, dispatch_queue_t
         }
         _CFStreamUnlock(stream);
     } else {
-        _CFStreamScheduleWithRunLoop(stream, _legacyStreamRunLoop(), kCFRunLoopDefaultMode);
+        _CFStreamScheduleWithRunLoop(stream, _legacyStreamRunLoop(stream), kCFRunLoopDefaultMode);
 
         _CFStreamLock(stream);
         if (stream->client) {
@@ -36,9 +36,11 @@
 #include <CoreFoundation/CFUnicodeDecomposition.h>
 #include <CoreFoundation/CFUnicodePrecomposition.h>
 #include <CoreFoundation/CFPriv.h>
+#include <CoreFoundation/CFCharacterSetPriv.h>
 #include <CoreFoundation/CFNumber.h>
 #include <CoreFoundation/CFNumberFormatter.h>
 #include "CFInternal.h"
+#include "CFByteScan.h"
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI || DEPLOYMENT_TARGET_WINDOWS || DEPLOYMENT_TARGET_LINUX
 #include "CFLocaleInternal.h"
 #endif
@@ -2566,8 +2568,10 @@ CFComparisonResult CFStringCompareWithOptionsAndLocale(CFStringRef string, CFStr
 
             if ((kCFStringEncodingASCII == eightBitEncoding) && (false == forceOrdering)) {
                 if (caseInsensitive) {
-                    int cmpResult = strncasecmp_l((const char *)str1Bytes + rangeToCompare.location, (const char *)str2Bytes, __CFMin(rangeToCompare.length, str2Len), NULL);
-                    
+                    CFIndex limitLength = __CFMin(rangeToCompare.length, str2Len);
+                    CFIndex mismatch = __CFByteScanCaselessMismatch(str1Bytes + rangeToCompare.location, str2Bytes, limitLength);
+                    CFIndex cmpResult = ((mismatch < limitLength) ? ((CFIndex)__CFByteScanFoldASCII(str1Bytes[rangeToCompare.location + mismatch]) - (CFIndex)__CFByteScanFoldASCII(str2Bytes[mismatch])) : 0);
+
                     if (0 == cmpResult) cmpResult = rangeToCompare.length - str2Len;
                     
                     return ((0 == cmpResult) ? kCFCompareEqualTo : ((cmpResult < 0) ? kCFCompareLessThan : kCFCompareGreaterThan));
@@ -2578,6 +2582,9 @@ CFComparisonResult CFStringCompareWithOptionsAndLocale(CFStringRef string, CFStr
                 str1Bytes += rangeToCompare.location;
 
                 while (str1Index < limitLength) {
+                    str1Index += __CFByteScanMismatch(str1Bytes + str1Index, str2Bytes + str1Index, limitLength - str1Index); // Skip the identical run
+                    if (str1Index == limitLength) break;
+
                     str1Char = str1Bytes[str1Index];
                     str2Char = str2Bytes[str1Index];
 
@@ -2931,7 +2938,26 @@ Boolean CFStringFindWithOptionsAndLocale(CFStringRef string, CFStringRef stringT
         
         delta = ((fromLoc <= toLoc) ? 1 : -1);
 
-        if ((NULL != str1Bytes) && (NULL != str2Bytes)) {
+        // Unanchored literal searches, and case insensitive ones over ASCII, are plain byte searches
+        bool byteSearch = ((NULL != str1Bytes) && (NULL != str2Bytes) && !(compareOptions & kCFCompareAnchored));
+        bool caselessByteSearch = false;
+        if (byteSearch && equalityOptions) {
+            byteSearch = caselessByteSearch = (caseInsensitive && (NULL == ignoredChars) && (NULL == langCode) && !(compareOptions & (kCFCompareNonliteral|kCFCompareDiacriticInsensitive|kCFCompareWidthInsensitive)) && (__CFByteScanFindNonASCII(str2Bytes, str2Bytes + findStrLen) == str2Bytes + findStrLen) && (__CFByteScanFindNonASCII(str1Bytes + rangeToSearch.location, str1Bytes + maxStr1Index) == str1Bytes + maxStr1Index));
+        }
+
+        if (byteSearch) {
+            const uint8_t *found;
+
+            if (compareOptions & kCFCompareBackwards) {
+                found = __CFByteScanFindLastBytes(str1Bytes + rangeToSearch.location, str1Bytes + maxStr1Index, str2Bytes, findStrLen, caselessByteSearch);
+            } else {
+                found = __CFByteScanFindBytes(str1Bytes + rangeToSearch.location, str1Bytes + maxStr1Index, str2Bytes, findStrLen, caselessByteSearch);
+            }
+            if (NULL != found) {
+                didFind = true;
+                if (NULL != result) *result = CFRangeMake(found - str1Bytes, findStrLen);
+            }
+        } else if ((NULL != str1Bytes) && (NULL != str2Bytes)) {
             uint8_t str1Byte, str2Byte;
 
             while (1) {
@@ -3883,6 +3909,34 @@ CF_EXPORT Boolean CFStringFindCharacterFromSet(CFStringRef theString, CFCharacte
 
     if ((rangeToSearch.location + rangeToSearch.length > CFStringGetLength(theString)) || (rangeToSearch.length == 0)) return false;
 
+    if (!(searchOptions & kCFCompareAnchored)) {	// Unanchored searches over directly accessible contents go through the set's lookup table
+        const _CFCharacterSetTable *table = _CFCharacterSetGetTable(theSet);
+        const UniChar *characters;
+
+        if (table && !CF_IS_OBJC(__kCFStringTypeID, theString) && __CFStrIsEightBit(theString)) {
+            const uint8_t *bytes = (const uint8_t *)__CFStrContents(theString) + __CFStrSkipAnyLengthByte(theString) + rangeToSearch.location;
+            CFIndex idx;
+
+            if (searchOptions & kCFCompareBackwards) {
+                for (idx = rangeToSearch.length - 1; idx >= 0; idx--) if (_CFCharacterSetTableIsMember(table, __CFCharToUniCharTable[bytes[idx]])) break;
+            } else {
+                for (idx = 0; idx < rangeToSearch.length; idx++) if (_CFCharacterSetTableIsMember(table, __CFCharToUniCharTable[bytes[idx]])) break;
+                if (idx == rangeToSearch.length) idx = -1;
+            }
+            if (idx < 0) return false;
+            if (result) *result = CFRangeMake(rangeToSearch.location + idx, 1);
+            return true;
+        } else if (NULL != (characters = CFStringGetCharactersPtr(theString))) {
+            CFIndex idx;
+
+            characters += rangeToSearch.location;
+            idx = ((searchOptions & kCFCompareBackwards) ? _CFCharacterSetFindLastMember(theSet, characters, rangeToSearch.length) : _CFCharacterSetFindFirstMember(theSet, characters, rangeToSearch.length));
+            if (kCFNotFound == idx) return false;
+            if (result) *result = CFRangeMake(rangeToSearch.location + idx, ((idx + 1 < rangeToSearch.length) && CFUniCharIsSurrogateHighCharacter(characters[idx]) && CFUniCharIsSurrogateLowCharacter(characters[idx + 1])) ? 2 : 1);
+            return true;
+        }
+    }
+
     if (searchOptions & kCFCompareBackwards) {
         fromLoc = rangeToSearch.location + rangeToSearch.length - 1;
         toLoc = rangeToSearch.location;
@@ -4116,37 +4170,251 @@ CFStringRef CFStringCreateByCombiningStrings(CFAllocatorRef alloc, CFArrayRef ar
 }
 
 
-CFArrayRef CFStringCreateArrayBySeparatingStrings(CFAllocatorRef alloc, CFStringRef string, CFStringRef separatorString) {
-    CFArrayRef separatorRanges;
-    CFIndex length = CFStringGetLength(string);
-    /* No objc dispatch needed here since CFStringCreateArrayWithFindResults() works with both CFString and NSString */
-    if (!(separatorRanges = CFStringCreateArrayWithFindResults(alloc, string, separatorString, CFRangeMake(0, length), 0))) {
-        return CFArrayCreate(alloc, (const void **)&string, 1, & kCFTypeArrayCallBacks);
+/* Field splitting
+
+ A field is the run of characters between two delimiters, or between a delimiter and an end of the range, so n delimiters make n + 1 fields, empty ones included. Delimiters are either the members of a character set or a list of strings; when several strings match at the same position the longest one wins. The storage of 8-bit CFStrings is scanned directly, 16 bytes at a time; everything else goes through CFStringInlineBuffer.
+ */
+typedef struct {
+    CFStringRef string;
+    _CFStringFieldCallBack callBack;
+    void *context;
+    CFIndex count;
+    Boolean stop;
+} __CFStringFieldState;
+
+typedef struct {
+    CFIndex length;
+    UniChar *characters;
+    uint8_t *bytes;	// NULL if the delimiter cannot appear in 8-bit storage
+} __CFStringFieldDelimiter;
+
+CF_INLINE void __CFStringReportField(__CFStringFieldState *state, CFIndex start, CFIndex end) {
+    state->count++;
+    if ((NULL != state->callBack) && !state->callBack(state->string, CFRangeMake(start, end - start), state->context)) state->stop = true;
+}
+
+// Returns the index of the first member of cset in [idx, end), or end, and the member's length in UTF-16 units
+static CFIndex __CFStringFindDelimiterInSet(CFStringInlineBuffer *buffer, const CFCharacterSetInlineBuffer *cset, CFIndex idx, CFIndex end, CFIndex *delimiterLength) {
+    while (idx < end) {
+        UTF32Char ch = CFStringGetCharacterFromInlineBuffer(buffer, idx);
+        CFIndex length = 1;
+        if (CFUniCharIsSurrogateHighCharacter(ch) && (idx + 1 < end)) {
+            UniChar low = CFStringGetCharacterFromInlineBuffer(buffer, idx + 1);
+            if (CFUniCharIsSurrogateLowCharacter(low)) {
+                ch = CFUniCharGetLongCharacterForSurrogatePair(ch, low);
+                length = 2;
+            }
+        }
+        if (CFCharacterSetInlineBufferIsLongCharacterMember(cset, ch)) {
+            *delimiterLength = length;
+            return idx;
+        }
+        idx += length;
+    }
+    return end;
+}
+
+// Length of the longest delimiter starting at idx, or 0
+static CFIndex __CFStringMatchDelimiters(CFStringInlineBuffer *buffer, CFIndex idx, CFIndex end, const __CFStringFieldDelimiter *delimiters, CFIndex numDelimiters) {
+    CFIndex longest = 0;
+    UniChar ch = CFStringGetCharacterFromInlineBuffer(buffer, idx);
+    for (CFIndex cnt = 0; cnt < numDelimiters; cnt++) {
+        const __CFStringFieldDelimiter *delimiter = &delimiters[cnt];
+        CFIndex matched;
+        if ((delimiter->length <= longest) || (delimiter->length > end - idx) || (delimiter->characters[0] != ch)) continue;
+        for (matched = 1; (matched < delimiter->length) && (CFStringGetCharacterFromInlineBuffer(buffer, idx + matched) == delimiter->characters[matched]); matched++);
+        if (matched == delimiter->length) longest = matched;
+    }
+    return longest;
+}
+
+// Same as __CFStringMatchDelimiters() over 8-bit storage
+static CFIndex __CFStringMatchDelimiterBytes(const uint8_t *p, const uint8_t *end, const __CFStringFieldDelimiter *delimiters, CFIndex numDelimiters) {
+    CFIndex longest = 0;
+    for (CFIndex cnt = 0; cnt < numDelimiters; cnt++) {
+        const __CFStringFieldDelimiter *delimiter = &delimiters[cnt];
+        if ((NULL == delimiter->bytes) || (delimiter->length <= longest) || (delimiter->length > end - p)) continue;
+        if (0 == memcmp(p, delimiter->bytes, delimiter->length)) longest = delimiter->length;
+    }
+    return longest;
+}
+
+CFIndex _CFStringEnumerateFields(CFStringRef string, CFRange range, CFCharacterSetRef delimiterSet, CFArrayRef delimiterStrings, _CFStringFieldCallBack callBack, void *context) {
+    /* No objc dispatch needed here since CFStringInlineBuffer works with both CFString and NSString */
+    __CFStringFieldState state = {string, callBack, context, 0, false};
+    CFIndex fieldStart = range.location, rangeEnd = range.location + range.length;
+    const uint8_t *contents = NULL;
+    uint8_t table[256], members[256];
+    CFIndex memberCount = 0;
+    CFStringInlineBuffer buffer;
+
+    if (!CF_IS_OBJC(__kCFStringTypeID, string) && __CFStrIsEightBit(string)) {
+        contents = (const uint8_t *)__CFStrContents(string) + __CFStrSkipAnyLengthByte(string);
+    } else {
+        CFStringInitInlineBuffer(string, &buffer, CFRangeMake(0, rangeEnd));
+    }
+
+    if (NULL != delimiterSet) {
+        CFCharacterSetInlineBuffer csetBuffer;
+        CFCharacterSetInitInlineBuffer(delimiterSet, &csetBuffer);
+
+        if (NULL != contents) {
+            const uint8_t *p = contents + range.location, *end = contents + rangeEnd;
+
+            for (CFIndex byte = 0; byte < 256; byte++) {
+                table[byte] = CFCharacterSetInlineBufferIsLongCharacterMember(&csetBuffer, __CFCharToUniCharTable[byte]) ? 1 : 0;
+                if (table[byte]) members[memberCount++] = (uint8_t)byte;
+            }
+            while (!state.stop) {
+                const uint8_t *delimiter = __CFByteScanFindInTable(p, end, table, members, memberCount);
+                __CFStringReportField(&state, fieldStart, delimiter - contents);
+                if (delimiter == end) break;
+                p = delimiter + 1;
+                fieldStart = p - contents;
+            }
+        } else {
+            while (!state.stop) {
+                CFIndex delimiterLength = 0;
+                CFIndex delimiter = __CFStringFindDelimiterInSet(&buffer, &csetBuffer, fieldStart, rangeEnd, &delimiterLength);
+                __CFStringReportField(&state, fieldStart, delimiter);
+                if (delimiter == rangeEnd) break;
+                fieldStart = delimiter + delimiterLength;
+            }
+        }
     } else {
-        CFIndex idx;
-        CFIndex count = CFArrayGetCount(separatorRanges);
-        CFIndex startIndex = 0;
-        CFIndex numChars;
-        CFMutableArrayRef array = CFArrayCreateMutable(alloc, count + 2, & kCFTypeArrayCallBacks);
-        const CFRange *currentRange;
-        CFStringRef substring;
-
-        for (idx = 0;idx < count;idx++) {
-            currentRange = (const CFRange *)CFArrayGetValueAtIndex(separatorRanges, idx);
-            numChars = currentRange->location - startIndex;
-            substring = CFStringCreateWithSubstring(alloc, string, CFRangeMake(startIndex, numChars));
-            CFArrayAppendValue(array, substring);
-            CFRelease(substring);
-            startIndex = currentRange->location + currentRange->length;
+        CFIndex count = (NULL == delimiterStrings) ? 0 : CFArrayGetCount(delimiterStrings);
+        CFIndex numDelimiters = 0, totalLength = 0;
+        __CFStringFieldDelimiter *delimiters;
+        UniChar *characterStorage;
+        uint8_t *byteStorage;
+
+        for (CFIndex cnt = 0; cnt < count; cnt++) totalLength += CFStringGetLength((CFStringRef)CFArrayGetValueAtIndex(delimiterStrings, cnt));
+        delimiters = (__CFStringFieldDelimiter *)malloc(count * sizeof(__CFStringFieldDelimiter) + totalLength * (sizeof(UniChar) + sizeof(uint8_t)) + 1);
+        characterStorage = (UniChar *)(delimiters + count);
+        byteStorage = (uint8_t *)(characterStorage + totalLength);
+        memset(table, 0, sizeof(table));
+        for (CFIndex cnt = 0; cnt < count; cnt++) {
+            CFStringRef delimiterString = (CFStringRef)CFArrayGetValueAtIndex(delimiterStrings, cnt);
+            __CFStringFieldDelimiter *delimiter = &delimiters[numDelimiters];
+            CFIndex length = CFStringGetLength(delimiterString);
+            if (0 == length) continue;	// Empty delimiters never separate anything
+            delimiter->length = length;
+            delimiter->characters = characterStorage;
+            CFStringGetCharacters(delimiterString, CFRangeMake(0, length), delimiter->characters);
+            characterStorage += length;
+            delimiter->bytes = NULL;
+            if (NULL != contents) {
+                CFIndex usedLength = 0;
+                // Delimiters which the 8-bit encoding cannot represent can't occur in the string either
+                if (length == CFStringGetBytes(delimiterString, CFRangeMake(0, length), __CFStringGetEightBitStringEncoding(), 0, false, byteStorage, length, &usedLength) && usedLength == length) {
+                    delimiter->bytes = byteStorage;
+                    byteStorage += length;
+                    if (!table[delimiter->bytes[0]]) members[memberCount++] = delimiter->bytes[0];
+                    table[delimiter->bytes[0]] = 1;
+                }
+            }
+            numDelimiters++;
         }
-        substring = CFStringCreateWithSubstring(alloc, string, CFRangeMake(startIndex, length - startIndex));
-        CFArrayAppendValue(array, substring);
-        CFRelease(substring);
 
-	CFRelease(separatorRanges);
-        
-        return array;
+        if (NULL != contents) {
+            const uint8_t *p = contents + range.location, *end = contents + rangeEnd;
+            while (!state.stop) {
+                const uint8_t *candidate = p;
+                CFIndex matchLength = 0;
+                while ((candidate = __CFByteScanFindInTable(candidate, end, table, members, memberCount)) < end) {
+                    if ((matchLength = __CFStringMatchDelimiterBytes(candidate, end, delimiters, numDelimiters))) break;
+                    candidate++;
+                }
+                __CFStringReportField(&state, fieldStart, candidate - contents);
+                if (candidate == end) break;
+                p = candidate + matchLength;
+                fieldStart = p - contents;
+            }
+        } else {
+            CFIndex idx = fieldStart;
+            while (!state.stop) {
+                CFIndex matchLength = 0;
+                while (idx < rangeEnd && (0 == numDelimiters || 0 == (matchLength = __CFStringMatchDelimiters(&buffer, idx, rangeEnd, delimiters, numDelimiters)))) idx++;
+                __CFStringReportField(&state, fieldStart, idx);
+                if (idx == rangeEnd) break;
+                idx += matchLength;
+                fieldStart = idx;
+            }
+        }
+        free(delimiters);
+    }
+    return state.count;
+}
+
+typedef struct {
+    CFRange *fields;
+    CFIndex maxFields;
+    CFIndex count;
+} __CFStringFieldRangesContext;
+
+static Boolean __CFStringStoreFieldRange(CFStringRef string, CFRange field, void *context) {
+    __CFStringFieldRangesContext *rangesContext = (__CFStringFieldRangesContext *)context;
+    if (rangesContext->count < rangesContext->maxFields) rangesContext->fields[rangesContext->count] = field;
+    rangesContext->count++;
+    return true;
+}
+
+CFIndex _CFStringGetFieldRanges(CFStringRef string, CFRange range, CFCharacterSetRef delimiterSet, CFArrayRef delimiterStrings, CFRange *fields, CFIndex maxFields) {
+    __CFStringFieldRangesContext context = {fields, (NULL == fields) ? 0 : maxFields, 0};
+    return _CFStringEnumerateFields(string, range, delimiterSet, delimiterStrings, __CFStringStoreFieldRange, &context);
+}
+
+typedef struct {
+    CFAllocatorRef alloc;
+    CFMutableArrayRef array;
+    CFAllocatorRef parentAllocator;	// Keeps the parent alive for as long as a substring sharing its storage is
+    const uint8_t *bytes;
+    const UniChar *characters;
+} __CFStringFieldArrayContext;
+
+static Boolean __CFStringAppendField(CFStringRef string, CFRange field, void *context) {
+    __CFStringFieldArrayContext *arrayContext = (__CFStringFieldArrayContext *)context;
+    CFStringRef substring;
+    if (NULL != arrayContext->bytes) {
+        substring = CFStringCreateWithBytesNoCopy(arrayContext->alloc, arrayContext->bytes + field.location, field.length, __CFStringGetEightBitStringEncoding(), false, arrayContext->parentAllocator);
+    } else if (NULL != arrayContext->characters) {
+        substring = CFStringCreateWithCharactersNoCopy(arrayContext->alloc, arrayContext->characters + field.location, field.length, arrayContext->parentAllocator);
+    } else {
+        substring = CFStringCreateWithSubstring(arrayContext->alloc, string, field);
+    }
+    CFArrayAppendValue(arrayContext->array, substring);
+    CFRelease(substring);
+    return true;
+}
+
+CFArrayRef _CFStringCreateArrayOfFields(CFAllocatorRef alloc, CFStringRef string, CFRange range, CFCharacterSetRef delimiterSet, CFArrayRef delimiterStrings, Boolean shareStorage) {
+    __CFStringFieldArrayContext context = {alloc, CFArrayCreateMutable(alloc, 0, &kCFTypeArrayCallBacks), NULL, NULL, NULL};
+
+    // Only immutable CFStrings keep their storage where it is for their whole life
+    if (shareStorage && !CF_IS_OBJC(__kCFStringTypeID, string) && !__CFStrIsMutable(string)) {
+        CFAllocatorContext allocatorContext = {0, (void *)string, CFRetain, CFRelease, NULL, NULL, NULL, NULL, NULL};
+        context.parentAllocator = CFAllocatorCreate(kCFAllocatorSystemDefault, &allocatorContext);
+        if (__CFStrIsEightBit(string)) {
+            context.bytes = (const uint8_t *)__CFStrContents(string) + __CFStrSkipAnyLengthByte(string);
+        } else {
+            context.characters = (const UniChar *)__CFStrContents(string);
+        }
+    }
+    _CFStringEnumerateFields(string, range, delimiterSet, delimiterStrings, __CFStringAppendField, &context);
+    if (NULL != context.parentAllocator) CFRelease(context.parentAllocator);
+    return context.array;
+}
+
+CFArrayRef CFStringCreateArrayBySeparatingStrings(CFAllocatorRef alloc, CFStringRef string, CFStringRef separatorString) {
+    /* No objc dispatch needed here since _CFStringCreateArrayOfFields() works with both CFString and NSString */
+    CFArrayRef separators = CFArrayCreate(kCFAllocatorSystemDefault, (const void **)&separatorString, 1, &kCFTypeArrayCallBacks);
+    CFArrayRef array = _CFStringCreateArrayOfFields(alloc, string, CFRangeMake(0, CFStringGetLength(string)), NULL, separators, false);
+    CFRelease(separators);
+    if (1 == CFArrayGetCount(array)) {	// No separators in the string returns array with that string
+        CFRelease(array);
+        array = CFArrayCreate(alloc, (const void **)&string, 1, &kCFTypeArrayCallBacks);
     }
+    return array;
 }
 
 CFStringRef CFStringCreateFromExternalRepresentation(CFAllocatorRef alloc, CFDataRef data, CFStringEncoding encoding) {
@@ -4604,8 +4872,9 @@ void CFStringTrimWhitespace(CFMutableStringRef string) {
 
     CFStringInitInlineBuffer(string, &buffer, CFRangeMake(0, length));
     CFIndex buffer_idx = 0;
+    const _CFCharacterSetTable *table = _CFCharacterSetGetTable(CFCharacterSetGetPredefined(kCFCharacterSetWhitespaceAndNewline));
 
-    while (buffer_idx < length && CFUniCharIsMemberOf(__CFStringGetCharacterFromInlineBufferQuick(&buffer, buffer_idx), kCFUniCharWhitespaceAndNewlineCharacterSet))
+    while (buffer_idx < length && _CFCharacterSetTableIsMember(table, __CFStringGetCharacterFromInlineBufferQuick(&buffer, buffer_idx)))
         buffer_idx++;
     newStartIndex = buffer_idx;
 
@@ -4614,7 +4883,7 @@ void CFStringTrimWhitespace(CFMutableStringRef string) {
         CFIndex charSize = (__CFStrIsUnicode(string) ? sizeof(UniChar) : sizeof(uint8_t));
 
         buffer_idx = length - 1;
-        while (0 <= buffer_idx && CFUniCharIsMemberOf(__CFStringGetCharacterFromInlineBufferQuick(&buffer, buffer_idx), kCFUniCharWhitespaceAndNewlineCharacterSet))
+        while (0 <= buffer_idx && _CFCharacterSetTableIsMember(table, __CFStringGetCharacterFromInlineBufferQuick(&buffer, buffer_idx)))
             buffer_idx--;
         length = buffer_idx - newStartIndex + 1;
 
@@ -4625,6 +4894,54 @@ void CFStringTrimWhitespace(CFMutableStringRef string) {
     }
 }
 
+/* Case mapping within the 8-bit encoding
+
+ For every byte with the high bit set, the byte its lower and upper case mappings come out as, or -1 when the mapping is not a single character of the 8-bit encoding (or depends on context) and the string has to be converted to Unicode. ASCII bytes are mapped without looking at the tables.
+ */
+static int16_t __CFEightBitCaseTables[2][128];
+static CFStringEncoding __CFEightBitCaseTablesEncoding = kCFStringEncodingInvalidId;
+static CFLock_t __CFEightBitCaseTablesLock = CFLockInit;
+
+static void __CFStringMapEightBitCase(uint8_t *contents, CFIndex length, uint32_t type, CFIndex *currentIndex) {
+    CFStringEncoding eightBitEncoding = __CFStringGetEightBitStringEncoding();
+    CFIndex tableIndex = ((kCFUniCharToLowercase == type) ? 0 : 1);
+    const int16_t *table;
+
+    __CFLock(&__CFEightBitCaseTablesLock);
+    if (__CFEightBitCaseTablesEncoding != eightBitEncoding) {
+        UniChar mappedCharacters[MAX_CASE_MAPPING_BUF];
+        for (CFIndex byte = 0x80; byte < 0x100; byte++) {
+            UniChar character = __CFCharToUniCharTable[byte];
+            for (CFIndex idx = 0; idx < 2; idx++) {
+                CFIndex mappedLength = ((0x03A3 == character) ? 0 : CFUniCharMapCaseTo(character, mappedCharacters, MAX_CASE_MAPPING_BUF, (0 == idx) ? kCFUniCharToLowercase : kCFUniCharToUppercase, 0, NULL));
+                int16_t mapped = -1;
+                if ((1 == mappedLength) && (mappedCharacters[0] == character)) {
+                    mapped = (int16_t)byte;
+                } else if (1 == mappedLength) {
+                    for (CFIndex other = 0; other < 0x100; other++) {
+                        if (__CFCharToUniCharTable[other] == mappedCharacters[0]) {
+                            mapped = (int16_t)other;
+                            break;
+                        }
+                    }
+                }
+                __CFEightBitCaseTables[idx][byte - 0x80] = mapped;
+            }
+        }
+        __CFEightBitCaseTablesEncoding = eightBitEncoding;
+    }
+    table = __CFEightBitCaseTables[tableIndex];
+    __CFUnlock(&__CFEightBitCaseTablesLock);
+
+    // Maps ASCII runs 16 bytes at a time and everything else through the table, up to the first byte which needs Unicode
+    while (*currentIndex < length) {
+        *currentIndex = __CFByteScanMapASCIICase(contents + *currentIndex, contents + length, (0 != tableIndex)) - contents;
+        if (*currentIndex == length || table[contents[*currentIndex] - 0x80] < 0) break;
+        contents[*currentIndex] = (uint8_t)table[contents[*currentIndex] - 0x80];
+        ++(*currentIndex);
+    }
+}
+
 void CFStringLowercase(CFMutableStringRef string, CFLocaleRef locale) {
     CFIndex currentIndex = 0;
     CFIndex length;
@@ -4640,14 +4957,7 @@ void CFStringLowercase(CFMutableStringRef string, CFLocaleRef locale) {
     langCode = (const uint8_t *)(_CFCanUseLocale(locale) ? _CFStrGetLanguageIdentifierForLocale(locale, false) : NULL);
 
     if (!langCode && isEightBit) {
-        uint8_t *contents = (uint8_t *)__CFStrContents(string) + __CFStrSkipAnyLengthByte(string);
-        for (;currentIndex < length;currentIndex++) {
-            if (contents[currentIndex] >= 'A' && contents[currentIndex] <= 'Z') {
-                contents[currentIndex] += 'a' - 'A';
-            } else if (contents[currentIndex] > 127) {
-                break;
-            }
-        }
+        __CFStringMapEightBitCase((uint8_t *)__CFStrContents(string) + __CFStrSkipAnyLengthByte(string), length, kCFUniCharToLowercase, &currentIndex);
     }
 
     if (currentIndex < length) {
@@ -4731,14 +5041,7 @@ void CFStringUppercase(CFMutableStringRef string, CFLocaleRef locale) {
     langCode = (const uint8_t *)(_CFCanUseLocale(locale) ? _CFStrGetLanguageIdentifierForLocale(locale, false) : NULL);
 
     if (!langCode && isEightBit) {
-        uint8_t *contents = (uint8_t *)__CFStrContents(string) + __CFStrSkipAnyLengthByte(string);
-        for (;currentIndex < length;currentIndex++) {
-            if (contents[currentIndex] >= 'a' && contents[currentIndex] <= 'z') {
-                contents[currentIndex] -= 'a' - 'A';
-            } else if (contents[currentIndex] > 127) {
-                break;
-            }
-        }
+        __CFStringMapEightBitCase((uint8_t *)__CFStrContents(string) + __CFStrSkipAnyLengthByte(string), length, kCFUniCharToUppercase, &currentIndex);
     }
 
     if (currentIndex < length) {
@@ -4954,6 +5257,8 @@ void CFStringNormalize(CFMutableStringRef string, CFStringNormalizationForm theF
     CFIndex currentIndex = 0;
     CFIndex length;
     bool needToReorder = true;
+    // Nothing below this decomposes, combines or composes in theForm
+    UniChar quickCheckLimit = ((theForm & kCFStringNormalizationFormKD) ? 0x00A0 : 0x00C0);
 
     CF_OBJC_FUNCDISPATCHV(__kCFStringTypeID, void, (NSMutableString *)string, _cfNormalize:theForm);
 
@@ -4968,12 +5273,13 @@ void CFStringNormalize(CFMutableStringRef string, CFStringNormalizationForm theF
 
         contents = (uint8_t *)__CFStrContents(string) + __CFStrSkipAnyLengthByte(string);
 
-        for (;currentIndex < length;currentIndex++) {
-            if (contents[currentIndex] > 127) {
+        while ((currentIndex = __CFByteScanFindNonASCII(contents + currentIndex, contents + length) - contents) < length) {
+            if (__CFCharToUniCharTable[contents[currentIndex]] >= quickCheckLimit) {
                 __CFStringChangeSize(string, CFRangeMake(0, 0), 0, true); // need to do harm way
                 needToReorder = false;
                 break;
             }
+            ++currentIndex;
         }
     }
 
@@ -4991,6 +5297,13 @@ void CFStringNormalize(CFMutableStringRef string, CFStringNormalizationForm theF
         const uint8_t *combiningBMP = (const uint8_t *)CFUniCharGetUnicodePropertyDataForPlane(kCFUniCharCombiningProperty, 0);
 
         while (contents < limit) {
+            if ((contents + 1 < limit) && (*contents < quickCheckLimit) && (*(contents + 1) < quickCheckLimit)) { // Skip the run that is already normalized
+                // The run's last character is left for the code below, which looks at its neighbors
+                UTF16Char *runLast = (UTF16Char *)__CFByteScanFindUTF16AtLeast(contents + 1, limit, quickCheckLimit) - 1;
+                currentIndex += runLast - contents;
+                contents = runLast;
+            }
+
             if (CFUniCharIsSurrogateHighCharacter(*contents) && (contents + 1 < limit) && CFUniCharIsSurrogateLowCharacter(*(contents + 1))) {
                 currentChar = CFUniCharGetLongCharacterForSurrogatePair(*contents, *(contents + 1));
                 currentLength = 2;
@@ -5290,6 +5603,11 @@ void CFStringFold(CFMutableStringRef theString, CFStringCompareFlags theFlags, C
         uint8_t *cStringContents = (isObjc ? NULL : (uint8_t *)__CFStrContents(theString) + __CFStrSkipAnyLengthByte(theString));
         
         while (cStringPtr < cStringLimit) {
+            if ((NULL != cStringContents) && (NULL == langCode)) {	// Skip or fold the ASCII run in one go
+                uint8_t *run = cStringContents + (cStringPtr - cString);
+                cStringPtr += (caseInsensitive ? __CFByteScanMapASCIICase(run, cStringContents + length, false) : __CFByteScanFindNonASCII(run, cStringContents + length)) - run;
+                if (cStringPtr == cStringLimit) break;
+            }
             if ((*cStringPtr < 0x80) && (NULL == langCode)) {
                 if (caseInsensitive && (*cStringPtr >= 'A') && (*cStringPtr <= 'Z')) {
                     if (NULL == cStringContents) {
@@ -5937,6 +6255,110 @@ void _CFStringAppendFormatAndArgumentsAux(CFMutableStringRef outputString, CFStr
     _CFStringAppendFormatAndArgumentsAux2(outputString, copyDescFunc, NULL, formatOptions, formatString, args);
 }
     
+/* Compiled formats
+
+ Most formats are constant strings used over and over, so their parsed specs are kept in a small direct-mapped cache keyed by the string, and parsing is skipped when the same constant format comes back. Only 8-bit formats with few enough specs to fit the on-stack spec buffer are kept. Each entry also keeps a copy of the characters, which is compared on every hit: a constant string in an image that was unloaded can have its address reused by a different one.
+ */
+#define COMPILED_FORMAT_CACHE_SIZE 256
+#define COMPILED_FORMAT_LOCKS 16
+
+typedef struct {
+    CFStringRef format;
+    CFIndex length;
+    SInt32 numSpecs;
+    SInt32 sizeSpecs;
+    uint8_t *characters;
+    CFFormatSpec *specs;
+} __CFCompiledFormat;
+
+static __CFCompiledFormat __CFCompiledFormats[COMPILED_FORMAT_CACHE_SIZE];
+static CFLock_t __CFCompiledFormatLocks[COMPILED_FORMAT_LOCKS];
+
+static void __CFCompiledFormatInitialize(void) {
+    static dispatch_once_t initOnce;
+    dispatch_once(&initOnce, ^{
+        for (CFIndex idx = 0; idx < COMPILED_FORMAT_LOCKS; idx++) __CFCompiledFormatLocks[idx] = CFLockInit;
+    });
+}
+
+CF_INLINE CFIndex __CFCompiledFormatSlot(CFStringRef format) {
+    uintptr_t key = (uintptr_t)format;
+    return (CFIndex)((key >> 4) ^ (key >> 12)) % COMPILED_FORMAT_CACHE_SIZE;
+}
+
+// Copies the cached specs for format into specs, which has room for maxSpecs, and returns true on a hit
+static Boolean __CFStringGetCompiledFormat(CFStringRef format, const uint8_t *cformat, CFIndex length, CFFormatSpec *specs, SInt32 maxSpecs, SInt32 *numSpecs, SInt32 *sizeSpecs) {
+    CFIndex slot = __CFCompiledFormatSlot(format);
+    __CFCompiledFormat *entry = &__CFCompiledFormats[slot];
+    Boolean found = false;
+    __CFCompiledFormatInitialize();
+    __CFLock(&__CFCompiledFormatLocks[slot % COMPILED_FORMAT_LOCKS]);
+    if (entry->format == format && entry->length == length && entry->numSpecs <= maxSpecs && memcmp(entry->characters, cformat, length) == 0) {
+        memmove(specs, entry->specs, entry->numSpecs * sizeof(CFFormatSpec));
+        *numSpecs = entry->numSpecs;
+        *sizeSpecs = entry->sizeSpecs;
+        found = true;
+    }
+    __CFUnlock(&__CFCompiledFormatLocks[slot % COMPILED_FORMAT_LOCKS]);
+    return found;
+}
+
+static void __CFStringSetCompiledFormat(CFStringRef format, const uint8_t *cformat, CFIndex length, const CFFormatSpec *specs, SInt32 numSpecs, SInt32 sizeSpecs) {
+    CFIndex slot = __CFCompiledFormatSlot(format);
+    __CFCompiledFormat *entry = &__CFCompiledFormats[slot];
+    // One block holds the specs followed by the characters
+    uint8_t *block = (uint8_t *)malloc(numSpecs * sizeof(CFFormatSpec) + length);
+    if (!block) return;
+    memmove(block, specs, numSpecs * sizeof(CFFormatSpec));
+    memmove(block + numSpecs * sizeof(CFFormatSpec), cformat, length);
+    __CFCompiledFormatInitialize();
+    __CFLock(&__CFCompiledFormatLocks[slot % COMPILED_FORMAT_LOCKS]);
+    uint8_t *oldBlock = (uint8_t *)entry->specs;
+    entry->format = format;
+    entry->length = length;
+    entry->numSpecs = numSpecs;
+    entry->sizeSpecs = sizeSpecs;
+    entry->specs = (CFFormatSpec *)block;
+    entry->characters = block + numSpecs * sizeof(CFFormatSpec);
+    __CFUnlock(&__CFCompiledFormatLocks[slot % COMPILED_FORMAT_LOCKS]);
+    free(oldBlock);
+}
+
+// Appends a plain %d, %i or %u the way snprintf() would, without going through it
+static void __CFStringAppendDecimal(CFMutableStringRef outputString, int64_t value, int16_t size, Boolean isUnsigned) {
+    char digits[24];
+    char *end = digits + sizeof(digits), *p = end;
+    uint64_t magnitude;
+    Boolean negative = false;
+    if (CFFormatSize8 == size) {
+        if (isUnsigned || value >= 0) magnitude = (uint64_t)value; else { magnitude = -(uint64_t)value; negative = true; }
+    } else {
+        SInt32 value32 = (SInt32)value;
+        if (isUnsigned) magnitude = (uint32_t)value32; else if (value32 >= 0) magnitude = (uint64_t)value32; else { magnitude = -(uint64_t)(int64_t)value32; negative = true; }
+    }
+    do {
+        *--p = '0' + (char)(magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (negative) *--p = '-';
+    __CFStringAppendBytes(outputString, p, end - p, kCFStringEncodingASCII);
+}
+
+// True for specs spelled as nothing more than %d, %i or %u with an optional position and length modifier
+static Boolean __CFFormatSpecIsPlainDecimal(const UniChar *uformat, const uint8_t *cformat, const CFFormatSpec *spec, Boolean *isUnsigned) {
+    if (CFFormatLongType != spec->type || (spec->flags & ~kCFStringFormatLocalizable) || -1 != spec->widthArg || -1 != spec->precArg || -1 != spec->widthArgNum || -1 != spec->precArgNum) return false;
+    if (CFFormatDefaultSize != spec->size && CFFormatSize4 != spec->size && CFFormatSize8 != spec->size) return false;
+    for (SInt32 idx = 1; idx < spec->len; idx++) {
+        UniChar ch = cformat ? (UniChar)cformat[spec->loc + idx] : uformat[spec->loc + idx];
+        if (idx == spec->len - 1) {
+            *isUnsigned = ('u' == ch);
+            return ('d' == ch || 'i' == ch || 'u' == ch);
+        }
+        if (!(('0' <= ch && ch <= '9') || '$' == ch || 'l' == ch || 'q' == ch || 'j' == ch || 'z' == ch || 't' == ch)) return false;
+    }
+    return false;
+}
+
 static void __CFStringAppendFormatCore(CFMutableStringRef outputString, CFStringRef (*copyDescFunc)(void *, const void *), CFStringRef (*contextDescFunc)(void *, const void *, const void *, bool, bool *), CFDictionaryRef formatOptions, CFDictionaryRef stringsDictConfig, CFStringRef formatString, CFIndex initialArgPosition, const void *origValues, CFIndex originalValuesSize, va_list args) {
     SInt32 numSpecs, sizeSpecs, sizeArgNum, formatIdx, curSpec, argNum;
     CFIndex formatLen;
@@ -5984,8 +6406,14 @@ static void __CFStringAppendFormatCore(CFMutableStringRef outputString, CFString
         uformat = formatChars;
     }
 
+    /* Constant formats seen before come with their specs already parsed */
+    Boolean isCompilableFormat = (cformat && !CF_IS_OBJC(__kCFStringTypeID, formatString) && __CFStrIsConstant(formatString));
+    Boolean isCompiledFormat = (isCompilableFormat && __CFStringGetCompiledFormat(formatString, cformat, formatLen, localSpecsBuffer, VPRINTF_BUFFER_LEN, &numSpecs, &sizeSpecs));
+
     /* Compute an upper bound for the number of format specifications */
-    if (cformat) {
+    if (isCompiledFormat) {
+        // sizeSpecs came with the specs
+    } else if (cformat) {
         for (formatIdx = 0; formatIdx < formatLen; formatIdx++) if ('%' == cformat[formatIdx]) sizeSpecs++;
     } else {
         for (formatIdx = 0; formatIdx < formatLen; formatIdx++) if ('%' == uformat[formatIdx]) sizeSpecs++;
@@ -5996,45 +6424,48 @@ static void __CFStringAppendFormatCore(CFMutableStringRef outputString, CFString
 
     configs = ((sizeSpecs < VPRINTF_BUFFER_LEN) ? localConfigs : (CFDictionaryRef *)CFAllocatorAllocate(tmpAlloc, sizeof(CFStringRef) * sizeSpecs, 0));
 
-    /* Collect format specification information from the format string */
-    for (curSpec = 0, formatIdx = 0; formatIdx < formatLen; curSpec++) {
-	SInt32 newFmtIdx;
-	specs[curSpec].loc = formatIdx;
-	specs[curSpec].len = 0;
-	specs[curSpec].size = 0;
-	specs[curSpec].type = 0;
-	specs[curSpec].flags = 0;
-	specs[curSpec].widthArg = -1;
-	specs[curSpec].precArg = -1;
-	specs[curSpec].mainArgNum = -1;
-	specs[curSpec].precArgNum = -1;
-	specs[curSpec].widthArgNum = -1;
-	specs[curSpec].configDictIndex = -1;
-        if (cformat) {
-            for (newFmtIdx = formatIdx; newFmtIdx < formatLen && '%' != cformat[newFmtIdx]; newFmtIdx++);
-        } else {
-            for (newFmtIdx = formatIdx; newFmtIdx < formatLen && '%' != uformat[newFmtIdx]; newFmtIdx++);
-        }
-	if (newFmtIdx != formatIdx) {	/* Literal chunk */
-	    specs[curSpec].type = CFFormatLiteralType;
-	    specs[curSpec].len = newFmtIdx - formatIdx;
-	} else {
-	    CFStringRef configKey = NULL;
-	    newFmtIdx++;	/* Skip % */
-	    __CFParseFormatSpec(uformat, cformat, &newFmtIdx, formatLen, &(specs[curSpec]), &configKey);
-            if (CFFormatLiteralType == specs[curSpec].type) {
-		specs[curSpec].loc = formatIdx + 1;
-		specs[curSpec].len = 1;
-	    } else {
+    if (!isCompiledFormat) {
+        /* Collect format specification information from the format string */
+        for (curSpec = 0, formatIdx = 0; formatIdx < formatLen; curSpec++) {
+	    SInt32 newFmtIdx;
+	    specs[curSpec].loc = formatIdx;
+	    specs[curSpec].len = 0;
+	    specs[curSpec].size = 0;
+	    specs[curSpec].type = 0;
+	    specs[curSpec].flags = 0;
+	    specs[curSpec].widthArg = -1;
+	    specs[curSpec].precArg = -1;
+	    specs[curSpec].mainArgNum = -1;
+	    specs[curSpec].precArgNum = -1;
+	    specs[curSpec].widthArgNum = -1;
+	    specs[curSpec].configDictIndex = -1;
+            if (cformat) {
+                for (newFmtIdx = formatIdx; newFmtIdx < formatLen && '%' != cformat[newFmtIdx]; newFmtIdx++);
+            } else {
+                for (newFmtIdx = formatIdx; newFmtIdx < formatLen && '%' != uformat[newFmtIdx]; newFmtIdx++);
+            }
+	    if (newFmtIdx != formatIdx) {	/* Literal chunk */
+		specs[curSpec].type = CFFormatLiteralType;
 		specs[curSpec].len = newFmtIdx - formatIdx;
+	    } else {
+		CFStringRef configKey = NULL;
+		newFmtIdx++;	/* Skip % */
+		__CFParseFormatSpec(uformat, cformat, &newFmtIdx, formatLen, &(specs[curSpec]), &configKey);
+                if (CFFormatLiteralType == specs[curSpec].type) {
+		    specs[curSpec].loc = formatIdx + 1;
+		    specs[curSpec].len = 1;
+		} else {
+		    specs[curSpec].len = newFmtIdx - formatIdx;
+		}
 	    }
-	}
-	formatIdx = newFmtIdx;
+	    formatIdx = newFmtIdx;
 
-// fprintf(stderr, "specs[%d] = {\n  size = %d,\n  type = %d,\n  loc = %d,\n  len = %d,\n  mainArgNum = %d,\n  precArgNum = %d,\n  widthArgNum = %d\n}\n", curSpec, specs[curSpec].size, specs[curSpec].type, specs[curSpec].loc, specs[curSpec].len, specs[curSpec].mainArgNum, specs[curSpec].precArgNum, specs[curSpec].widthArgNum);
+    // fprintf(stderr, "specs[%d] = {\n  size = %d,\n  type = %d,\n  loc = %d,\n  len = %d,\n  mainArgNum = %d,\n  precArgNum = %d,\n  widthArgNum = %d\n}\n", curSpec, specs[curSpec].size, specs[curSpec].type, specs[curSpec].loc, specs[curSpec].len, specs[curSpec].mainArgNum, specs[curSpec].precArgNum, specs[curSpec].widthArgNum);
 
+        }
+        numSpecs = curSpec;
+        if (isCompilableFormat && specs == localSpecsBuffer) __CFStringSetCompiledFormat(formatString, cformat, formatLen, specs, numSpecs, sizeSpecs);
     }
-    numSpecs = curSpec;
 
     // Max of three args per spec, reasoning thus: 1 width, 1 prec, 1 value
     sizeArgNum = ((NULL == originalValues) ? (3 * sizeSpecs + 1) : originalValuesSize);
@@ -6186,6 +6617,13 @@ static void __CFStringAppendFormatCore(CFMutableStringRef outputString, CFString
             }
             /* Otherwise fall-thru to the next case! */
 #endif
+            if (CFFormatLongType == specs[curSpec].type) {
+                Boolean isUnsigned = false;
+                if (__CFFormatSpecIsPlainDecimal(uformat, cformat, &specs[curSpec], &isUnsigned)) {
+                    __CFStringAppendDecimal(outputString, values[specs[curSpec].mainArgNum].value.int64Value, specs[curSpec].size, isUnsigned);
+                    break;
+                }
+            }
          case CFFormatPointerType: {
                 char formatBuffer[128];
 #if defined(__GNUC__)
@@ -8,6 +8,9 @@
 #include "CFBase.h"
 #include "CFRuntime.h"
 #include "CFStringTokenizer.h"
+#include "CFInternal.h"
+#include "CFByteScan.h"
+#include <CoreFoundation/CFPriv.h>
 #include <unicode/ubrk.h>
 
 #define TYPE_MASK 0x000000FF
@@ -18,7 +21,13 @@ struct __CFStringTokenizer {
     CFRange _range;
     CFOptionFlags _options;
     CFLocaleRef _locale;
+    CFStringRef _localeName; // the locale ICU was opened with
     UBreakIterator *_break_itr;
+    UniChar *_text; // the break iterator works on this copy of _string's characters
+    CFIndex _textLength;
+    CFIndex _textCapacity;
+    Boolean _isASCII;
+    Boolean _hasRootWordRules; // ICU picked the root break rules for _localeName, which are the ones the ASCII word scanner follows
 };
 
 static void __CFStringTokenizerDeallocate(CFTypeRef cf) {
@@ -31,9 +40,17 @@ static void __CFStringTokenizerDeallocate(CFTypeRef cf) {
         CFRelease(tokenizer->_locale);
     }
 
+    if (tokenizer->_localeName) {
+        CFRelease(tokenizer->_localeName);
+    }
+
     if (tokenizer->_break_itr) {
         ubrk_close(tokenizer->_break_itr);
     }
+
+    if (tokenizer->_text) {
+        free(tokenizer->_text);
+    }
 }
 
 
@@ -65,6 +82,23 @@ CFTypeID CFStringTokenizerGetTypeID(void) {
 
 #define BUFFER_SIZE 768
 
+// Copies the characters of string into the tokenizer's text buffer; ICU does not copy the text it is given, so the buffer has to live as long as the break iterator uses it.
+static Boolean __CFStringTokenizerCopyText(struct __CFStringTokenizer *tokenizer, CFStringRef string) {
+    CFIndex len = CFStringGetLength(string);
+    if (len > tokenizer->_textCapacity || tokenizer->_text == NULL) {
+        UniChar *text = realloc(tokenizer->_text, (len ? len : 1) * sizeof(UniChar));
+        if (text == NULL) {
+            return false;
+        }
+        tokenizer->_text = text;
+        tokenizer->_textCapacity = len ? len : 1;
+    }
+    CFStringGetCharacters(string, CFRangeMake(0, len), tokenizer->_text);
+    tokenizer->_textLength = len;
+    tokenizer->_isASCII = (__CFByteScanFindUTF16AtLeast(tokenizer->_text, tokenizer->_text + len, 0x80) == tokenizer->_text + len);
+    return true;
+}
+
 CFStringTokenizerRef CFStringTokenizerCreate(CFAllocatorRef allocator, CFStringRef string, CFRange range, CFOptionFlags options, CFLocaleRef locale) {
     CFIndex size = sizeof(struct __CFStringTokenizer) - sizeof(CFRuntimeBase);
     struct __CFStringTokenizer *tokenizer = (struct __CFStringTokenizer *)_CFRuntimeCreateInstance(allocator, CFStringTokenizerGetTypeID(), size, NULL);
@@ -91,6 +125,7 @@ CFStringTokenizerRef CFStringTokenizerCreate(CFAllocatorRef allocator, CFStringR
         CFRelease((CFTypeRef)tokenizer);
         return NULL;
     }
+    tokenizer->_localeName = CFStringCreateCopy(allocator, localeName);
 
     UBreakIteratorType type;
     // UBRK_CHARACTER, UBRK_WORD, UBRK_LINE, UBRK_SENTENCE
@@ -108,28 +143,22 @@ CFStringTokenizerRef CFStringTokenizerCreate(CFAllocatorRef allocator, CFStringR
             break;
     }
 
-    UChar stack_text[BUFFER_SIZE] = {0};
-    UChar *text = &stack_text[0];
-    CFIndex len = CFStringGetLength(string);
-    if (len > BUFFER_SIZE) {
-        text = malloc(len * sizeof(UChar));
-        if (text == NULL) {
-            CFRelease(tokenizer);
-            return NULL;
-        }
+    if (!__CFStringTokenizerCopyText(tokenizer, string)) {
+        CFRelease(tokenizer);
+        return NULL;
     }
-    CFStringGetCharacters(string, CFRangeMake(0, len), (UniChar *)text);
     UErrorCode err = 0;
-    tokenizer->_break_itr = ubrk_open(type, cstr, text, len, &err);
-    if (text != &stack_text[0]) {
-        free(text);
-    }
+    tokenizer->_break_itr = ubrk_open(type, cstr, (const UChar *)tokenizer->_text, tokenizer->_textLength, &err);
 
     if (tokenizer->_break_itr == NULL) {
         CFRelease(tokenizer);
         return NULL;
     }
 
+    // Some locales (sv, fi, en_US_POSIX, ...) tailor the word rules, so the data ICU actually loaded decides whether the ASCII scanner may stand in for it
+    const char *actual = ubrk_getLocale(tokenizer->_break_itr, ULOC_ACTUAL_LOCALE, &err);
+    tokenizer->_hasRootWordRules = U_SUCCESS(err) && actual && (actual[0] == '\0' || strcmp(actual, "root") == 0);
+
     return tokenizer;
 }
 
@@ -142,23 +171,19 @@ CFStringRef CFStringTokenizerCopyBestStringLanguage(CFStringRef string, CFRange
 
 void CFStringTokenizerSetString(CFStringTokenizerRef tokenizer, CFStringRef string, CFRange range) {
 
-#warning TODO: range is not handled currently
+#warning TODO: range is not handled currently by the one-token-at-a-time functions
 
-    UChar stack_text[BUFFER_SIZE] = { 0 };
-    UChar *text = &stack_text[0];
-    CFIndex len = CFStringGetLength(string);
-    if (len > BUFFER_SIZE) {
-        text = malloc(len * sizeof(UChar));
-        if (text == NULL) {
-            return;
-        }
+    CFStringRef copy = CFStringCreateCopy(CFGetAllocator(tokenizer), string);
+    if (tokenizer->_string) {
+        CFRelease(tokenizer->_string);
+    }
+    tokenizer->_string = copy;
+    tokenizer->_range = range;
+    if (!__CFStringTokenizerCopyText(tokenizer, string)) {
+        tokenizer->_textLength = 0;
     }
-    CFStringGetCharacters(string, CFRangeMake(0, len), (UniChar *)text);
     UErrorCode err = 0;
-    ubrk_setText(tokenizer->_break_itr, text, len, &err);
-    if (text != &stack_text[0]) {
-        free(text);
-    }  
+    ubrk_setText(tokenizer->_break_itr, (const UChar *)tokenizer->_text, tokenizer->_textLength, &err);
 }
 
 CFStringTokenizerTokenType CFStringTokenizerGoToTokenAtIndex(CFStringTokenizerRef tokenizer, CFIndex index) {
@@ -197,3 +222,226 @@ CFIndex CFStringTokenizerGetCurrentSubTokens(CFStringTokenizerRef tokenizer, CFR
 }
 */
 
+
+/* Bulk tokenizing */
+
+// Token attributes worked out from the characters of a word token, as the one-token-at-a-time API would report them
+static CFStringTokenizerTokenType __CFStringTokenizerGetWordTokenType(const UniChar *characters, CFIndex length, int32_t status) {
+    CFCharacterSetRef letters = NULL;
+    CFCharacterSetRef digits = NULL;
+    CFStringTokenizerTokenType type = kCFStringTokenizerTokenNormal;
+
+    if (status >= UBRK_WORD_KANA && status < UBRK_WORD_IDEO_LIMIT) {
+        type |= kCFStringTokenizerTokenIsCJWordMask;
+    }
+    for (CFIndex idx = 0; idx < length; idx++) {
+        UniChar ch = characters[idx];
+        if (ch < 0x80) {
+            if (ch >= '0' && ch <= '9') {
+                type |= kCFStringTokenizerTokenHasHasNumbersMask | kCFStringTokenizerTokenHasNonLettersMask;
+            } else if (!((ch | 0x20) >= 'a' && (ch | 0x20) <= 'z')) {
+                type |= kCFStringTokenizerTokenHasNonLettersMask;
+            }
+        } else {
+            if (letters == NULL) {
+                letters = CFCharacterSetGetPredefined(kCFCharacterSetLetter);
+                digits = CFCharacterSetGetPredefined(kCFCharacterSetDecimalDigit);
+            }
+            if (CFCharacterSetIsCharacterMember(digits, ch)) {
+                type |= kCFStringTokenizerTokenHasHasNumbersMask | kCFStringTokenizerTokenHasNonLettersMask;
+            } else if (!CFCharacterSetIsCharacterMember(letters, ch)) {
+                type |= kCFStringTokenizerTokenHasNonLettersMask;
+            }
+        }
+    }
+    return type;
+}
+
+static CFIndex __CFStringTokenizerGetICUTokens(struct __CFStringTokenizer *tokenizer, CFIndex index, CFIndex end, CFRange *ranges, CFStringTokenizerTokenType *types, CFIndex maxCount) {
+    UBreakIterator *itr = tokenizer->_break_itr;
+    CFOptionFlags unit = tokenizer->_options & TYPE_MASK;
+    Boolean words = (unit == kCFStringTokenizerUnitWord || unit == kCFStringTokenizerUnitWordBoundary);
+    CFIndex count = 0;
+    int32_t prev, next;
+
+    ubrk_isBoundary(itr, (int32_t)index); // leaves the iterator at the first boundary at or after index
+    prev = ubrk_current(itr);
+    while (count < maxCount && prev < end && (next = ubrk_next(itr)) != UBRK_DONE) {
+        int32_t status = ubrk_getRuleStatus(itr);
+        // Words only; the spaces and punctuation in between are tokens of kCFStringTokenizerUnitWordBoundary
+        if (unit != kCFStringTokenizerUnitWord || status >= UBRK_WORD_NONE_LIMIT) {
+            CFIndex tokenEnd = next < end ? next : end;
+            ranges[count] = CFRangeMake(prev, tokenEnd - prev);
+            if (types) {
+                types[count] = words ? __CFStringTokenizerGetWordTokenType(tokenizer->_text + prev, tokenEnd - prev, status) : kCFStringTokenizerTokenNormal;
+            }
+            count++;
+        }
+        prev = next;
+    }
+    return count;
+}
+
+/*
+ Word tokens of ASCII text without ICU. These are the UAX #29 rules as they apply to ASCII: letters,
+ digits and '_' run together; '.' and '\'' join letters to letters and digits to digits, ',' and ';'
+ only digits to digits. Everything else, ':' included as in ICU's default rules, ends a word.
+ */
+enum {
+    __kCFTokenizerASCIIOther = 0,
+    __kCFTokenizerASCIILetter,
+    __kCFTokenizerASCIIDigit,
+    __kCFTokenizerASCIIExtendNumLet,
+    __kCFTokenizerASCIIMidNumLet,
+    __kCFTokenizerASCIIMidNum
+};
+
+CF_INLINE uint8_t __CFStringTokenizerASCIIClass(UniChar ch) {
+    if ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'z') return __kCFTokenizerASCIILetter;
+    if (ch >= '0' && ch <= '9') return __kCFTokenizerASCIIDigit;
+    switch (ch) {
+        case '_': return __kCFTokenizerASCIIExtendNumLet;
+        case '.': case '\'': return __kCFTokenizerASCIIMidNumLet;
+        case ',': case ';': return __kCFTokenizerASCIIMidNum;
+        default: return __kCFTokenizerASCIIOther;
+    }
+}
+
+static CFIndex __CFStringTokenizerGetASCIIWordTokens(struct __CFStringTokenizer *tokenizer, CFIndex index, CFIndex end, CFRange *ranges, CFStringTokenizerTokenType *types, CFIndex maxCount) {
+    const UniChar *text = tokenizer->_text;
+    CFIndex length = tokenizer->_textLength;
+    CFIndex count = 0;
+    CFIndex idx = index;
+
+    // A word never spans an "other" character, so scanning from just after one sees the same words ICU would; words starting before index are then dropped
+    while (idx > 0 && __CFStringTokenizerASCIIClass(text[idx - 1]) != __kCFTokenizerASCIIOther) idx--;
+
+    while (count < maxCount && idx < end) {
+        uint8_t cls = __CFStringTokenizerASCIIClass(text[idx]);
+        if (cls != __kCFTokenizerASCIILetter && cls != __kCFTokenizerASCIIDigit && cls != __kCFTokenizerASCIIExtendNumLet) {
+            idx++;
+            continue;
+        }
+
+        CFIndex start = idx;
+        Boolean hasLetters = (cls == __kCFTokenizerASCIILetter), hasDigits = (cls == __kCFTokenizerASCIIDigit), hasNonLetters = (cls != __kCFTokenizerASCIILetter);
+        uint8_t prev = cls;
+        idx++;
+        while (idx < length) {
+            cls = __CFStringTokenizerASCIIClass(text[idx]);
+            if (cls == __kCFTokenizerASCIILetter || cls == __kCFTokenizerASCIIDigit || cls == __kCFTokenizerASCIIExtendNumLet) {
+                idx++;
+            } else if ((cls == __kCFTokenizerASCIIMidNumLet || cls == __kCFTokenizerASCIIMidNum) && idx + 1 < length && (prev == __kCFTokenizerASCIILetter || prev == __kCFTokenizerASCIIDigit) && __CFStringTokenizerASCIIClass(text[idx + 1]) == prev && (cls == __kCFTokenizerASCIIMidNumLet || prev == __kCFTokenizerASCIIDigit)) {
+                hasNonLetters = true;
+                cls = prev;
+                idx += 2;
+            } else {
+                break;
+            }
+            hasLetters |= (cls == __kCFTokenizerASCIILetter);
+            hasDigits |= (cls == __kCFTokenizerASCIIDigit);
+            hasNonLetters |= (cls != __kCFTokenizerASCIILetter);
+            prev = cls;
+        }
+
+        // A lone '_' is not a word, though a run of them is
+        if (start >= index && (hasLetters || hasDigits || idx - start > 1)) {
+            CFIndex tokenEnd = idx < end ? idx : end;
+            ranges[count] = CFRangeMake(start, tokenEnd - start);
+            if (types) {
+                types[count] = kCFStringTokenizerTokenNormal | (hasDigits ? kCFStringTokenizerTokenHasHasNumbersMask : 0) | (hasNonLetters ? kCFStringTokenizerTokenHasNonLettersMask : 0);
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+CFIndex _CFStringTokenizerGetTokens(CFStringTokenizerRef tokenizer, CFIndex index, CFRange *ranges, CFStringTokenizerTokenType *types, CFIndex maxCount) {
+    CFIndex end = tokenizer->_range.location + tokenizer->_range.length;
+
+    if (end > tokenizer->_textLength) {
+        end = tokenizer->_textLength;
+    }
+    if (index < tokenizer->_range.location) {
+        index = tokenizer->_range.location;
+    }
+    if (index >= end || maxCount <= 0) {
+        return 0;
+    }
+
+    if (tokenizer->_isASCII && tokenizer->_hasRootWordRules && (tokenizer->_options & TYPE_MASK) == kCFStringTokenizerUnitWord) {
+        return __CFStringTokenizerGetASCIIWordTokens(tokenizer, index, end, ranges, types, maxCount);
+    } else {
+        return __CFStringTokenizerGetICUTokens(tokenizer, index, end, ranges, types, maxCount);
+    }
+}
+
+/* Tokenizer pool */
+
+#define TOKENIZER_POOL_SIZE 8
+#define TOKENIZER_POOL_MAX_TEXT (64 * 1024) // pooled tokenizers give back text buffers larger than this many characters
+
+static CFStringTokenizerRef __CFStringTokenizerPool[TOKENIZER_POOL_SIZE];
+static CFIndex __CFStringTokenizerPoolCount = 0;
+static CFLock_t __CFStringTokenizerPoolLock = CFLockInit;
+
+CFStringTokenizerRef _CFStringTokenizerCreateFromPool(CFStringRef string, CFRange range, CFOptionFlags options, CFLocaleRef locale) {
+    CFStringRef localeName = locale ? CFLocaleGetIdentifier(locale) : CFSTR("");
+    CFStringTokenizerRef tokenizer = NULL;
+
+    __CFLock(&__CFStringTokenizerPoolLock);
+    for (CFIndex idx = __CFStringTokenizerPoolCount - 1; idx >= 0; idx--) {
+        CFStringTokenizerRef candidate = __CFStringTokenizerPool[idx];
+        if (candidate->_options == options && CFEqual(candidate->_localeName, localeName)) {
+            tokenizer = candidate;
+            __CFStringTokenizerPool[idx] = __CFStringTokenizerPool[--__CFStringTokenizerPoolCount];
+            break;
+        }
+    }
+    __CFUnlock(&__CFStringTokenizerPoolLock);
+
+    if (tokenizer == NULL) {
+        return CFStringTokenizerCreate(kCFAllocatorSystemDefault, string, range, options, locale);
+    }
+
+    CFLocaleRef oldLocale = tokenizer->_locale;
+    tokenizer->_locale = locale ? CFRetain(locale) : CFLocaleCopyCurrent();
+    CFRelease(oldLocale);
+    CFStringTokenizerSetString(tokenizer, string, range);
+    return tokenizer;
+}
+
+void _CFStringTokenizerReturnToPool(CFStringTokenizerRef tokenizer) {
+    static const UniChar empty = 0;
+    UErrorCode err = 0;
+
+    if (CFGetRetainCount(tokenizer) != 1 || CFGetAllocator(tokenizer) != kCFAllocatorSystemDefault) {
+        CFRelease(tokenizer);
+        return;
+    }
+
+    // Let go of the string while the tokenizer waits in the pool
+    ubrk_setText(tokenizer->_break_itr, (const UChar *)&empty, 0, &err);
+    if (tokenizer->_string) {
+        CFRelease(tokenizer->_string);
+        tokenizer->_string = NULL;
+    }
+    tokenizer->_textLength = 0;
+    if (tokenizer->_textCapacity > TOKENIZER_POOL_MAX_TEXT) {
+        free(tokenizer->_text);
+        tokenizer->_text = NULL;
+        tokenizer->_textCapacity = 0;
+    }
+
+    __CFLock(&__CFStringTokenizerPoolLock);
+    if (__CFStringTokenizerPoolCount < TOKENIZER_POOL_SIZE) {
+        __CFStringTokenizerPool[__CFStringTokenizerPoolCount++] = tokenizer;
+        tokenizer = NULL;
+    }
+    __CFUnlock(&__CFStringTokenizerPoolLock);
+
+    if (tokenizer) {
+        CFRelease(tokenizer);
+    }
+}
@@ -6,7 +6,9 @@
 //
 
 #include "CFString.h"
+#include "CFInternal.h"
 #include <unicode/utrans.h>
+#include <unicode/ustring.h>
 #include <dispatch/dispatch.h>
 #include <stdio.h>
 
@@ -68,7 +70,7 @@ static void _CFStringTransformCopy(UReplaceable *rep, int32_t start, int32_t lim
     UniChar stack_text[BUFFER_SIZE];
     UniChar *text = &stack_text[0];
     if (limit - start > BUFFER_SIZE) {
-        text = malloc(limit - start);
+        text = malloc((limit - start) * sizeof(UniChar));
         if (text == NULL) {
             // we cant throw a NSException here, but return before anything blows up...
             fprintf(stderr, "ICU Internal failure occurred, we are out of memory: time to go cry in a corner now...\n");
@@ -86,76 +88,62 @@ static void _CFStringTransformCopy(UReplaceable *rep, int32_t start, int32_t lim
     }
 }
 
-static inline UTransliterator *utrans_find(CFStringRef transform, UTransDirection dir, UErrorCode *error) {
-    UEnumeration *uenum = NULL;
+// The ICU transliterator IDs of the transform constants; any other transform is taken to be an ICU ID itself
+static const struct {
+    const CFStringRef *transform;
+    const char *identifier;
+} __CFStringTransformIdentifiers[] = {
+    { &kCFStringTransformStripCombiningMarks, "NFD; [:Mn:] Remove; NFC" },
+    { &kCFStringTransformToLatin, "Any-Latin" },
+    { &kCFStringTransformFullwidthHalfwidth, "Fullwidth-Halfwidth" },
+    { &kCFStringTransformLatinKatakana, "Latin-Katakana" },
+    { &kCFStringTransformLatinHiragana, "Latin-Hiragana" },
+    { &kCFStringTransformHiraganaKatakana, "Hiragana-Katakana" },
+    { &kCFStringTransformMandarinLatin, "Han-Latin" },
+    { &kCFStringTransformLatinHangul, "Latin-Hangul" },
+    { &kCFStringTransformLatinArabic, "Latin-Arabic" },
+    { &kCFStringTransformLatinHebrew, "Latin-Hebrew" },
+    { &kCFStringTransformLatinThai, "Latin-Thai" },
+    { &kCFStringTransformLatinCyrillic, "Latin-Cyrillic" },
+    { &kCFStringTransformLatinGreek, "Latin-Greek" },
+    { &kCFStringTransformToXMLHex, "Any-Hex/XML" },
+    { &kCFStringTransformToUnicodeName, "Any-Name" },
+    { &kCFStringTransformStripDiacritics, "Accents-Any" },
+};
+
+#define TRANSFORM_COUNT (CFIndex)(sizeof(__CFStringTransformIdentifiers) / sizeof(__CFStringTransformIdentifiers[0]))
+
+static UTransliterator *__CFStringTransformOpen(CFStringRef transform, UTransDirection dir, UErrorCode *error) {
+    UChar stack_id[BUFFER_SIZE];
+    UChar *uid = &stack_id[0];
+    CFIndex idLen = -1;
+    Boolean isConstant = false;
     UTransliterator *trans = NULL;
-    do {
-        uenum = utrans_openIDs(error);
-        if (U_FAILURE(*error)) {
-            fprintf(stderr, "%s\n", u_errorName(*error));
-            break;
-        }
 
-        int32_t count = uenum_count(uenum, error);
-        if (U_FAILURE(*error)) {
-            fprintf(stderr, "%s\n", u_errorName(*error));
+    for (CFIndex idx = 0; idx < TRANSFORM_COUNT; idx++) {
+        if (CFEqual(transform, *__CFStringTransformIdentifiers[idx].transform)) {
+            u_uastrncpy(uid, __CFStringTransformIdentifiers[idx].identifier, BUFFER_SIZE);
+            isConstant = true;
             break;
         }
-        int32_t trans_idx = 0;
-        while (trans_idx < count && trans == NULL) {
-            int32_t idLen = 0;
-            const UChar *uid = uenum_unext(uenum, &idLen, error);
-            if (U_FAILURE(*error)) {
-                fprintf(stderr, "%s\n", u_errorName(*error));
-                break;
-            }
-            // this seems rather unlikely since we should have already broken
-            // by the trans_idx exceeding the count
+    }
+    if (!isConstant) {
+        idLen = CFStringGetLength(transform);
+        if (idLen > BUFFER_SIZE) {
+            uid = malloc(idLen * sizeof(UChar));
             if (uid == NULL) {
-                break;
-            }
-
-            CFStringRef name = CFStringCreateWithCharactersNoCopy(kCFAllocatorDefault, uid, idLen, kCFAllocatorNull);
-            // It would have been nice if these stirng constants were actually defined somewhere in icu, but sadly they are runtime metadata...
-            if ((CFEqual(name, CFSTR("Any-Remove")) && CFEqual(transform, kCFStringTransformStripCombiningMarks)) ||
-                (CFEqual(name, CFSTR("Any-Latin")) && CFEqual(transform, kCFStringTransformToLatin)) ||
-                (CFEqual(name, CFSTR("Latin-Katakana")) && CFEqual(transform, kCFStringTransformLatinKatakana)) ||
-                (CFEqual(name, CFSTR("Latin-Hiragana")) && CFEqual(transform, kCFStringTransformLatinHiragana)) ||
-                (CFEqual(name, CFSTR("Hiragana-Katakana")) && CFEqual(transform, kCFStringTransformHiraganaKatakana)) ||
-                (CFEqual(name, CFSTR("Latin-Hangul")) && CFEqual(transform, kCFStringTransformLatinHangul)) ||
-                (CFEqual(name, CFSTR("Latin-Arabic")) && CFEqual(transform, kCFStringTransformLatinArabic)) ||
-                (CFEqual(name, CFSTR("Latin-Hebrew")) && CFEqual(transform, kCFStringTransformLatinHebrew)) ||
-                (CFEqual(name, CFSTR("Latin-Thai")) && CFEqual(transform, kCFStringTransformLatinThai)) ||
-                (CFEqual(name, CFSTR("Latin-Cyrillic")) && CFEqual(transform, kCFStringTransformLatinCyrillic)) ||
-                (CFEqual(name, CFSTR("Latin-Greek")) && CFEqual(transform, kCFStringTransformLatinGreek)) ||
-                (CFEqual(name, CFSTR("Any-Hex/XML")) && CFEqual(transform, kCFStringTransformToXMLHex)) ||
-                (CFEqual(name, CFSTR("Any-Name")) && CFEqual(transform, kCFStringTransformToUnicodeName)) ||
-                (CFEqual(name, CFSTR("Accents-Any")) && CFEqual(transform, kCFStringTransformStripDiacritics))) {
-                trans = utrans_openU(uid, idLen, dir, NULL, 0, NULL, error);
+                return NULL;
             }
-            CFRelease(name);
-            trans_idx++;
         }
-    } while (0);
+        CFStringGetCharacters(transform, CFRangeMake(0, idLen), (UniChar *)uid);
+    }
 
-    if (uenum != NULL) {
-        uenum_reset(uenum, error);
-        uenum_close(uenum);
-    }
-
-    if (trans == NULL && (CFEqual(transform, kCFStringTransformStripCombiningMarks) ||
-                          CFEqual(transform, kCFStringTransformToLatin) ||
-                          CFEqual(transform, kCFStringTransformLatinKatakana) ||
-                          CFEqual(transform, kCFStringTransformLatinHiragana) ||
-                          CFEqual(transform, kCFStringTransformHiraganaKatakana) ||
-                          CFEqual(transform, kCFStringTransformLatinHangul) ||
-                          CFEqual(transform, kCFStringTransformLatinArabic) ||
-                          CFEqual(transform, kCFStringTransformLatinHebrew) ||
-                          CFEqual(transform, kCFStringTransformLatinCyrillic) ||
-                          CFEqual(transform, kCFStringTransformLatinGreek) ||
-                          CFEqual(transform, kCFStringTransformToXMLHex) ||
-                          CFEqual(transform, kCFStringTransformToUnicodeName) ||
-                          CFEqual(transform, kCFStringTransformStripDiacritics))) {
+    trans = utrans_openU(uid, idLen, dir, NULL, 0, NULL, error);
+    if (uid != &stack_id[0]) {
+        free(uid);
+    }
+
+    if (trans == NULL && isConstant) {
         static dispatch_once_t once = 0L;
         dispatch_once(&once, ^{
             fprintf(stderr, "Unable to find transliterators in icu data: likely this is from not including the Transliterators section in building your icu.dat file");
@@ -165,6 +153,106 @@ static inline UTransliterator *utrans_find(CFStringRef transform, UTransDirectio
     return trans;
 }
 
+/*
+ Opening a transliterator compiles its rules, which costs far more than running it. Each (transform,
+ direction) is opened once per process and kept in __CFTransliteratorCache; a thread works with its own
+ clone of it, since transliterating is not safe on one transliterator from several threads at once.
+ */
+#define TRANSLITERATOR_CACHE_SIZE 16
+#define THREAD_TRANSLITERATOR_CACHE_SIZE 8
+
+typedef struct {
+    CFStringRef _transform;
+    UTransDirection _direction;
+    UTransliterator *_transliterator;
+} __CFTransliteratorCacheEntry;
+
+typedef struct {
+    CFIndex _count;
+    __CFTransliteratorCacheEntry _entries[THREAD_TRANSLITERATOR_CACHE_SIZE]; // most recently used first
+} __CFTransliteratorThreadCache;
+
+static __CFTransliteratorCacheEntry __CFTransliteratorCache[TRANSLITERATOR_CACHE_SIZE]; // only ever cloned
+static CFIndex __CFTransliteratorCacheCount = 0;
+static CFLock_t __CFTransliteratorCacheLock = CFLockInit;
+
+static void __CFTransliteratorThreadCacheDestructor(void *context) {
+    __CFTransliteratorThreadCache *cache = (__CFTransliteratorThreadCache *)context;
+    for (CFIndex idx = 0; idx < cache->_count; idx++) {
+        utrans_close(cache->_entries[idx]._transliterator);
+        CFRelease(cache->_entries[idx]._transform);
+    }
+    free(cache);
+}
+
+// The returned transliterator belongs to the calling thread's cache
+static UTransliterator *__CFStringTransformGetTransliterator(CFStringRef transform, UTransDirection dir, UErrorCode *error) {
+    __CFTransliteratorThreadCache *cache = (__CFTransliteratorThreadCache *)_CFGetTSD(__CFTSDKeyTransliterators);
+    __CFTransliteratorCacheEntry entry;
+    UTransliterator *trans = NULL;
+
+    if (cache == NULL) {
+        cache = (__CFTransliteratorThreadCache *)calloc(1, sizeof(__CFTransliteratorThreadCache));
+        if (cache == NULL) {
+            return NULL;
+        }
+        _CFSetTSD(__CFTSDKeyTransliterators, cache, __CFTransliteratorThreadCacheDestructor);
+    }
+
+    for (CFIndex idx = 0; idx < cache->_count; idx++) {
+        if (cache->_entries[idx]._direction == dir && CFEqual(cache->_entries[idx]._transform, transform)) {
+            entry = cache->_entries[idx];
+            memmove(&cache->_entries[1], &cache->_entries[0], idx * sizeof(__CFTransliteratorCacheEntry));
+            cache->_entries[0] = entry;
+            return entry._transliterator;
+        }
+    }
+
+    __CFLock(&__CFTransliteratorCacheLock);
+    for (CFIndex idx = 0; idx < __CFTransliteratorCacheCount; idx++) {
+        if (__CFTransliteratorCache[idx]._direction == dir && CFEqual(__CFTransliteratorCache[idx]._transform, transform)) {
+            trans = utrans_clone(__CFTransliteratorCache[idx]._transliterator, error);
+            break;
+        }
+    }
+    if (trans == NULL && !U_FAILURE(*error)) {
+        UTransliterator *compiled = __CFStringTransformOpen(transform, dir, error);
+        if (compiled != NULL && __CFTransliteratorCacheCount < TRANSLITERATOR_CACHE_SIZE) {
+            __CFTransliteratorCache[__CFTransliteratorCacheCount]._transform = CFStringCreateCopy(kCFAllocatorSystemDefault, transform);
+            __CFTransliteratorCache[__CFTransliteratorCacheCount]._direction = dir;
+            __CFTransliteratorCache[__CFTransliteratorCacheCount]._transliterator = compiled;
+            __CFTransliteratorCacheCount++;
+            trans = utrans_clone(compiled, error);
+        } else {
+            trans = compiled; // no room to share it; the thread keeps the original
+        }
+    }
+    __CFUnlock(&__CFTransliteratorCacheLock);
+
+    if (trans == NULL) {
+        return NULL;
+    }
+
+    if (cache->_count == THREAD_TRANSLITERATOR_CACHE_SIZE) {
+        cache->_count--;
+        utrans_close(cache->_entries[cache->_count]._transliterator);
+        CFRelease(cache->_entries[cache->_count]._transform);
+    }
+    memmove(&cache->_entries[1], &cache->_entries[0], cache->_count * sizeof(__CFTransliteratorCacheEntry));
+    cache->_entries[0]._transform = CFStringCreateCopy(kCFAllocatorSystemDefault, transform);
+    cache->_entries[0]._direction = dir;
+    cache->_entries[0]._transliterator = trans;
+    cache->_count++;
+    return trans;
+}
+
+// Transforms that leave ASCII text as it is, so that ASCII text need not go through ICU at all
+static Boolean __CFStringTransformKeepsASCII(CFStringRef transform, Boolean reverse) {
+    return !reverse && (CFEqual(transform, kCFStringTransformStripCombiningMarks) ||
+                        CFEqual(transform, kCFStringTransformToLatin) ||
+                        CFEqual(transform, kCFStringTransformStripDiacritics));
+}
+
 Boolean CFStringTransform(CFMutableStringRef string, CFRange *range, CFStringRef transform, Boolean reverse) {
     UErrorCode err = 0;
     static UReplaceableCallbacks callbacks = {
@@ -180,12 +268,18 @@ Boolean CFStringTransform(CFMutableStringRef string, CFRange *range, CFStringRef
     int32_t start = 0;
     int32_t limit = CFStringGetLength(string);
     if (range != NULL) {
-        range->location = kCFNotFound;
-        range->length = 0;
+        start = range->location;
+        limit = range->location + range->length;
     }
     do {
-        // technically this data could potentially be cached, if it is used often, we should consider doing so, until then this should work
-        trans = utrans_find(transform, reverse ? UTRANS_REVERSE : UTRANS_FORWARD, &err);
+        if (__CFStringTransformKeepsASCII(transform, reverse)) {
+            CFIndex asciiLength = CFStringGetBytes(string, CFRangeMake(start, limit - start), kCFStringEncodingASCII, 0, false, NULL, 0, NULL);
+            if (asciiLength == limit - start) {
+                success = true;
+                break;
+            }
+        }
+        trans = __CFStringTransformGetTransliterator(transform, reverse ? UTRANS_REVERSE : UTRANS_FORWARD, &err);
         if (trans == NULL) {
             break;
         }
@@ -193,15 +287,13 @@ Boolean CFStringTransform(CFMutableStringRef string, CFRange *range, CFStringRef
         if (U_FAILURE(err)) {
             break;
         }
-        utrans_close(trans);
         success = true;
     } while (0);
 
-    if (success) {
-        range->location = start;
-        range->length = limit - start;
+    if (range != NULL) {
+        range->location = success ? start : kCFNotFound;
+        range->length = success ? limit - start : 0;
     }
 
     return success;
 }
-
@@ -441,7 +441,6 @@ static UCollator *__CFStringCopyDefaultCollator(CFLocaleRef compareLocale) {
     return collator;
 }
 
-#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED
 static void __collatorFinalize(UCollator *collator) {
     CFLocaleRef locale = _CFGetTSD(__CFTSDKeyCollatorLocale);
     _CFSetTSD(__CFTSDKeyCollatorUCollator, NULL, NULL);
@@ -455,7 +454,22 @@ static void __collatorFinalize(UCollator *collator) {
     if (NULL != collator) ucol_close(collator);
     if (locale) CFRelease(locale);
 }
-#endif
+
+// Returns the collator this thread last used if it was for the same locale, otherwise checks out a default one or creates one. The thread owns the collator until it needs one for another locale or exits; callers must leave its default settings in place.
+static UCollator *__CFStringGetThreadCollator(CFLocaleRef compareLocale) {
+    UCollator *threadCollator = (UCollator *)_CFGetTSD(__CFTSDKeyCollatorUCollator);
+    CFLocaleRef threadLocale = (CFLocaleRef)_CFGetTSD(__CFTSDKeyCollatorLocale);
+    if (compareLocale == threadLocale) return threadCollator;
+
+    UCollator *collator = __CFStringCopyDefaultCollator(compareLocale);
+    if (NULL == collator) collator = __CFStringCreateCollator(compareLocale);
+
+    if (threadLocale) __collatorFinalize(threadCollator); // need to dealloc collators
+
+    _CFSetTSD(__CFTSDKeyCollatorUCollator, collator, (void *)__collatorFinalize);
+    _CFSetTSD(__CFTSDKeyCollatorLocale, (void *)CFRetain(compareLocale), NULL);
+    return collator;
+}
 
 // -------------------------------------------------------------------------------------------------
 // __CompareTextDefault
@@ -596,7 +610,6 @@ CF_PRIVATE CFComparisonResult _CFCompareStringsWithLocale(CFStringInlineBuffer *
     bool forcedOrdering = ((options & kCFCompareForcedOrdering) ? true : false);
 
     UCollator *collator = NULL;
-    bool defaultCollator = true;
 #endif
     static const uint8_t *alnumBMP = NULL;
     static const uint8_t *nonBaseBMP = NULL;
@@ -626,24 +639,7 @@ CF_PRIVATE CFComparisonResult _CFCompareStringsWithLocale(CFStringInlineBuffer *
     }
     
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS || DEPLOYMENT_TARGET_LINUX
-#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED
-    // First we try to use the last one used on this thread, if the locale is the same,
-    // otherwise we try to check out a default one, or then we create one.
-    UCollator *threadCollator = _CFGetTSD(__CFTSDKeyCollatorUCollator);
-    CFLocaleRef threadLocale = _CFGetTSD(__CFTSDKeyCollatorLocale);
-    if (compareLocale == threadLocale) {
-	collator = threadCollator;
-    } else {
-#endif
-	collator = __CFStringCopyDefaultCollator((CFLocaleRef)compareLocale);
-	defaultCollator = true;
-	if (NULL == collator) {
-	    collator = __CFStringCreateCollator((CFLocaleRef)compareLocale);
-	    defaultCollator = false;
-	}
-#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED
-    }
-#endif
+    collator = __CFStringGetThreadCollator((CFLocaleRef)compareLocale);
 #endif
     
     characters1 = CFStringGetCharactersPtrFromInlineBuffer(str1, range1);
@@ -760,17 +756,222 @@ CF_PRIVATE CFComparisonResult _CFCompareStringsWithLocale(CFStringInlineBuffer *
         if (buffer2Len > 0) CFAllocatorDeallocate(kCFAllocatorSystemDefault, buffer2);
     }
 
-#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED
-    if (collator == threadCollator) {
-	// do nothing, already cached
+    return compResult;
+}
+
+
+#if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS || DEPLOYMENT_TARGET_LINUX
+// -------------------------------------------------------------------------------------------------
+// Collation keys
+//
+// A collation key is the ICU sort key of a string, built with the strength and case level that the
+// second pass of __CompareTextDefault() uses for the same options, so that memcmp() of two keys orders
+// the strings the way ICU's collator for the locale does at those settings. That is not always the order
+// of a localized comparison: the special cases of __CompareSpecials() and the segment handling of
+// _CFCompareStringsWithLocale() are not reproduced, and options other than the case, diacritic, numeric
+// and forced-ordering ones (kCFCompareNonliteral, kCFCompareWidthInsensitive, ...) are ignored.
+// For kCFCompareForcedOrdering the tertiary key and the big-endian UTF-16 code units follow, breaking
+// the remaining ties. Sort keys end with a 0 byte and contain no other, so the concatenation still
+// compares level by level.
+// -------------------------------------------------------------------------------------------------
+
+#define __kCFCollationKeyParallelMinCount (4096)
+#define __kCFCollationKeyChunkMinCount (1024)
+
+typedef struct {
+    uint8_t *bytes;
+    CFIndex length;
+    CFIndex capacity;
+} __CFCollationKeyBuffer;
+
+typedef struct {
+    const void *value;
+    const uint8_t *key;
+    CFIndex keyLength;
+} __CFCollationSortEntry;
+
+static void __CFStringSetCollationKeyAttributes(UCollator *collator, CFOptionFlags options, Boolean tertiary) {
+    UErrorCode icuStatus = U_ZERO_ERROR;
+    ucol_setAttribute(collator, UCOL_NORMALIZATION_MODE, UCOL_ON, &icuStatus);
+    if (tertiary) {
+        ucol_setAttribute(collator, UCOL_STRENGTH, UCOL_TERTIARY, &icuStatus);
+        ucol_setAttribute(collator, UCOL_CASE_LEVEL, UCOL_ON, &icuStatus);
     } else {
-	if (threadLocale) __collatorFinalize((UCollator *)_CFGetTSD(__CFTSDKeyCollatorUCollator)); // need to dealloc collators
+        ucol_setAttribute(collator, UCOL_STRENGTH, (options & kCFCompareDiacriticInsensitive) ? UCOL_PRIMARY : UCOL_SECONDARY, &icuStatus);
+        ucol_setAttribute(collator, UCOL_CASE_LEVEL, (options & kCFCompareCaseInsensitive) ? UCOL_OFF : UCOL_ON, &icuStatus);
+    }
+    ucol_setAttribute(collator, UCOL_NUMERIC_COLLATION, (options & kCFCompareNumerically) ? UCOL_ON : UCOL_OFF, &icuStatus);
+}
 
-	_CFSetTSD(__CFTSDKeyCollatorUCollator, collator, (void *)__collatorFinalize);
-	_CFSetTSD(__CFTSDKeyCollatorLocale, (void *)CFRetain(compareLocale), NULL);
+// Puts back the settings __CFStringCreateCollator() gives, which the thread's collator must keep between uses
+static void __CFStringResetCollatorAttributes(UCollator *collator) {
+    UErrorCode icuStatus = U_ZERO_ERROR;
+    ucol_setAttribute(collator, UCOL_NORMALIZATION_MODE, UCOL_OFF, &icuStatus);
+    ucol_setAttribute(collator, UCOL_STRENGTH, UCOL_PRIMARY, &icuStatus);
+    ucol_setAttribute(collator, UCOL_CASE_LEVEL, UCOL_OFF, &icuStatus);
+    ucol_setAttribute(collator, UCOL_NUMERIC_COLLATION, UCOL_OFF, &icuStatus);
+}
+
+static uint8_t *__CFCollationKeyBufferReserve(__CFCollationKeyBuffer *buffer, CFIndex length) {
+    if (buffer->length + length > buffer->capacity) {
+        CFIndex capacity = (buffer->capacity < 256) ? 256 : buffer->capacity;
+        while (capacity < buffer->length + length) capacity *= 2;
+        buffer->bytes = (uint8_t *)CFAllocatorReallocate(kCFAllocatorSystemDefault, buffer->bytes, capacity, 0);
+        if (!buffer->bytes) HALT;
+        buffer->capacity = capacity;
     }
-#endif
-    
-    return compResult;
+    return buffer->bytes + buffer->length;
+}
+
+static void __CFCollationKeyBufferAppendSortKey(__CFCollationKeyBuffer *buffer, UCollator *collator, const UniChar *characters, CFIndex length) {
+    CFIndex available = buffer->capacity - buffer->length;
+    CFIndex keyLength = ucol_getSortKey(collator, (const UChar *)characters, (int32_t)length, buffer->bytes ? buffer->bytes + buffer->length : NULL, (int32_t)available);
+    if (keyLength > available) {
+        __CFCollationKeyBufferReserve(buffer, keyLength);
+        keyLength = ucol_getSortKey(collator, (const UChar *)characters, (int32_t)length, buffer->bytes + buffer->length, (int32_t)keyLength);
+    }
+    buffer->length += keyLength;
+}
+
+// Appends the key of string to buffer. The collator must be set up with __CFStringSetCollationKeyAttributes(options, false); it is left that way.
+static void __CFStringAppendCollationKey(__CFCollationKeyBuffer *buffer, UCollator *collator, CFStringRef string, CFOptionFlags options, UniChar **characterBuffer, CFIndex *characterCapacity) {
+    CFIndex length = CFStringGetLength(string);
+    const UniChar *characters = CFStringGetCharactersPtr(string);
+    if (NULL == characters && length > 0) {
+        if (length > *characterCapacity) {
+            *characterBuffer = (UniChar *)CFAllocatorReallocate(kCFAllocatorSystemDefault, *characterBuffer, length * sizeof(UniChar), 0);
+            if (!*characterBuffer) HALT;
+            *characterCapacity = length;
+        }
+        CFStringGetCharacters(string, CFRangeMake(0, length), *characterBuffer);
+        characters = *characterBuffer;
+    }
+
+    __CFCollationKeyBufferAppendSortKey(buffer, collator, characters, length);
+    if (options & kCFCompareForcedOrdering) {
+        __CFStringSetCollationKeyAttributes(collator, options, true);
+        __CFCollationKeyBufferAppendSortKey(buffer, collator, characters, length);
+        __CFStringSetCollationKeyAttributes(collator, options, false);
+        uint8_t *bytes = __CFCollationKeyBufferReserve(buffer, length * 2);
+        for (CFIndex idx = 0; idx < length; idx++) {
+            bytes[2 * idx] = (uint8_t)(characters[idx] >> 8);
+            bytes[2 * idx + 1] = (uint8_t)characters[idx];
+        }
+        buffer->length += length * 2;
+    }
+}
+
+CFDataRef _CFStringCreateCollationKey(CFAllocatorRef alloc, CFStringRef string, CFOptionFlags options, CFLocaleRef locale) {
+    CFLocaleRef currentLocale = (NULL == locale) ? CFLocaleCopyCurrent() : NULL;
+    UCollator *collator = __CFStringGetThreadCollator(locale ? locale : currentLocale);
+    CFDataRef key = NULL;
+    if (NULL != collator) {
+        __CFCollationKeyBuffer buffer = {NULL, 0, 0};
+        UniChar *characterBuffer = NULL;
+        CFIndex characterCapacity = 0;
+        __CFStringSetCollationKeyAttributes(collator, options, false);
+        __CFStringAppendCollationKey(&buffer, collator, string, options, &characterBuffer, &characterCapacity);
+        __CFStringResetCollatorAttributes(collator);
+        key = CFDataCreate(alloc, buffer.bytes, buffer.length);
+        if (buffer.bytes) CFAllocatorDeallocate(kCFAllocatorSystemDefault, buffer.bytes);
+        if (characterBuffer) CFAllocatorDeallocate(kCFAllocatorSystemDefault, characterBuffer);
+    }
+    if (currentLocale) CFRelease(currentLocale);
+    return key;
+}
+
+// Fills in the keys of count entries, using the calling thread's collator; returns the buffer holding them, which the caller frees
+static uint8_t *__CFStringComputeCollationKeys(__CFCollationSortEntry *entries, CFIndex count, CFOptionFlags options, CFLocaleRef locale) {
+    UCollator *collator = __CFStringGetThreadCollator(locale);
+    if (NULL == collator) return NULL;
+    __CFCollationKeyBuffer buffer = {NULL, 0, 0};
+    UniChar *characterBuffer = NULL;
+    CFIndex characterCapacity = 0;
+    __CFStringSetCollationKeyAttributes(collator, options, false);
+    // Keys are recorded as offsets while the buffer may still move
+    for (CFIndex idx = 0; idx < count; idx++) {
+        CFIndex start = buffer.length;
+        __CFStringAppendCollationKey(&buffer, collator, (CFStringRef)entries[idx].value, options, &characterBuffer, &characterCapacity);
+        entries[idx].key = (const uint8_t *)(uintptr_t)start;
+        entries[idx].keyLength = buffer.length - start;
+    }
+    __CFStringResetCollatorAttributes(collator);
+    if (characterBuffer) CFAllocatorDeallocate(kCFAllocatorSystemDefault, characterBuffer);
+    if (NULL == buffer.bytes) buffer.bytes = (uint8_t *)CFAllocatorAllocate(kCFAllocatorSystemDefault, 1, 0);
+    for (CFIndex idx = 0; idx < count; idx++) entries[idx].key = buffer.bytes + (uintptr_t)entries[idx].key;
+    return buffer.bytes;
+}
+
+static CFComparisonResult __CFCollationSortEntryCompare(const void *val1, const void *val2, void *context) {
+    const __CFCollationSortEntry *entry1 = (const __CFCollationSortEntry *)val1;
+    const __CFCollationSortEntry *entry2 = (const __CFCollationSortEntry *)val2;
+    CFIndex length = (entry1->keyLength < entry2->keyLength) ? entry1->keyLength : entry2->keyLength;
+    int result = memcmp(entry1->key, entry2->key, length);
+    if (0 == result) return (entry1->keyLength < entry2->keyLength) ? kCFCompareLessThan : ((entry1->keyLength > entry2->keyLength) ? kCFCompareGreaterThan : kCFCompareEqualTo);
+    return (result < 0) ? kCFCompareLessThan : kCFCompareGreaterThan;
+}
+
+static CFComparisonResult __CFStringCompareWithLocaleApplier(const void *val1, const void *val2, void *context) {
+    const void **info = (const void **)context;
+    CFStringRef string1 = *(CFStringRef *)val1;
+    CFStringRef string2 = *(CFStringRef *)val2;
+    return CFStringCompareWithOptionsAndLocale(string1, string2, CFRangeMake(0, CFStringGetLength(string1)), (CFOptionFlags)(uintptr_t)info[0] | kCFCompareLocalized, (CFLocaleRef)info[1]);
 }
 
+void _CFArraySortStringsWithLocale(CFMutableArrayRef array, CFRange range, CFOptionFlags options, CFLocaleRef locale) {
+    CFIndex count = range.length;
+    if (count < 2) return;
+    CFLocaleRef currentLocale = (NULL == locale) ? CFLocaleCopyCurrent() : NULL;
+    if (NULL == locale) locale = currentLocale;
+
+    __CFCollationSortEntry *entries = (__CFCollationSortEntry *)CFAllocatorAllocate(kCFAllocatorSystemDefault, count * (sizeof(__CFCollationSortEntry) + sizeof(const void *)), 0);
+    if (!entries) HALT;
+    const void **values = (const void **)(entries + count);
+    CFArrayGetValues(array, range, values);
+    for (CFIndex idx = 0; idx < count; idx++) entries[idx].value = values[idx];
+
+    // Building the keys is where the time goes; large arrays are split into chunks, each computed on a worker thread with that thread's own collator
+    CFIndex ncores = __CFActiveProcessorCount();
+    CFIndex nchunks = 1;
+    if (ncores > 1 && count >= __kCFCollationKeyParallelMinCount) {
+        nchunks = 4 * ncores;
+        if (count / nchunks < __kCFCollationKeyChunkMinCount) nchunks = count / __kCFCollationKeyChunkMinCount;
+    }
+    CFIndex perChunk = (count + nchunks - 1) / nchunks;
+    nchunks = (count + perChunk - 1) / perChunk;
+    uint8_t **keyBuffers = (uint8_t **)calloc(nchunks, sizeof(uint8_t *));
+    if (!keyBuffers) HALT;
+
+    if (1 == nchunks) {
+        keyBuffers[0] = __CFStringComputeCollationKeys(entries, count, options, locale);
+    } else {
+        __CFCollationSortEntry *entriesPtr = entries;
+        dispatch_apply(nchunks, __CFDispatchQueueGetGenericMatchingCurrent(), ^(size_t chunk) {
+            CFIndex first = chunk * perChunk;
+            CFIndex n = (first + perChunk <= count) ? perChunk : count - first;
+            keyBuffers[chunk] = __CFStringComputeCollationKeys(entriesPtr + first, n, options, locale);
+        });
+    }
+
+    Boolean success = true;
+    for (CFIndex chunk = 0; chunk < nchunks; chunk++) {
+        if (NULL == keyBuffers[chunk]) success = false;
+    }
+    if (success) {
+        CFMergeSortArray(entries, count, sizeof(__CFCollationSortEntry), __CFCollationSortEntryCompare, NULL);
+        for (CFIndex idx = 0; idx < count; idx++) values[idx] = entries[idx].value;
+    } else {
+        // No collator for this locale; fall back to comparing the strings directly
+        const void *info[2] = {(const void *)(uintptr_t)options, locale};
+        CFMergeSortArray(values, count, sizeof(const void *), __CFStringCompareWithLocaleApplier, info);
+    }
+    CFArrayReplaceValues(array, range, values, count);
+
+    for (CFIndex chunk = 0; chunk < nchunks; chunk++) {
+        if (keyBuffers[chunk]) CFAllocatorDeallocate(kCFAllocatorSystemDefault, keyBuffers[chunk]);
+    }
+    free(keyBuffers);
+    CFAllocatorDeallocate(kCFAllocatorSystemDefault, entries);
+    if (currentLocale) CFRelease(currentLocale);
+}
+#endif
@@ -79,6 +79,16 @@ static void __InitTZStrings(void);
 #error Unknown or unspecified DEPLOYMENT_TARGET
 #endif
 
+#if !DEPLOYMENT_TARGET_WINDOWS && CF_EMBEDDED_ZONE_TAB
+// Compiled-in copy of the zoneinfo database, consulted only when TZDIR itself is missing; see _zone_tab.c
+extern const uint8_t *_TimeZoneDataGet(const char *key, CFIndex *len);
+
+static Boolean __CFTimeZoneDirectoryIsMissing(void) {
+    struct stat statBuf;
+    return stat(TZDIR, &statBuf) != 0 && (ENOENT == errno || ENOTDIR == errno);
+}
+#endif
+
 #if DEPLOYMENT_TARGET_LINUX
 // Symbol aliases
 CF_EXPORT CFStringRef const kCFDateFormatterTimeZone __attribute__((weak, alias ("kCFDateFormatterTimeZoneKey")));
@@ -162,6 +172,32 @@ static CFMutableArrayRef __CFCopyWindowsTimeZoneList() {
     return result;
 }
 #elif DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_WINDOWS || DEPLOYMENT_TARGET_LINUX
+#if !DEPLOYMENT_TARGET_WINDOWS && CF_EMBEDDED_ZONE_TAB
+// Appends the zone names (third column) of an in-memory zone.tab to the list
+static void __CFAppendZoneTabNames(CFMutableArrayRef result, const uint8_t *bytes, CFIndex len) {
+    const uint8_t *end = bytes + len;
+    while (bytes < end) {
+	const uint8_t *nextl = memchr(bytes, '\n', end - bytes);
+	if (!nextl) nextl = end;
+	if ('#' != *bytes) {
+	    const uint8_t *tab1 = memchr(bytes, '\t', nextl - bytes);
+	    const uint8_t *tab2 = tab1 ? memchr(tab1 + 1, '\t', nextl - tab1 - 1) : NULL;
+	    if (tab2) {
+		const uint8_t *name = tab2 + 1;
+		const uint8_t *tab3 = memchr(name, '\t', nextl - name);
+		CFIndex nmlen = (tab3 ? tab3 : nextl) - name;
+		CFStringRef string = CFStringCreateWithBytes(kCFAllocatorSystemDefault, name, nmlen, kCFStringEncodingUTF8, false);
+		if (string) {
+		    CFArrayAppendValue(result, string);
+		    CFRelease(string);
+		}
+	    }
+	}
+	bytes = (nextl < end) ? nextl + 1 : end;
+    }
+}
+#endif
+
 static CFMutableArrayRef __CFCopyRecursiveDirectoryList() {
     CFMutableArrayRef result = CFArrayCreateMutable(kCFAllocatorSystemDefault, 0, &kCFTypeArrayCallBacks);
 #if DEPLOYMENT_TARGET_WINDOWS
@@ -170,6 +206,15 @@ static CFMutableArrayRef __CFCopyRecursiveDirectoryList() {
     int fd = open(__tzDir, O_RDONLY);
 #else
     int fd = open(TZDIR "/zone.tab", O_RDONLY);
+#if CF_EMBEDDED_ZONE_TAB
+    if (fd < 0 && __CFTimeZoneDirectoryIsMissing()) {
+	// Only the compiled-in zone.tab is read here; none of the zones themselves are touched
+	CFIndex len = 0;
+	const uint8_t *bytes = _TimeZoneDataGet("zone.tab", &len);
+	if (bytes) __CFAppendZoneTabNames(result, bytes, len);
+	return result;
+    }
+#endif
 #endif
 
     for (; 0 <= fd;) {
@@ -1164,6 +1209,19 @@ CFTimeZoneRef CFTimeZoneCreateWithName(CFAllocatorRef allocator, CFStringRef nam
            }
            CFRelease(tempURL);
        }
+#if !DEPLOYMENT_TARGET_WINDOWS && CF_EMBEDDED_ZONE_TAB
+       if (NULL == data && __CFTimeZoneDirectoryIsMissing()) {
+           // Fall back to the compiled-in database; its payloads are immutable, so wrap them without copying
+           char buffer[1024];
+           const uint8_t *compiled = NULL;
+           if (CFStringGetCString(tzName, buffer, sizeof(buffer), kCFStringEncodingUTF8)) {
+               compiled = _TimeZoneDataGet(buffer, &length);
+           }
+           if (compiled) {
+               data = CFDataCreateWithBytesNoCopy(kCFAllocatorSystemDefault, compiled, length, kCFAllocatorNull);
+           }
+       }
+#endif
     }
     CFRelease(baseURL);
     if (NULL != data) {
@@ -31,6 +31,7 @@
 #include <CoreFoundation/CFCharacterSetPriv.h>
 #include <CoreFoundation/CFNumber.h>
 #include "CFInternal.h"
+#include "CFByteScan.h"
 #include <CoreFoundation/CFStringEncodingConverter.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -192,6 +193,7 @@ struct __CFURL {
     CFURLRef _base;
     struct _CFURLAdditionalData* _extra;
     void *_resourceInfo;    // For use by CoreServicesInternal to cache property values. Retained and released by CFURL.
+    CFStringRef _posixPath; // The POSIX path of the URL, not resolved against _base; computed on first use and set atomically.
     CFRange _ranges[1]; // variable length (1 to 9) array of ranges
 };
 
@@ -1045,10 +1047,16 @@ static CFStringRef UnescapeAllWithUTF8(CFAllocatorRef alloc, CFStringRef origina
                             conversionOK = FALSE;
                         }
                         break;
-                    default:
-                        // copy everything else
-                        *bufPtr = *bytePtr++;
+                    default: {
+                        // copy everything up to the next escape in one go
+                        const UInt8 *nextEscape = __CFByteScanFind2(bytePtr, escapedBuf + usedBufLen, '%', '%');
+                        CFIndex runLength = nextEscape - bytePtr;
+                        memcpy(bufPtr, bytePtr, runLength);
+                        bytePtr = nextEscape;
+                        bufPtr += runLength - 1;
+                        idx += runLength - 1;
                         break;
+                    }
                 }
                 ++bufPtr;
             }
@@ -1065,6 +1073,12 @@ static CFStringRef UnescapeAllWithUTF8(CFAllocatorRef alloc, CFStringRef origina
     return ( result );
 }
 
+// True when the string's 8-bit characters are directly accessible and none of them is a '%'; a false result only means the string has to be scanned the slow way
+static Boolean _stringHasNoPercentEscapes(CFStringRef string, CFIndex length) {
+    const uint8_t *bytes = (const uint8_t *)CFStringGetCStringPtr(string, kCFStringEncodingISOLatin1);
+    return (bytes && __CFByteScanFind2(bytes, bytes + length, '%', '%') == bytes + length);
+}
+
 // Uses UTF-8 to translate all percent escape sequences; returns NULL if it encounters a format failure.  May return the original string.
 CFStringRef  CFURLCreateStringByReplacingPercentEscapes(CFAllocatorRef alloc, CFStringRef  originalString, CFStringRef  charactersToLeaveEscaped) {
     CFMutableStringRef newStr = NULL;
@@ -1081,7 +1095,7 @@ CFStringRef  CFURLCreateStringByReplacingPercentEscapes(CFAllocatorRef alloc, CF
     
     length = CFStringGetLength(originalString);
     
-    if ((length == 0) || (charactersToLeaveEscaped == NULL)) {
+    if ((length == 0) || (charactersToLeaveEscaped == NULL) || _stringHasNoPercentEscapes(originalString, length)) {
         return (CFStringRef)CFStringCreateCopy(alloc, originalString);
     }
     
@@ -1602,6 +1616,7 @@ static void __CFURLDeallocate(CFTypeRef  cf) {
     if (sanitizedString) CFRelease(sanitizedString);
     if ( url->_extra != NULL ) CFAllocatorDeallocate( alloc, url->_extra );
     if (_getResourceInfo(url)) CFRelease(_getResourceInfo(url));
+    if (url->_posixPath) CFRelease(url->_posixPath);
 }
 
 static CFTypeID __kCFURLTypeID = _kCFRuntimeNotATypeID;
@@ -1710,14 +1725,29 @@ static void constructBuffers(CFAllocatorRef alloc, CFStringRef string, UInt8 *in
     }
 }
 
+// Index of the first a or b in characterArray[from, to), or to if there is none
+CF_INLINE CFIndex _findDelimiterCString(const char *characterArray, CFIndex from, CFIndex to, char a, char b) {
+    const uint8_t *bytes = (const uint8_t *)characterArray;
+    return __CFByteScanFind2(bytes + from, bytes + to, (uint8_t)a, (uint8_t)b) - bytes;
+}
+
+CF_INLINE CFIndex _findDelimiterUString(const UniChar *characterArray, CFIndex from, CFIndex to, char a, char b) {
+    while (from < to && characterArray[from] != (UniChar)a && characterArray[from] != (UniChar)b) from++;
+    return from;
+}
+
 static void _parseComponentsCString(CFAllocatorRef alloc, CFURLRef baseURL, CFIndex cfStringLength, const char *characterArray, UInt32 *theFlags, CFRange *packedRanges, uint8_t *numberOfRanges)
 #define CFURL_INCLUDE_PARSE_COMPONENTS
+#define CFURL_FIND_DELIMITER _findDelimiterCString
 #include "CFURL.inc.h"
+#undef CFURL_FIND_DELIMITER
 #undef CFURL_INCLUDE_PARSE_COMPONENTS
 
 static void _parseComponentsUString(CFAllocatorRef alloc, CFURLRef baseURL, CFIndex cfStringLength, const UniChar *characterArray, UInt32 *theFlags, CFRange *packedRanges, uint8_t *numberOfRanges)
 #define CFURL_INCLUDE_PARSE_COMPONENTS
+#define CFURL_FIND_DELIMITER _findDelimiterUString
 #include "CFURL.inc.h"
+#undef CFURL_FIND_DELIMITER
 #undef CFURL_INCLUDE_PARSE_COMPONENTS
 
 static void _parseComponents(CFAllocatorRef alloc, CFStringRef string, CFURLRef baseURL, UInt32 *theFlags, CFRange *packedRanges, uint8_t *numberOfRanges)
@@ -1857,6 +1887,7 @@ static struct __CFURL * _CFURLAlloc(CFAllocatorRef allocator, uint8_t numberOfRa
 static CFURLRef _CFURLCreateWithURLString(CFAllocatorRef allocator, CFStringRef string, Boolean checkForLegalCharacters, CFURLRef baseURL);
 static CFURLRef _CFURLCreateWithFileSystemPath(CFAllocatorRef allocator, CFStringRef fileSystemPath, CFURLPathStyle pathStyle, Boolean isDirectory, CFURLRef baseURL);
 static CFURLRef _CFURLCreateWithFileSystemRepresentation(CFAllocatorRef allocator, const UInt8 *buffer, CFIndex bufLen, Boolean isDirectory, CFURLRef baseURL);
+static CFStringRef _CFURLGetPOSIXPath(CFURLRef url);
 
 static struct __CFURL * _CFURLAlloc(CFAllocatorRef allocator, uint8_t numberOfRanges) {
     struct __CFURL *url;
@@ -1875,6 +1906,7 @@ static struct __CFURL * _CFURLAlloc(CFAllocatorRef allocator, uint8_t numberOfRa
 	url->_base = NULL;
 	url->_extra = NULL;
 	url->_resourceInfo = NULL;
+	url->_posixPath = NULL;
     }
     return url;
 }
@@ -2282,12 +2314,189 @@ static CFURLRef _CFURLCreateWithFileSystemRepresentation(CFAllocatorRef allocato
     return ( result );
 }
 
+/* URL interning
+
+ An optional process-wide cache of the URLs created from strings, for clients that create the same few URLs over and over. It is off until _CFURLSetInterningCacheLimit() gives it a size. Entries are keyed by (string, whether legal characters were checked) and spread by hash over independently locked stripes; each stripe has its own chained hash table and LRU list, and evicts its least recently used entry once it holds its share of the limit. Only absolute URLs in the system default allocator are shared. File URLs are never shared, as they carry per-instance resource value caches. A URL is shared only once the sanitized string, the one part of a CFURL filled in lazily without a lock, has been computed, so that threads reading a shared URL never write to it.
+ */
+#define URL_INTERN_STRIPES 16
+#define URL_INTERN_BUCKETS 128
+
+typedef struct __CFURLInternEntry {
+    struct __CFURLInternEntry *chain;   // next entry in the same bucket
+    struct __CFURLInternEntry *newer;
+    struct __CFURLInternEntry *older;
+    CFHashCode hash;
+    CFStringRef string;
+    Boolean checked;
+    CFURLRef url;
+} __CFURLInternEntry;
+
+typedef struct {
+    CFLock_t lock;
+    CFIndex count;
+    CFIndex hits;
+    CFIndex misses;
+    CFIndex evictions;
+    __CFURLInternEntry *newest;
+    __CFURLInternEntry *oldest;
+    __CFURLInternEntry *buckets[URL_INTERN_BUCKETS];
+} __CFURLInternStripe;
+
+static __CFURLInternStripe __CFURLInternStripes[URL_INTERN_STRIPES];
+static CFIndex __CFURLInternLimit = 0;
+
+static void __CFURLInternInitialize(void) {
+    static dispatch_once_t initOnce;
+    dispatch_once(&initOnce, ^{
+        for (CFIndex idx = 0; idx < URL_INTERN_STRIPES; idx++) __CFURLInternStripes[idx].lock = CFLockInit;
+    });
+}
+
+// Called with the stripe locked
+static void __CFURLInternUnlink(__CFURLInternStripe *stripe, __CFURLInternEntry *entry) {
+    __CFURLInternEntry **link = &stripe->buckets[(entry->hash / URL_INTERN_STRIPES) % URL_INTERN_BUCKETS];
+    while (*link != entry) link = &(*link)->chain;
+    *link = entry->chain;
+    if (entry->newer) entry->newer->older = entry->older; else stripe->newest = entry->older;
+    if (entry->older) entry->older->newer = entry->newer; else stripe->oldest = entry->newer;
+    stripe->count--;
+}
+
+static void __CFURLInternFreeEntries(__CFURLInternEntry *entry) {
+    while (entry) {
+        __CFURLInternEntry *next = entry->chain;
+        CFRelease(entry->url);
+        CFRelease(entry->string);
+        free(entry);
+        entry = next;
+    }
+}
+
+// Called with the stripe locked; moves a hit to the front of the LRU list and returns it retained
+static CFURLRef __CFURLInternFind(__CFURLInternStripe *stripe, CFHashCode hash, CFStringRef string, Boolean checked) {
+    __CFURLInternEntry *entry;
+    for (entry = stripe->buckets[(hash / URL_INTERN_STRIPES) % URL_INTERN_BUCKETS]; entry; entry = entry->chain) {
+        if (entry->hash == hash && entry->checked == checked && CFEqual(entry->string, string)) break;
+    }
+    if (!entry) return NULL;
+    if (entry != stripe->newest) {
+        entry->newer->older = entry->older;
+        if (entry->older) entry->older->newer = entry->newer; else stripe->oldest = entry->newer;
+        entry->newer = NULL;
+        entry->older = stripe->newest;
+        stripe->newest->newer = entry;
+        stripe->newest = entry;
+    }
+    return (CFURLRef)CFRetain(entry->url);
+}
+
+static CFURLRef _CFURLCreateWithURLStringInterned(CFAllocatorRef allocator, CFStringRef string, Boolean checkForLegalCharacters, CFURLRef baseURL) {
+    CFIndex limit = __CFURLInternLimit;
+    // Relative URLs are not shared; whether they are file URLs depends on the base URL
+    if (limit <= 0 || baseURL || (allocator ? allocator : __CFGetDefaultAllocator()) != kCFAllocatorSystemDefault) {
+        return _CFURLCreateWithURLString(allocator, string, checkForLegalCharacters, baseURL);
+    }
+    CFHashCode hash = CFHash(string) * 31 + checkForLegalCharacters;
+    __CFURLInternStripe *stripe = &__CFURLInternStripes[hash % URL_INTERN_STRIPES];
+    
+    __CFLock(&stripe->lock);
+    CFURLRef result = __CFURLInternFind(stripe, hash, string, checkForLegalCharacters);
+    if (result) stripe->hits++; else stripe->misses++;
+    __CFUnlock(&stripe->lock);
+    if (result) return result;
+    
+    result = _CFURLCreateWithURLString(allocator, string, checkForLegalCharacters, NULL);
+    // The scheme may be spelled in any case, so the scheme type in the flags is not enough to rule out a file URL
+    if (!result || _CFURLHasFileURLScheme(result, NULL)) return result;
+    // Fill in the lazy state while this thread still owns the URL; other threads only ever read a shared one
+    if (!_haveTestedOriginalString(result)) computeSanitizedString(result);
+    
+    __CFURLInternEntry *evicted = NULL;
+    __CFLock(&stripe->lock);
+    // Another thread may have created the same URL in the meantime; prefer the one already shared
+    CFURLRef existing = __CFURLInternFind(stripe, hash, string, checkForLegalCharacters);
+    if (!existing) {
+        __CFURLInternEntry *entry = (__CFURLInternEntry *)malloc(sizeof(__CFURLInternEntry));
+        __CFURLInternEntry **bucket = &stripe->buckets[(hash / URL_INTERN_STRIPES) % URL_INTERN_BUCKETS];
+        entry->hash = hash;
+        entry->string = CFStringCreateCopy(kCFAllocatorSystemDefault, string);
+        entry->checked = checkForLegalCharacters;
+        entry->url = (CFURLRef)CFRetain(result);
+        entry->chain = *bucket;
+        *bucket = entry;
+        entry->newer = NULL;
+        entry->older = stripe->newest;
+        if (stripe->newest) stripe->newest->newer = entry; else stripe->oldest = entry;
+        stripe->newest = entry;
+        stripe->count++;
+        // Evicted entries are chained together and released once the lock is dropped
+        CFIndex stripeLimit = __CFMax(limit / URL_INTERN_STRIPES, 1);
+        while (stripe->count > stripeLimit) {
+            __CFURLInternEntry *oldest = stripe->oldest;
+            __CFURLInternUnlink(stripe, oldest);
+            oldest->chain = evicted;
+            evicted = oldest;
+            stripe->evictions++;
+        }
+    }
+    __CFUnlock(&stripe->lock);
+    __CFURLInternFreeEntries(evicted);
+    if (existing) {
+        CFRelease(result);
+        result = existing;
+    }
+    return result;
+}
+
+CF_EXPORT void _CFURLSetInterningCacheLimit(CFIndex limit) {
+    __CFURLInternInitialize();
+    __CFURLInternLimit = limit;
+    for (CFIndex idx = 0; idx < URL_INTERN_STRIPES; idx++) {
+        __CFURLInternStripe *stripe = &__CFURLInternStripes[idx];
+        CFIndex stripeLimit = (limit > 0) ? __CFMax(limit / URL_INTERN_STRIPES, 1) : 0;
+        __CFURLInternEntry *evicted = NULL;
+        __CFLock(&stripe->lock);
+        while (stripe->count > stripeLimit) {
+            __CFURLInternEntry *oldest = stripe->oldest;
+            __CFURLInternUnlink(stripe, oldest);
+            oldest->chain = evicted;
+            evicted = oldest;
+            stripe->evictions++;
+        }
+        __CFUnlock(&stripe->lock);
+        __CFURLInternFreeEntries(evicted);
+    }
+}
+
+CF_EXPORT void _CFURLGetInterningCacheStatistics(CFIndex *hits, CFIndex *misses, CFIndex *evictions, CFIndex *count) {
+    CFIndex totalHits = 0, totalMisses = 0, totalEvictions = 0, totalCount = 0;
+    __CFURLInternInitialize();
+    for (CFIndex idx = 0; idx < URL_INTERN_STRIPES; idx++) {
+        __CFURLInternStripe *stripe = &__CFURLInternStripes[idx];
+        __CFLock(&stripe->lock);
+        totalHits += stripe->hits;
+        totalMisses += stripe->misses;
+        totalEvictions += stripe->evictions;
+        totalCount += stripe->count;
+        __CFUnlock(&stripe->lock);
+    }
+    if (hits) *hits = totalHits;
+    if (misses) *misses = totalMisses;
+    if (evictions) *evictions = totalEvictions;
+    if (count) *count = totalCount;
+}
+
 // encoding will be used both to interpret the bytes of URLBytes, and to interpret any percent-escapes within the bytes.
 CFURLRef CFURLCreateWithBytes(CFAllocatorRef allocator, const uint8_t *URLBytes, CFIndex length, CFStringEncoding encoding, CFURLRef baseURL) {
     CFStringRef  urlString = CFStringCreateWithBytes(allocator, URLBytes, length, encoding, false);
     CFURLRef result = NULL;
     if ( urlString ) {
-            result = _CFURLCreateWithURLString(allocator, urlString, false /* checkForLegalCharacters */, baseURL);
+            if (encoding == kCFStringEncodingUTF8) {
+                // Only UTF-8 URLs can be shared; any other encoding is stored into the URL after it is created
+                result = _CFURLCreateWithURLStringInterned(allocator, urlString, false /* checkForLegalCharacters */, baseURL);
+            } else {
+                result = _CFURLCreateWithURLString(allocator, urlString, false /* checkForLegalCharacters */, baseURL);
+            }
             if ( result ) {
                 if (encoding != kCFStringEncodingUTF8) {
                     ((struct __CFURL *)result)->_encoding = encoding;
@@ -2316,7 +2525,7 @@ CFDataRef CFURLCreateData(CFAllocatorRef allocator, CFURLRef  url, CFStringEncod
 CFURLRef CFURLCreateWithString(CFAllocatorRef allocator, CFStringRef  URLString, CFURLRef  baseURL) {
     CFURLRef url = NULL;
     if ( URLString ) {
-            url = _CFURLCreateWithURLString(allocator, URLString, true /* checkForLegalCharacters */, baseURL);
+            url = _CFURLCreateWithURLStringInterned(allocator, URLString, true /* checkForLegalCharacters */, baseURL);
     }
     return ( url );
 }
@@ -3521,6 +3730,25 @@ CFRange CFURLGetByteRangeForComponent(CFURLRef url, CFURLComponentType component
     return byteRange;
 }
 
+CF_EXPORT CFRange _CFURLGetComponentRangeNoCopy(CFURLRef url, CFURLComponentType component, const UInt8 **bytes) {
+    CFRange charRange, charRangeWithSeparators;
+    const UInt8 *characters;
+    CFAssert2(component > 0 && component < 13, __kCFLogAssertion, "%s(): passed invalid component %d", __PRETTY_FUNCTION__, component);
+    url = _CFURLFromNSURL(url);
+
+    if (!(url->_flags & IS_DECOMPOSABLE)) {
+        charRange = _getCharRangeInNonDecomposableURL(url, component, &charRangeWithSeparators);
+    } else {
+        charRange = _getCharRangeInDecomposableURL(url, component, &charRangeWithSeparators);
+    }
+    if (bytes) {
+        // The ranges are character indexes into url->_string; they are byte offsets too when the string is stored as Latin-1, which is the common case for URL strings
+        characters = (const UInt8 *)CFStringGetCStringPtr(url->_string, kCFStringEncodingISOLatin1);
+        *bytes = (characters && charRange.location != kCFNotFound) ? characters + charRange.location : NULL;
+    }
+    return charRange;
+}
+
 /* Component support */
 
 static Boolean decomposeToNonHierarchical(CFURLRef url, CFURLComponentsNonHierarchical *components) {
@@ -4173,19 +4401,10 @@ CF_EXPORT CFStringRef CFURLCopyFileSystemPath(CFURLRef anURL, CFURLPathStyle pat
     CFStringRef result = NULL;
     CFAllocatorRef alloc = CFGetAllocator(anURL);
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI || DEPLOYMENT_TARGET_LINUX
-    Boolean isCanonicalFileURL = false;
-    
-    if ( (pathStyle == kCFURLPOSIXPathStyle) && (CFURLGetBaseURL(anURL) == NULL) ) {
-        if ( !CF_IS_OBJC(CFURLGetTypeID(), anURL) ) {
-            // We can grope the ivars
-            isCanonicalFileURL = ((anURL->_flags & IS_CANONICAL_FILE_URL) != 0);
-            if ( isCanonicalFileURL ) {
-                STACK_BUFFER_DECL(UInt8, buffer, PATH_MAX + 1);
-                if ( CanonicalFileURLStringToFileSystemRepresentation(anURL->_string, buffer, PATH_MAX + 1) ) {
-                    result = CFStringCreateWithBytes(alloc, buffer, strlen((char *)buffer), kCFStringEncodingUTF8, false);
-                }
-            }
-        }
+    if ( (pathStyle == kCFURLPOSIXPathStyle) && !CF_IS_OBJC(CFURLGetTypeID(), anURL) ) {
+        // We can grope the ivars; the path is converted once and then kept by the URL
+        result = _CFURLGetPOSIXPath(anURL);
+        if ( result ) CFRetain(result);
     }
     if ( ! result ) {
         // fall back to slower way.
@@ -4199,6 +4418,19 @@ CF_EXPORT CFStringRef CFURLCopyFileSystemPath(CFURLRef anURL, CFURLPathStyle pat
 }
 
 
+// Returns the POSIX path of a CF (not ObjC) URL, not resolved against its base, converting it only the first time; the result is owned by url. Repeated resource probing asks the same URLs for their paths over and over.
+static CFStringRef _CFURLGetPOSIXPath(CFURLRef url) {
+    CFStringRef path = url->_posixPath;
+    if (!path) {
+        path = CFURLCreateStringWithFileSystemPath(CFGetAllocator(url), url, kCFURLPOSIXPathStyle, false);
+        if (path && !OSAtomicCompareAndSwapPtrBarrier(NULL, (void *)path, (void * volatile *)&((struct __CFURL *)url)->_posixPath)) {
+            CFRelease(path);
+            path = url->_posixPath;
+        }
+    }
+    return path;
+}
+
 // There is no matching ObjC method for this functionality; because this function sits on top of the CFURL primitives, it's o.k. not to check for the need to dispatch an ObjC method instead, but this means care must be taken that this function never call anything that will result in dereferencing anURL without first checking for an ObjC dispatch.  -- REW, 10/29/98
 CFStringRef CFURLCreateStringWithFileSystemPath(CFAllocatorRef allocator, CFURLRef anURL, CFURLPathStyle fsType, Boolean resolveAgainstBase) {
     CFURLRef base = resolveAgainstBase ? CFURLGetBaseURL(anURL) : NULL;
@@ -4287,9 +4519,14 @@ Boolean CFURLGetFileSystemRepresentation(CFURLRef url, Boolean resolveAgainstBas
     if ( !resolveAgainstBase || (CFURLGetBaseURL(url) == NULL) ) {
         if (!CF_IS_OBJC(CFURLGetTypeID(), url)) {
             // We can grope the ivars
+            if ( url->_posixPath ) {
+                return _CFStringGetFileSystemRepresentation(url->_posixPath, buffer, bufLen);
+            }
             if ( url->_flags & IS_CANONICAL_FILE_URL ) {
                 return CanonicalFileURLStringToFileSystemRepresentation(url->_string, buffer, bufLen);
             }
+            path = _CFURLGetPOSIXPath(url);
+            return path ? _CFStringGetFileSystemRepresentation(path, buffer, bufLen) : false;
         }
     }
     // else fall back to slower way.
@@ -342,6 +342,7 @@ typedef struct {
 } __CFUniCharBitmapData;
 
 static char __CFUniCharUnicodeVersionString[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+static uint8_t __CFUniCharUnicodeVersion[4] = {0, 0, 0, 0};
 
 static uint32_t __CFUniCharNumberOfBitmaps = 0;
 static __CFUniCharBitmapData *__CFUniCharBitmapDataArray = NULL;
@@ -383,6 +384,7 @@ static bool __CFUniCharLoadBitmapData(void) {
         return false;
     }
 
+    memmove(__CFUniCharUnicodeVersion, bytes, sizeof(__CFUniCharUnicodeVersion));
     for (idx = 0;idx < 4 && ((const uint8_t *)bytes)[idx];idx++) {
         __CFUniCharUnicodeVersionString[idx * 2] = ((const uint8_t *)bytes)[idx];
         __CFUniCharUnicodeVersionString[idx * 2 + 1] = '.';
@@ -425,6 +427,7 @@ static bool __CFUniCharLoadBitmapData(void) {
         }
     }
 
+    OSMemoryBarrier();	// Readers test __CFUniCharBitmapDataArray without taking the lock
     __CFUniCharBitmapDataArray = array;
 
     __CFUnlock(&__CFUniCharBitmapLock);
@@ -437,6 +440,14 @@ CF_PRIVATE const char *__CFUniCharGetUnicodeVersionString(void) {
     return __CFUniCharUnicodeVersionString;
 }
 
+// Every Unicode data file starts with the version of Unicode it was generated from. The tables refer to one another by character, so a file from another version than the bitmaps gives subtly wrong answers; say so.
+static void __CFUniCharVerifyUnicodeVersion(const void *bytes, const char *fileName) {
+    if (NULL == __CFUniCharBitmapDataArray) __CFUniCharLoadBitmapData();
+    if ((NULL != __CFUniCharBitmapDataArray) && (0 != memcmp(bytes, __CFUniCharUnicodeVersion, sizeof(__CFUniCharUnicodeVersion)))) {
+        CFLog(kCFLogLevelCritical, CFSTR("Unicode version of %s does not match the character set bitmaps (%s)."), fileName, __CFUniCharUnicodeVersionString);
+    }
+}
+
 bool CFUniCharIsMemberOf(UTF32Char theChar, uint32_t charset) {
     charset = __CFUniCharMapCompatibilitySetID(charset);
 
@@ -649,7 +660,10 @@ CF_PRIVATE uint32_t CFUniCharGetNumberOfPlanes(uint32_t charset) {
 }
 
 // Mapping data loading
-static const void **__CFUniCharMappingTables = NULL;
+// The mapping file is used where it is mapped: its header holds, for each table, the offset of the table from the start of the body.
+static const uint8_t *__CFUniCharMappingTableBody = NULL;
+static const uint32_t *__CFUniCharMappingTableOffsets = NULL;
+static uint32_t __CFUniCharMappingTableCount = 0;
 
 static CFLock_t __CFUniCharMappingTableLock = CFLockInit;
 
@@ -687,46 +701,32 @@ static CFLock_t __CFUniCharMappingTableLock = CFLockInit;
 
 CF_PRIVATE const void *CFUniCharGetMappingData(uint32_t type) {
 
-    __CFLock(&__CFUniCharMappingTableLock);
-
-    if (NULL == __CFUniCharMappingTables) {
-        const void *bytes;
-        const void *bodyBase;
-        int headerSize;
-        int idx, count;
-	int64_t fileSize;
+    if (NULL == __CFUniCharMappingTableBody) {
+        __CFLock(&__CFUniCharMappingTableLock);
 
-        if (!__CFUniCharLoadFile(MAPPING_TABLE_FILE, &bytes, &fileSize) || !__CFSimpleFileSizeVerification(bytes, fileSize)) {
-            __CFUnlock(&__CFUniCharMappingTableLock);
-            return NULL;
-        }
-
-#if defined (__cplusplus)
-		bytes = (uint8_t *)bytes + 4; // Skip Unicode version
-		headerSize = *((uint8_t *)bytes); bytes = (uint8_t *)bytes + sizeof(uint32_t);
-#else
-		bytes += 4; // Skip Unicode version
-		headerSize = *((uint32_t *)bytes); bytes += sizeof(uint32_t);
-#endif    
-        headerSize -= (sizeof(uint32_t) * 2);
-        bodyBase = (char *)bytes + headerSize;
+        if (NULL == __CFUniCharMappingTableBody) {
+            const void *bytes;
+            uint32_t headerSize;
+            int64_t fileSize;
 
-        count = headerSize / sizeof(uint32_t);
+            if (!__CFUniCharLoadFile(MAPPING_TABLE_FILE, &bytes, &fileSize) || !__CFSimpleFileSizeVerification(bytes, fileSize)) {
+                __CFUnlock(&__CFUniCharMappingTableLock);
+                return NULL;
+            }
+            __CFUniCharVerifyUnicodeVersion(bytes, "the Unicode mapping data");
 
-        __CFUniCharMappingTables = (const void **)CFAllocatorAllocate(kCFAllocatorSystemDefault, sizeof(const void *) * count, 0);
+            headerSize = *((const uint32_t *)((const uint8_t *)bytes + 4)) - (sizeof(uint32_t) * 2); // Skip Unicode version and header size
+            __CFUniCharMappingTableOffsets = (const uint32_t *)((const uint8_t *)bytes + (sizeof(uint32_t) * 2));
+            __CFUniCharMappingTableCount = headerSize / sizeof(uint32_t);
 
-        for (idx = 0;idx < count;idx++) {
-#if defined (__cplusplus)            
-			__CFUniCharMappingTables[idx] = (char *)bodyBase + *((uint32_t *)bytes); bytes = (uint8_t *)bytes + sizeof(uint32_t);
-#else
-			__CFUniCharMappingTables[idx] = (char *)bodyBase + *((uint32_t *)bytes); bytes += sizeof(uint32_t);
-#endif
+            OSMemoryBarrier();	// Readers test __CFUniCharMappingTableBody without taking the lock
+            __CFUniCharMappingTableBody = (const uint8_t *)__CFUniCharMappingTableOffsets + headerSize;
         }
-    }
 
-    __CFUnlock(&__CFUniCharMappingTableLock);
+        __CFUnlock(&__CFUniCharMappingTableLock);
+    }
 
-    return __CFUniCharMappingTables[type];
+    return ((type < __CFUniCharMappingTableCount) ? __CFUniCharMappingTableBody + __CFUniCharMappingTableOffsets[type] : NULL);
 }
 
 // Case mapping functions
@@ -765,8 +765,7 @@ static bool __CFUniCharLoadCaseMappingTable(void) {
     uint32_t *countArray;
     int idx;
 
-    if (NULL == __CFUniCharMappingTables) (void)CFUniCharGetMappingData(kCFUniCharToLowercase);
-    if (NULL == __CFUniCharMappingTables) return false;
+    if (NULL == CFUniCharGetMappingData(kCFUniCharToLowercase)) return false;
 
     __CFLock(&__CFUniCharMappingTableLock);
 
@@ -780,11 +779,14 @@ static bool __CFUniCharLoadCaseMappingTable(void) {
     __CFUniCharCaseMappingExtraTable = (const uint32_t **)__CFUniCharCaseMappingTable + NUM_CASE_MAP_DATA;
 
     for (idx = 0;idx < NUM_CASE_MAP_DATA;idx++) {
-        countArray[idx] = *((uint32_t *)__CFUniCharMappingTables[idx]) / (sizeof(uint32_t) * 2);
-        __CFUniCharCaseMappingTable[idx] = ((uint32_t *)__CFUniCharMappingTables[idx]) + 1;
-        __CFUniCharCaseMappingExtraTable[idx] = (const uint32_t *)((char *)__CFUniCharCaseMappingTable[idx] + *((uint32_t *)__CFUniCharMappingTables[idx]));
+        const uint32_t *mappingData = (const uint32_t *)CFUniCharGetMappingData(idx);
+
+        countArray[idx] = *mappingData / (sizeof(uint32_t) * 2);
+        __CFUniCharCaseMappingTable[idx] = (uint32_t *)mappingData + 1;
+        __CFUniCharCaseMappingExtraTable[idx] = (const uint32_t *)((char *)__CFUniCharCaseMappingTable[idx] + *mappingData);
     }
 
+    OSMemoryBarrier();	// Readers test __CFUniCharCaseMappingTableCounts without taking the lock
     __CFUniCharCaseMappingTableCounts = countArray;
 
     __CFUnlock(&__CFUniCharMappingTableLock);
@@ -1177,7 +1179,9 @@ CF_PRIVATE uint32_t CFUniCharGetConditionalCaseMappingFlags(UTF32Char theChar, U
 }
 
 // Unicode property database
+// One entry per property; the plane array of an entry is filled in the first time the property is asked for
 static __CFUniCharBitmapData *__CFUniCharUnicodePropertyTable = NULL;
+static const uint8_t **__CFUniCharUnicodePropertyBodies = NULL;
 static int __CFUniCharUnicodePropertyTableCount = 0;
 
 static CFLock_t __CFUniCharPropTableLock = CFLockInit;
@@ -1198,80 +1202,96 @@ static CFLock_t __CFUniCharPropTableLock = CFLockInit;
 #error Unknown or unspecified DEPLOYMENT_TARGET
 #endif
 
-const void *CFUniCharGetUnicodePropertyDataForPlane(uint32_t propertyType, uint32_t plane) {
+static void __CFUniCharLoadUnicodePropertyDatabase(void) {
+    __CFUniCharBitmapData *table;
+    const uint8_t **bodies;
+    const void *bytes;
+    const uint8_t *bodyBase;
+    const uint32_t *bodySizes;
+    uint32_t headerSize;
+    int idx, count;
+    int64_t fileSize;
 
     __CFLock(&__CFUniCharPropTableLock);
 
-    if (NULL == __CFUniCharUnicodePropertyTable) {
-        __CFUniCharBitmapData *table;
-        const void *bytes;
-        const void *bodyBase;
-        const void *planeBase;
-        int headerSize;
-        int idx, count;
-        int planeIndex, planeCount;
-        int planeSize;
-	int64_t fileSize;
-
-        if (!__CFUniCharLoadFile(PROP_DB_FILE, &bytes, &fileSize) || !__CFSimpleFileSizeVerification(bytes, fileSize)) {
-            __CFUnlock(&__CFUniCharPropTableLock);
-            return NULL;
-        }
+    if (__CFUniCharUnicodePropertyTable || !__CFUniCharLoadFile(PROP_DB_FILE, &bytes, &fileSize) || !__CFSimpleFileSizeVerification(bytes, fileSize)) {
+        __CFUnlock(&__CFUniCharPropTableLock);
+        return;
+    }
+    __CFUniCharVerifyUnicodeVersion(bytes, "the Unicode property database");
 
-#if defined (__cplusplus)
-		bytes = (uint8_t*)bytes + 4; // Skip Unicode version
-		headerSize = CFSwapInt32BigToHost(*((uint32_t *)bytes)); bytes = (uint8_t *)bytes + sizeof(uint32_t);
-#else
-		bytes += 4; // Skip Unicode version
-		headerSize = CFSwapInt32BigToHost(*((uint32_t *)bytes)); bytes += sizeof(uint32_t);
-#endif
-		
-        headerSize -= (sizeof(uint32_t) * 2);
-        bodyBase = (char *)bytes + headerSize;
+    headerSize = CFSwapInt32BigToHost(*((const uint32_t *)((const uint8_t *)bytes + 4))) - (sizeof(uint32_t) * 2); // Skip Unicode version and header size
+    bodySizes = (const uint32_t *)((const uint8_t *)bytes + (sizeof(uint32_t) * 2));
+    bodyBase = (const uint8_t *)bodySizes + headerSize;
+
+    count = headerSize / sizeof(uint32_t);
+
+    table = (__CFUniCharBitmapData *)CFAllocatorAllocate(kCFAllocatorSystemDefault, (sizeof(__CFUniCharBitmapData) + sizeof(const uint8_t *)) * count, 0);
+    bodies = (const uint8_t **)(table + count);
+
+    for (idx = 0;idx < count;idx++) {
+        table[idx]._numPlanes = 0;
+        table[idx]._planes = NULL;
+        bodies[idx] = bodyBase;
+        bodyBase += CFSwapInt32BigToHost(bodySizes[idx]);
+    }
+
+    __CFUniCharUnicodePropertyBodies = bodies;
+    __CFUniCharUnicodePropertyTableCount = count;
+    OSMemoryBarrier();	// Readers test __CFUniCharUnicodePropertyTable without taking the lock
+    __CFUniCharUnicodePropertyTable = table;
+
+    __CFUnlock(&__CFUniCharPropTableLock);
+}
+
+static const __CFUniCharBitmapData *__CFUniCharGetUnicodePropertyTable(uint32_t propertyType) {
+    __CFUniCharBitmapData *table;
 
-        count = headerSize / sizeof(uint32_t);
-        __CFUniCharUnicodePropertyTableCount = count;
+    if (NULL == __CFUniCharUnicodePropertyTable) __CFUniCharLoadUnicodePropertyDatabase();
+    if ((NULL == __CFUniCharUnicodePropertyTable) || (propertyType >= (uint32_t)__CFUniCharUnicodePropertyTableCount)) return NULL;
 
-        table = (__CFUniCharBitmapData *)CFAllocatorAllocate(kCFAllocatorSystemDefault, sizeof(__CFUniCharBitmapData) * count, 0);
+    table = __CFUniCharUnicodePropertyTable + propertyType;
 
-        for (idx = 0;idx < count;idx++) {
-            planeCount = *((const uint8_t *)bodyBase);
-            planeBase = (char *)bodyBase + planeCount + (planeCount % 4 ? 4 - (planeCount % 4) : 0);
-            table[idx]._planes = (const uint8_t **)CFAllocatorAllocate(kCFAllocatorSystemDefault, sizeof(const void *) * planeCount, 0);
+    if (NULL == table->_planes) {
+        __CFLock(&__CFUniCharPropTableLock);
+
+        if (NULL == table->_planes) {
+            const uint8_t *body = __CFUniCharUnicodePropertyBodies[propertyType];
+            int planeCount = *body;
+            const uint8_t *planeBase = body + planeCount + (planeCount % 4 ? 4 - (planeCount % 4) : 0);
+            const uint8_t **planes = (const uint8_t **)CFAllocatorAllocate(kCFAllocatorSystemDefault, sizeof(const void *) * (planeCount ? planeCount : 1), 0);
+            int planeIndex, planeSize;
 
             for (planeIndex = 0;planeIndex < planeCount;planeIndex++) {
-                if ((planeSize = ((const uint8_t *)bodyBase)[planeIndex + 1])) {
-                    table[idx]._planes[planeIndex] = (const uint8_t *)planeBase;
-#if defined (__cplusplus)   
-					planeBase = (char*)planeBase + (planeSize * 256);
-#else
-					planeBase += (planeSize * 256);
-#endif
+                if ((planeSize = body[planeIndex + 1])) {
+                    planes[planeIndex] = planeBase;
+                    planeBase += (planeSize * 256);
                 } else {
-                    table[idx]._planes[planeIndex] = NULL;
+                    planes[planeIndex] = NULL;
                 }
             }
 
-            table[idx]._numPlanes = planeCount;
-#if defined (__cplusplus)   
-			bodyBase = (const uint8_t *)bodyBase + (CFSwapInt32BigToHost(*(uint32_t *)bytes));
-			((uint32_t *&)bytes) ++;
-#else
-			bodyBase += (CFSwapInt32BigToHost(*((uint32_t *)bytes++)));
-#endif
+            table->_numPlanes = planeCount;
+            OSMemoryBarrier();
+            table->_planes = planes;
         }
 
-        __CFUniCharUnicodePropertyTable = table;
+        __CFUnlock(&__CFUniCharPropTableLock);
     }
 
-    __CFUnlock(&__CFUniCharPropTableLock);
+    return table;
+}
+
+const void *CFUniCharGetUnicodePropertyDataForPlane(uint32_t propertyType, uint32_t plane) {
+    const __CFUniCharBitmapData *table = __CFUniCharGetUnicodePropertyTable(propertyType);
 
-    return (plane < __CFUniCharUnicodePropertyTable[propertyType]._numPlanes ? __CFUniCharUnicodePropertyTable[propertyType]._planes[plane] : NULL);
+    return ((table && (plane < table->_numPlanes)) ? table->_planes[plane] : NULL);
 }
 
 CF_PRIVATE uint32_t CFUniCharGetNumberOfPlanesForUnicodePropertyData(uint32_t propertyType) {
-    (void)CFUniCharGetUnicodePropertyDataForPlane(propertyType, 0);
-    return __CFUniCharUnicodePropertyTable[propertyType]._numPlanes;
+    const __CFUniCharBitmapData *table = __CFUniCharGetUnicodePropertyTable(propertyType);
+
+    return (table ? table->_numPlanes : 0);
 }
 
 CF_PRIVATE uint32_t CFUniCharGetUnicodeProperty(UTF32Char character, uint32_t propertyType) {
@@ -1423,14 +1443,8 @@ void __CFUniCharCleanup(void)
     
     __CFUnlock(&__CFUniCharBitmapLock);
     
-    // cleanup memory allocated by CFUniCharGetMappingData()
     __CFLock(&__CFUniCharMappingTableLock);
     
-    if (__CFUniCharMappingTables != NULL) {
-        CFAllocatorDeallocate(kCFAllocatorSystemDefault, __CFUniCharMappingTables);
-        __CFUniCharMappingTables = NULL;
-    }
-    
     // cleanup memory allocated by __CFUniCharLoadCaseMappingTable()
     if (__CFUniCharCaseMappingTableCounts != NULL) {
         CFAllocatorDeallocate(kCFAllocatorSystemDefault, __CFUniCharCaseMappingTableCounts);
@@ -1447,12 +1461,13 @@ void __CFUniCharCleanup(void)
     
     if (__CFUniCharUnicodePropertyTable != NULL) {
         for (idx = 0; idx < __CFUniCharUnicodePropertyTableCount; idx++) {
-            CFAllocatorDeallocate(kCFAllocatorSystemDefault, __CFUniCharUnicodePropertyTable[idx]._planes);
+            if (__CFUniCharUnicodePropertyTable[idx]._planes) CFAllocatorDeallocate(kCFAllocatorSystemDefault, __CFUniCharUnicodePropertyTable[idx]._planes);
             __CFUniCharUnicodePropertyTable[idx]._planes = NULL;
         }
         
         CFAllocatorDeallocate(kCFAllocatorSystemDefault, __CFUniCharUnicodePropertyTable);
         __CFUniCharUnicodePropertyTable = NULL;
+        __CFUniCharUnicodePropertyBodies = NULL;
         __CFUniCharUnicodePropertyTableCount = 0;
     }
     
@@ -32,23 +32,48 @@
 #include <CoreFoundation/CFPropertyList.h>
 #include <CoreFoundation/CFNumber.h>
 #include <CoreFoundation/CFDate.h>
+#include <CoreFoundation/CFPriv.h>
 #include "CFInternal.h"
 #include <time.h>
 #if DEPLOYMENT_TARGET_MACOSX
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/stat.h>
 #include <mach/mach.h>
 #include <mach/mach_syscalls.h>
+#include <fcntl.h>
+#define XML_PREFERENCES_FILE_IDENTITY 1
+#define XML_PREFERENCES_WRITE_BEHIND 1
 #endif
 
 Boolean __CFPreferencesShouldWriteXML(void);
+CFTimeInterval __CFPreferencesWriteBehindInterval(void);
+
+#if XML_PREFERENCES_FILE_IDENTITY
+// What a domain's file looked like when _domainDict was read from it or written to it. A synchronize with no changes of its own stats the file once and keeps _domainDict as long as the file is still the same one, unchanged; otherwise the file is parsed again on the next access, not by the synchronize.
+typedef struct {
+    Boolean exists;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+} __CFXMLPreferencesFileIdentity;
+#endif
 
 typedef struct {
     CFMutableDictionaryRef _domainDict; // Current value of the domain dictionary
     CFMutableArrayRef _dirtyKeys; // The array of keys which must be synchronized
     CFAbsoluteTime _lastReadTime; // The last time we synchronized with the disk
     CFLock_t _lock; // Lock for accessing fields in the domain
+#if XML_PREFERENCES_FILE_IDENTITY
+    __CFXMLPreferencesFileIdentity _identity; // The file _domainDict matches, if _identityValid
+    Boolean _identityValid;
+#endif
+#if XML_PREFERENCES_WRITE_BEHIND
+    CFAbsoluteTime _flushDeadline; // With write-behind on, dirty keys are written once the domain went unchanged for the quiet period
+    Boolean _flushScheduled;
+#endif
     Boolean _isWorldReadable; // HACK - this is because we have no good way to propogate the kCFPreferencesAnyUser information from the upper level CFPreferences routines  REW, 1/13/00
     char _padding[3];
 } _CFXMLPreferencesDomain;
@@ -140,21 +165,111 @@ static void *createXMLDomain(CFAllocatorRef allocator, CFTypeRef context) {
     domain->_dirtyKeys = CFArrayCreateMutable(allocator, 0, & kCFTypeArrayCallBacks);
 	const CFLock_t lock = CFLockInit;
     domain->_lock = lock;
+#if XML_PREFERENCES_FILE_IDENTITY
+    domain->_identityValid = false;
+#endif
+#if XML_PREFERENCES_WRITE_BEHIND
+    domain->_flushDeadline = 0.0;
+    domain->_flushScheduled = false;
+#endif
     domain->_isWorldReadable = false;
     return domain;
 }
 
+#if XML_PREFERENCES_WRITE_BEHIND
+static void _deferXMLDomainWrite(CFTypeRef context, _CFXMLPreferencesDomain *domain, CFTimeInterval quietPeriod);
+static void _cancelXMLDomainFlush(CFTypeRef context, _CFXMLPreferencesDomain *domain);
+#endif
+
 static void freeXMLDomain(CFAllocatorRef allocator, CFTypeRef context, void *tDomain) {
     _CFXMLPreferencesDomain *domain = (_CFXMLPreferencesDomain *)tDomain;
+#if XML_PREFERENCES_WRITE_BEHIND
+    _cancelXMLDomainFlush(context, domain);
+#endif
     if (domain->_domainDict) CFRelease(domain->_domainDict);
     if (domain->_dirtyKeys) CFRelease(domain->_dirtyKeys);
     CFAllocatorDeallocate(allocator, domain);
 }
 
+// Reads and parses the file; an unreadable or missing file is an empty domain
+static CFMutableDictionaryRef _createXMLDomainDictionary(CFURLRef url) {
+    CFAllocatorRef alloc = __CFPreferencesAllocator();
+    CFMutableDictionaryRef result = NULL;
+    int idx;
+
+    // We no longer lock on read; instead, we assume parse failures are because someone else is writing the file, and just try to parse again.  If we fail 3 times in a row, we assume the file is corrupted.  REW, 7/13/99
+
+    for (idx = 0; idx < 3; idx ++) {
+        CFDataRef data;
+        if (!CFURLCreateDataAndPropertiesFromResource(alloc, url, &data, NULL, NULL, NULL) || !data) {
+            // Either a file system error (so we can't read the file), or an empty (or perhaps non-existant) file
+            break;
+        } else {
+            CFTypeRef pList = CFPropertyListCreateFromXMLData(alloc, data, kCFPropertyListImmutable, NULL);
+            CFRelease(data);
+            if (pList && CFGetTypeID(pList) == CFDictionaryGetTypeID()) {
+                result = CFDictionaryCreateMutableCopy(alloc, 0, (CFDictionaryRef)pList);
+                CFRelease(pList);
+                break;
+            } else if (pList) {
+                CFRelease(pList);
+            }
+            // Assume the file is being written; sleep for a short time (to allow the write to complete) then re-read
+            __CFMilliSleep(150);
+        }
+    }
+    if (!result) {
+        // Failed to ever load
+        result = CFDictionaryCreateMutable(alloc, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    }
+    return result;
+}
+
+#if XML_PREFERENCES_FILE_IDENTITY
+// False if the file system could not be asked; a file that does not exist is an identity of its own
+static Boolean _getXMLDomainFileIdentity(CFURLRef url, __CFXMLPreferencesFileIdentity *identity) {
+    char path[CFMaxPathSize];
+    struct stat statBuf;
+    if (!CFURLGetFileSystemRepresentation(url, true, (UInt8 *)path, CFMaxPathSize)) return false;
+    memset(identity, 0, sizeof(__CFXMLPreferencesFileIdentity));
+    if (0 != stat(path, &statBuf)) return (ENOENT == errno || ENOTDIR == errno);
+    identity->exists = true;
+    identity->dev = statBuf.st_dev;
+    identity->ino = statBuf.st_ino;
+    identity->size = statBuf.st_size;
+    identity->mtime = statBuf.st_mtimespec;
+    return true;
+}
+
+// Assumes the domain has already been locked. True if the file is no longer the one _domainDict was read from or written to.
+static Boolean _xmlDomainFileChanged(CFURLRef url, _CFXMLPreferencesDomain *domain) {
+    __CFXMLPreferencesFileIdentity identity;
+    if (!domain->_identityValid || !_getXMLDomainFileIdentity(url, &identity)) return true;
+    __CFXMLPreferencesFileIdentity *loaded = &domain->_identity;
+    if (identity.exists != loaded->exists) return true;
+    if (!identity.exists) return false;
+    return (identity.dev != loaded->dev || identity.ino != loaded->ino || identity.size != loaded->size || identity.mtime.tv_sec != loaded->mtime.tv_sec || identity.mtime.tv_nsec != loaded->mtime.tv_nsec);
+}
+#endif
+
 // Assumes the domain has already been locked
 static void _loadXMLDomainIfStale(CFURLRef url, _CFXMLPreferencesDomain *domain) {
     CFAllocatorRef alloc = __CFPreferencesAllocator();
-    int idx;
+#if XML_PREFERENCES_FILE_IDENTITY
+    if (domain->_domainDict) {
+        if (!_xmlDomainFileChanged(url, domain)) {
+            // We're up-to-date
+            return;
+        }
+        CFRelease(domain->_domainDict);
+        domain->_domainDict = NULL;
+    }
+    // Look before reading, so that a change made while we read is seen by the next synchronize
+    domain->_identityValid = _getXMLDomainFileIdentity(url, &domain->_identity);
+    domain->_domainDict = _createXMLDomainDictionary(url);
+    domain->_lastReadTime = CFAbsoluteTimeGetCurrent();
+    return;
+#endif
     if (domain->_domainDict) {
         CFDateRef modDate;
         CFAbsoluteTime modTime;
@@ -183,33 +298,7 @@ static void _loadXMLDomainIfStale(CFURLRef url, _CFXMLPreferencesDomain *domain)
         CFRelease(domain->_domainDict);
         domain->_domainDict = NULL;
     }
-
-    // We no longer lock on read; instead, we assume parse failures are because someone else is writing the file, and just try to parse again.  If we fail 3 times in a row, we assume the file is corrupted.  REW, 7/13/99
-
-    for (idx = 0; idx < 3; idx ++) {
-        CFDataRef data;
-        if (!CFURLCreateDataAndPropertiesFromResource(alloc, url, &data, NULL, NULL, NULL) || !data) {
-            // Either a file system error (so we can't read the file), or an empty (or perhaps non-existant) file
-            domain->_domainDict = CFDictionaryCreateMutable(alloc, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-            break;
-        } else {
-            CFTypeRef pList = CFPropertyListCreateFromXMLData(alloc, data, kCFPropertyListImmutable, NULL);
-            CFRelease(data);
-            if (pList && CFGetTypeID(pList) == CFDictionaryGetTypeID()) {
-                domain->_domainDict = CFDictionaryCreateMutableCopy(alloc, 0, (CFDictionaryRef)pList);
-                CFRelease(pList);
-                break;
-            } else if (pList) {
-                CFRelease(pList);
-            }
-            // Assume the file is being written; sleep for a short time (to allow the write to complete) then re-read
-            __CFMilliSleep(150);
-        }
-    }
-    if (!domain->_domainDict) {
-        // Failed to ever load
-        domain->_domainDict = CFDictionaryCreateMutable(alloc, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
-    }
+    domain->_domainDict = _createXMLDomainDictionary(url);
     domain->_lastReadTime = CFAbsoluteTimeGetCurrent();
 }
 
@@ -301,6 +390,7 @@ static Boolean __CFWriteBytesToFileWithAtomicity(CFURLRef url, const void *bytes
             chown(cpath, owner, group);
         }
     }
+    _CFInvalidatePathPropertiesCache(cpath);
     return true;
 }
 #endif
@@ -320,7 +410,8 @@ static Boolean _writeXMLFile(CFURLRef url, CFMutableDictionaryRef dict, Boolean
         }
         if (val) CFRelease(val);
     } else {
-        CFPropertyListFormat desiredFormat = __CFPreferencesShouldWriteXML() ? kCFPropertyListXMLFormat_v1_0 : kCFPropertyListBinaryFormat_v1_0;
+        // Write-behind exists to make large domains cheap to write, so it always writes them in binary
+        CFPropertyListFormat desiredFormat = (__CFPreferencesShouldWriteXML() && __CFPreferencesWriteBehindInterval() <= 0.0) ? kCFPropertyListXMLFormat_v1_0 : kCFPropertyListBinaryFormat_v1_0;
         CFDataRef data = CFPropertyListCreateData(alloc, dict, desiredFormat, 0, NULL);
         if (data) {
             SInt32 mode;
@@ -440,6 +531,10 @@ static void writeXMLValue(CFTypeRef context, void *xmlDomain, CFStringRef key, C
     } else {
         CFDictionaryRemoveValue(domain->_domainDict, key);
     }
+#if XML_PREFERENCES_WRITE_BEHIND
+    CFTimeInterval quietPeriod = __CFPreferencesWriteBehindInterval();
+    if (quietPeriod > 0.0) _deferXMLDomainWrite(context, domain, quietPeriod);
+#endif
     __CFUnlock(&domain->_lock);
 }
 
@@ -488,27 +583,12 @@ static void setXMLDomainIsWorldReadable(CFTypeRef context, void *domain, Boolean
     ((_CFXMLPreferencesDomain *)domain)->_isWorldReadable = isWorldReadable;
 }
 
-static Boolean synchronizeXMLDomain(CFTypeRef context, void *xmlDomain) {
-    _CFXMLPreferencesDomain *domain = (_CFXMLPreferencesDomain *)xmlDomain;
-    CFMutableDictionaryRef cachedDict;
-    CFMutableArrayRef changedKeys;
-    SInt32 idx,  count;
+// domain should already be locked. Merges the dirty keys into the latest version from the disk and writes the result.
+static Boolean _writeXMLDomainChanges(CFTypeRef context, _CFXMLPreferencesDomain *domain) {
+    CFMutableDictionaryRef cachedDict = domain->_domainDict;
+    CFMutableArrayRef changedKeys = domain->_dirtyKeys;
+    SInt32 idx, count = CFArrayGetCount(changedKeys);
     Boolean success, tryAgain;
-    
-    __CFLock(&domain->_lock);
-    cachedDict = domain->_domainDict;
-    changedKeys = domain->_dirtyKeys;
-    count = CFArrayGetCount(changedKeys);
-    
-    if (count == 0) {
-        // no changes were made to this domain; just remove it from the cache to guarantee it will be taken from disk next access
-        if (cachedDict) {
-            CFRelease(cachedDict);
-            domain->_domainDict = NULL;
-        }
-        __CFUnlock(&domain->_lock);
-        return true;
-    }
 
     domain->_domainDict = NULL; // This forces a reload.  Note that we now have a retain on cachedDict
     do {
@@ -531,8 +611,132 @@ static Boolean synchronizeXMLDomain(CFTypeRef context, void *xmlDomain) {
     if (success) {
 	CFArrayRemoveAllValues(domain->_dirtyKeys);
     }
+#if XML_PREFERENCES_FILE_IDENTITY
+    // _domainDict is now what the file holds, so our own write does not make the next synchronize read it back
+    domain->_identityValid = success && _getXMLDomainFileIdentity((CFURLRef)context, &domain->_identity);
+#endif
     domain->_lastReadTime = CFAbsoluteTimeGetCurrent();
-    __CFUnlock(&domain->_lock);
     return success;
 }
 
+#if XML_PREFERENCES_WRITE_BEHIND
+// Domains with a write scheduled, mapped to their URL. Only touched on the flush queue, so that a domain on its way out can be taken off it before it is freed.
+static CFMutableDictionaryRef _xmlDomainsPendingFlush = NULL;
+
+static dispatch_queue_t _xmlDomainFlushQueue(void) {
+    static dispatch_queue_t queue = NULL;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        dispatch_queue_attr_t dqattr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0);
+        queue = dispatch_queue_create("com.apple.CFPreferences.flush", dqattr);
+        _xmlDomainsPendingFlush = CFDictionaryCreateMutable(kCFAllocatorSystemDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        // Domains are not freed at exit, so what is still waiting would otherwise be lost
+        atexit(_CFPreferencesFlushWriteBehind);
+    });
+    return queue;
+}
+
+static void _scheduleXMLDomainFlush(_CFXMLPreferencesDomain *domain, CFTimeInterval delay);
+
+// Runs on the flush queue
+static void _xmlDomainFlushFired(_CFXMLPreferencesDomain *domain) {
+    CFURLRef url = (CFURLRef)CFDictionaryGetValue(_xmlDomainsPendingFlush, domain);
+    if (!url) return;
+    __CFLock(&domain->_lock);
+    CFTimeInterval remaining = domain->_flushDeadline - CFAbsoluteTimeGetCurrent();
+    if (remaining > 0.0) {
+        // Changed again since this was scheduled; wait for things to go quiet
+        _scheduleXMLDomainFlush(domain, remaining);
+    } else {
+        domain->_flushScheduled = false;
+        CFRetain(url);
+        CFDictionaryRemoveValue(_xmlDomainsPendingFlush, domain);
+        if (CFArrayGetCount(domain->_dirtyKeys) > 0 && domain->_domainDict) _writeXMLDomainChanges(url, domain);
+        CFRelease(url);
+    }
+    __CFUnlock(&domain->_lock);
+}
+
+static void _scheduleXMLDomainFlush(_CFXMLPreferencesDomain *domain, CFTimeInterval delay) {
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _xmlDomainFlushQueue(), ^{
+        _xmlDomainFlushFired(domain);
+    });
+}
+
+// Assumes the domain has already been locked
+static void _deferXMLDomainWrite(CFTypeRef context, _CFXMLPreferencesDomain *domain, CFTimeInterval quietPeriod) {
+    domain->_flushDeadline = CFAbsoluteTimeGetCurrent() + quietPeriod;
+    if (domain->_flushScheduled) return;
+    domain->_flushScheduled = true;
+    CFRetain(context);
+    dispatch_async(_xmlDomainFlushQueue(), ^{
+        CFDictionarySetValue(_xmlDomainsPendingFlush, domain, context);
+        CFRelease(context);
+    });
+    _scheduleXMLDomainFlush(domain, quietPeriod);
+}
+
+// Called as the domain goes away; whatever is still waiting to be written is written now
+static void _cancelXMLDomainFlush(CFTypeRef context, _CFXMLPreferencesDomain *domain) {
+    if (!domain->_flushScheduled) return;
+    dispatch_sync(_xmlDomainFlushQueue(), ^{
+        CFDictionaryRemoveValue(_xmlDomainsPendingFlush, domain);
+    });
+    __CFLock(&domain->_lock);
+    domain->_flushScheduled = false;
+    if (CFArrayGetCount(domain->_dirtyKeys) > 0 && domain->_domainDict) _writeXMLDomainChanges(context, domain);
+    __CFUnlock(&domain->_lock);
+}
+
+void _CFPreferencesFlushWriteBehind(void) {
+    dispatch_sync(_xmlDomainFlushQueue(), ^{
+        CFIndex count = CFDictionaryGetCount(_xmlDomainsPendingFlush);
+        if (count == 0) return;
+        _CFXMLPreferencesDomain **domains = (_CFXMLPreferencesDomain **)CFAllocatorAllocate(kCFAllocatorSystemDefault, count * sizeof(void *), 0);
+        CFDictionaryGetKeysAndValues(_xmlDomainsPendingFlush, (const void **)domains, NULL);
+        for (CFIndex idx = 0; idx < count; idx++) {
+            __CFLock(&domains[idx]->_lock);
+            domains[idx]->_flushDeadline = 0.0;
+            __CFUnlock(&domains[idx]->_lock);
+            _xmlDomainFlushFired(domains[idx]);
+        }
+        CFAllocatorDeallocate(kCFAllocatorSystemDefault, domains);
+    });
+}
+#else
+void _CFPreferencesFlushWriteBehind(void) {
+}
+#endif
+
+static Boolean synchronizeXMLDomain(CFTypeRef context, void *xmlDomain) {
+    _CFXMLPreferencesDomain *domain = (_CFXMLPreferencesDomain *)xmlDomain;
+    CFMutableDictionaryRef cachedDict;
+    SInt32 count;
+    Boolean success;
+    
+    __CFLock(&domain->_lock);
+    cachedDict = domain->_domainDict;
+    count = CFArrayGetCount(domain->_dirtyKeys);
+    
+    if (count == 0) {
+#if XML_PREFERENCES_FILE_IDENTITY
+        if (cachedDict && !_xmlDomainFileChanged((CFURLRef)context, domain)) {
+            // Nothing changed on either side; keep what was read
+            __CFUnlock(&domain->_lock);
+            return true;
+        }
+#endif
+        // no changes were made to this domain; just remove it from the cache to guarantee it will be taken from disk next access
+        if (cachedDict) {
+            CFRelease(cachedDict);
+            domain->_domainDict = NULL;
+        }
+        __CFUnlock(&domain->_lock);
+        return true;
+    }
+
+    // A write scheduled by write-behind finds nothing left to do once this one is done
+    success = _writeXMLDomainChanges(context, domain);
+    __CFUnlock(&domain->_lock);
+    return success;
+}
@@ -245,6 +245,9 @@ void _CFBundleFlushBundleCaches(CFBundleRef bundle);    // The previous two func
 CF_EXPORT 
 CFArrayRef _CFBundleCopyAllBundles(void); // Pending publication, the only known client of this is PowerBox. Email david_smith@apple.com before using this.
 
+CF_EXPORT
+void _CFBundlesPrewarm(CFArrayRef bundles);    // Reads the info dictionaries and locates the executables of the given bundles concurrently; loads no code
+
 CF_EXPORT
 void _CFBundleSetStringsFilesShared(CFBundleRef bundle, Boolean flag);
 
@@ -301,6 +304,10 @@ void _CFBundleCloseBundleResourceFork(CFBundleRef bundle);	// deprecated in favo
 CF_EXPORT
 CFBundleRef _CFBundleCreateUnique(CFAllocatorRef allocator, CFURLRef bundleURL) CF_AVAILABLE(10_11, 9_0);
 
+/* Turns on the on-disk index of resource lookups in ~/Library/Caches/com.apple.CFBundle.ResourceIndex, keeping at most limit entries per bundle; 0, the default, turns it off. Nothing is written if that directory cannot be written. */
+CF_EXPORT
+void _CFBundleSetResourceIndexLimit(CFIndex limit);
+
 CF_EXTERN_C_END
 
 #endif /* ! __COREFOUNDATION_CFBUNDLEPRIV__ */
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2015 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ CFByteScan.h
+ Copyright (c) 2015, Apple Inc. All rights reserved.
+ */
+
+/*
+ This file is for the use of the CoreFoundation project only.
+
+ Byte classification primitives for scanning 8-bit buffers (UTF-8 documents,
+ ASCII/Latin-1 string storage), plus a UTF-16 one. Each routine looks at 16
+ bytes per step with SSE2 when it is available and finishes the tail, or the
+ whole buffer on other architectures, one element at a time. The scanning
+ ones return a pointer into [p, end]; end means "not found".
+ */
+
+#if !defined(__COREFOUNDATION_CFBYTESCAN__)
+#define __COREFOUNDATION_CFBYTESCAN__ 1
+
+#include <CoreFoundation/CFBase.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+CF_EXTERN_C_BEGIN
+
+#if defined(__SSE2__)
+#define __CFByteScanStride 16
+
+CF_INLINE int __CFByteScanLoadMatch(const uint8_t *p, uint8_t a, uint8_t b) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)a)), _mm_cmpeq_epi8(v, _mm_set1_epi8((char)b))));
+}
+#endif
+
+// First byte equal to a or b
+CF_INLINE const uint8_t *__CFByteScanFind2(const uint8_t *p, const uint8_t *end, uint8_t a, uint8_t b) {
+#if defined(__SSE2__)
+    while (end - p >= __CFByteScanStride) {
+        int mask = __CFByteScanLoadMatch(p, a, b);
+        if (mask) return p + __builtin_ctz(mask);
+        p += __CFByteScanStride;
+    }
+#endif
+    while (p < end && *p != a && *p != b) p++;
+    return p;
+}
+
+// First byte that is not XML white space (' ', '\t', '\n' or '\r')
+CF_INLINE const uint8_t *__CFByteScanSkipXMLSpace(const uint8_t *p, const uint8_t *end) {
+#if defined(__SSE2__)
+    while (end - p >= __CFByteScanStride) {
+        int mask = (__CFByteScanLoadMatch(p, ' ', '\t') | __CFByteScanLoadMatch(p, '\n', '\r')) ^ 0xFFFF;
+        if (mask) return p + __builtin_ctz(mask);
+        p += __CFByteScanStride;
+    }
+#endif
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// First byte that has to be escaped in XML character data ('<', '>' or '&')
+CF_INLINE const uint8_t *__CFByteScanFindXMLSpecial(const uint8_t *p, const uint8_t *end) {
+#if defined(__SSE2__)
+    while (end - p >= __CFByteScanStride) {
+        int mask = __CFByteScanLoadMatch(p, '<', '>') | __CFByteScanLoadMatch(p, '&', '&');
+        if (mask) return p + __builtin_ctz(mask);
+        p += __CFByteScanStride;
+    }
+#endif
+    while (p < end && *p != '<' && *p != '>' && *p != '&') p++;
+    return p;
+}
+
+// First byte with the high bit set, i.e. the end of the leading ASCII run
+CF_INLINE const uint8_t *__CFByteScanFindNonASCII(const uint8_t *p, const uint8_t *end) {
+#if defined(__SSE2__)
+    while (end - p >= __CFByteScanStride) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p));
+        if (mask) return p + __builtin_ctz(mask);
+        p += __CFByteScanStride;
+    }
+#endif
+    while (p < end && *p < 0x80) p++;
+    return p;
+}
+
+/* First byte b with table[b] set. The caller also passes the set's members; when there are at most four of them they are matched 16 bytes at a time, otherwise the table is looked up a byte at a time.
+ */
+CF_INLINE const uint8_t *__CFByteScanFindInTable(const uint8_t *p, const uint8_t *end, const uint8_t table[256], const uint8_t *members, CFIndex memberCount) {
+#if defined(__SSE2__)
+    if (0 < memberCount && memberCount <= 4) {
+        uint8_t a = members[0], b = members[(1 < memberCount) ? 1 : 0], c = members[(2 < memberCount) ? 2 : 0], d = members[(3 < memberCount) ? 3 : 0];
+        while (end - p >= __CFByteScanStride) {
+            int mask = __CFByteScanLoadMatch(p, a, b) | __CFByteScanLoadMatch(p, c, d);
+            if (mask) return p + __builtin_ctz(mask);
+            p += __CFByteScanStride;
+        }
+    }
+#endif
+    while (p < end && !table[*p]) p++;
+    return p;
+}
+
+CF_INLINE uint8_t __CFByteScanFoldASCII(uint8_t c) {
+    return (('A' <= c) && (c <= 'Z')) ? (c + ('a' - 'A')) : c;
+}
+
+#if defined(__SSE2__)
+// 16 bytes with 'A'-'Z' folded to lower case; bytes with the high bit set compare as negative and are left alone
+CF_INLINE __m128i __CFByteScanLoadFolded(const uint8_t *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_add_epi8(v, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+#endif
+
+// First UTF-16 unit in [p, end) that is limit or above; eight units per step with SSE2
+CF_INLINE const UniChar *__CFByteScanFindUTF16AtLeast(const UniChar *p, const UniChar *end, UniChar limit) {
+#if defined(__SSE2__)
+    __m128i below = _mm_set1_epi16((short)(limit - 1)), zero = _mm_setzero_si128();
+    while (end - p >= __CFByteScanStride / 2) {
+        // Units below limit saturate to 0
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(_mm_loadu_si128((const __m128i *)p), below), zero)) ^ 0xFFFF;
+        if (mask) return p + (__builtin_ctz(mask) >> 1);
+        p += __CFByteScanStride / 2;
+    }
+#endif
+    while (p < end && *p < limit) p++;
+    return p;
+}
+
+// Maps 'A'-'Z' to lower case, or 'a'-'z' to upper case, in place up to the first byte with the high bit set, which is returned
+CF_INLINE uint8_t *__CFByteScanMapASCIICase(uint8_t *p, uint8_t *end, Boolean toUppercase) {
+    uint8_t first = toUppercase ? 'a' : 'A', last = toUppercase ? 'z' : 'Z';
+#if defined(__SSE2__)
+    __m128i below = _mm_set1_epi8(first - 1), above = _mm_set1_epi8(last + 1), delta = _mm_set1_epi8('a' - 'A');
+    while (end - p >= __CFByteScanStride) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        if (_mm_movemask_epi8(v)) break;	// The scalar loop stops at the non-ASCII byte
+        __m128i change = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi8(v, below), _mm_cmplt_epi8(v, above)), delta);
+        _mm_storeu_si128((__m128i *)p, toUppercase ? _mm_sub_epi8(v, change) : _mm_add_epi8(v, change));
+        p += __CFByteScanStride;
+    }
+#endif
+    for (; p < end && *p < 0x80; p++) {
+        if (first <= *p && *p <= last) *p = toUppercase ? (*p - ('a' - 'A')) : (*p + ('a' - 'A'));
+    }
+    return p;
+}
+
+// Index of the first byte where p and q differ, or len
+CF_INLINE CFIndex __CFByteScanMismatch(const uint8_t *p, const uint8_t *q, CFIndex len) {
+    CFIndex idx = 0;
+#if defined(__SSE2__)
+    while (len - idx >= __CFByteScanStride) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + idx)), _mm_loadu_si128((const __m128i *)(q + idx)))) ^ 0xFFFF;
+        if (mask) return idx + __builtin_ctz(mask);
+        idx += __CFByteScanStride;
+    }
+#endif
+    while (idx < len && p[idx] == q[idx]) idx++;
+    return idx;
+}
+
+// Same as __CFByteScanMismatch(), ignoring ASCII case
+CF_INLINE CFIndex __CFByteScanCaselessMismatch(const uint8_t *p, const uint8_t *q, CFIndex len) {
+    CFIndex idx = 0;
+#if defined(__SSE2__)
+    while (len - idx >= __CFByteScanStride) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(__CFByteScanLoadFolded(p + idx), __CFByteScanLoadFolded(q + idx))) ^ 0xFFFF;
+        if (mask) return idx + __builtin_ctz(mask);
+        idx += __CFByteScanStride;
+    }
+#endif
+    while (idx < len && __CFByteScanFoldASCII(p[idx]) == __CFByteScanFoldASCII(q[idx])) idx++;
+    return idx;
+}
+
+CF_INLINE Boolean __CFByteScanMatchesAt(const uint8_t *p, const uint8_t *needle, CFIndex needleLen, Boolean caseless) {
+    if (needleLen <= 2) return true;    // First and last bytes were already checked
+    return (caseless ? __CFByteScanCaselessMismatch(p + 1, needle + 1, needleLen - 2) : __CFByteScanMismatch(p + 1, needle + 1, needleLen - 2)) == needleLen - 2;
+}
+
+#if defined(__SSE2__)
+// Bit i is set when p + i could start a match: its first and last bytes line up with the needle's
+CF_INLINE int __CFByteScanCandidates(const uint8_t *p, CFIndex needleLen, __m128i first, __m128i last, Boolean caseless) {
+    __m128i head = caseless ? __CFByteScanLoadFolded(p) : _mm_loadu_si128((const __m128i *)p);
+    __m128i tail = caseless ? __CFByteScanLoadFolded(p + needleLen - 1) : _mm_loadu_si128((const __m128i *)(p + needleLen - 1));
+    return _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+}
+#endif
+
+/* First occurrence of needle in [p, end), or NULL. With caseless, 'A'-'Z' and 'a'-'z' match each other and every other byte only matches itself, which is only a correct case-insensitive search when both buffers are ASCII.
+ */
+CF_INLINE const uint8_t *__CFByteScanFindBytes(const uint8_t *p, const uint8_t *end, const uint8_t *needle, CFIndex needleLen, Boolean caseless) {
+    if (needleLen <= 0 || end - p < needleLen) return NULL;
+    const uint8_t *lastStart = end - needleLen;
+    uint8_t firstByte = caseless ? __CFByteScanFoldASCII(needle[0]) : needle[0];
+    uint8_t lastByte = caseless ? __CFByteScanFoldASCII(needle[needleLen - 1]) : needle[needleLen - 1];
+#if defined(__SSE2__)
+    __m128i first = _mm_set1_epi8((char)firstByte), last = _mm_set1_epi8((char)lastByte);
+    while (lastStart - p >= __CFByteScanStride - 1) {
+        int mask = __CFByteScanCandidates(p, needleLen, first, last, caseless);
+        while (mask) {
+            int idx = __builtin_ctz(mask);
+            if (__CFByteScanMatchesAt(p + idx, needle, needleLen, caseless)) return p + idx;
+            mask &= mask - 1;
+        }
+        p += __CFByteScanStride;
+    }
+#endif
+    for (; p <= lastStart; p++) {
+        if ((caseless ? __CFByteScanFoldASCII(*p) : *p) != firstByte) continue;
+        if ((caseless ? __CFByteScanFoldASCII(p[needleLen - 1]) : p[needleLen - 1]) != lastByte) continue;
+        if (__CFByteScanMatchesAt(p, needle, needleLen, caseless)) return p;
+    }
+    return NULL;
+}
+
+// Last occurrence of needle in [p, end), or NULL; see __CFByteScanFindBytes()
+CF_INLINE const uint8_t *__CFByteScanFindLastBytes(const uint8_t *p, const uint8_t *end, const uint8_t *needle, CFIndex needleLen, Boolean caseless) {
+    if (needleLen <= 0 || end - p < needleLen) return NULL;
+    const uint8_t *start = end - needleLen;
+    uint8_t firstByte = caseless ? __CFByteScanFoldASCII(needle[0]) : needle[0];
+    uint8_t lastByte = caseless ? __CFByteScanFoldASCII(needle[needleLen - 1]) : needle[needleLen - 1];
+#if defined(__SSE2__)
+    __m128i first = _mm_set1_epi8((char)firstByte), last = _mm_set1_epi8((char)lastByte);
+    while (start - p >= __CFByteScanStride - 1) {
+        const uint8_t *block = start - (__CFByteScanStride - 1);
+        int mask = __CFByteScanCandidates(block, needleLen, first, last, caseless);
+        while (mask) {
+            int idx = 31 - __builtin_clz(mask);
+            if (__CFByteScanMatchesAt(block + idx, needle, needleLen, caseless)) return block + idx;
+            mask &= ~(1 << idx);
+        }
+        start -= __CFByteScanStride;
+    }
+#endif
+    for (CFIndex idx = start - p; idx >= 0; idx--) {
+        if ((caseless ? __CFByteScanFoldASCII(p[idx]) : p[idx]) != firstByte) continue;
+        if ((caseless ? __CFByteScanFoldASCII(p[idx + needleLen - 1]) : p[idx + needleLen - 1]) != lastByte) continue;
+        if (__CFByteScanMatchesAt(p + idx, needle, needleLen, caseless)) return p + idx;
+    }
+    return NULL;
+}
+
+CF_EXTERN_C_END
+
+#endif /* ! __COREFOUNDATION_CFBYTESCAN__ */
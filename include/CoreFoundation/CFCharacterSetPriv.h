@@ -85,6 +85,28 @@ CF_EXPORT CFStringRef _CFCharacterSetCreateKeyedCodingString(CFCharacterSetRef c
 CF_EXPORT bool _CFCharacterSetIsInverted(CFCharacterSetRef cset);
 CF_EXPORT void _CFCharacterSetSetIsInverted(CFCharacterSetRef cset, bool flag);
 
+/* Compiled membership tables
+   A flat two-level bitmap covering all 17 planes: index holds, for each run of 256 code points, the number of the 32-byte block in blocks with their membership bits. Runs with the same bits share a block. */
+typedef struct {
+    UTF32Char firstMember;	// No character below this is a member (0x110000 if the set is empty)
+    UTF32Char firstNonMember;	// Every character below this is a member
+    uint16_t index[0x110000 >> 8];
+    uint8_t blocks[];
+} _CFCharacterSetTable;
+
+/* Returns the table of an immutable CFCharacterSet, compiling it on first use; the table lives as long as cset. Returns NULL for mutable and bridged sets. */
+CF_EXPORT const _CFCharacterSetTable *_CFCharacterSetGetTable(CFCharacterSetRef cset);
+
+CF_INLINE Boolean _CFCharacterSetTableIsMember(const _CFCharacterSetTable *table, UTF32Char character) {
+    return ((character < 0x110000) && ((table->blocks[(table->index[character >> 8] << 5) | ((character & 0xFF) >> 3)] >> (character & 7)) & 1)) ? true : false;
+}
+
+/* Bulk membership searches over UTF-16 text. Surrogate pairs are looked up as the character they encode and are reported at the index of their high surrogate; as in CFStringFindCharacterFromSet(), a surrogate that does not pair with the unit next to it in the direction of the search is passed over together with that unit. Return kCFNotFound when there is no such character. */
+CF_EXPORT CFIndex _CFCharacterSetFindFirstMember(CFCharacterSetRef cset, const UniChar *characters, CFIndex length);
+CF_EXPORT CFIndex _CFCharacterSetFindFirstNonMember(CFCharacterSetRef cset, const UniChar *characters, CFIndex length);
+CF_EXPORT CFIndex _CFCharacterSetFindLastMember(CFCharacterSetRef cset, const UniChar *characters, CFIndex length);
+CF_EXPORT CFIndex _CFCharacterSetFindLastNonMember(CFCharacterSetRef cset, const UniChar *characters, CFIndex length);
+
 CF_EXTERN_C_END
 
 #endif /* ! __COREFOUNDATION_CFCHARACTERSETPRIV__ */
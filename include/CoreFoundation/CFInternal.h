@@ -220,6 +220,7 @@ enum {
 	__CFTSDKeyRunLoopCntr = 11,
         __CFTSDKeyMachMessageBoost = 12, // valid only in the context of a CFMachPort callout
         __CFTSDKeyMachMessageHasVoucher = 13,
+	__CFTSDKeyTransliterators = 14,
 	// autorelease pool stuff must be higher than run loop constants
 	__CFTSDKeyAutoreleaseData2 = 61,
 	__CFTSDKeyAutoreleaseData1 = 62,
@@ -533,6 +534,10 @@ CF_PRIVATE SInt32 _CFGetFileProperties(CFAllocatorRef alloc, CFURLRef pathURL, B
     /* alloc may be NULL */
     /* any of exists, posixMode, size, modTime, and dirContents can be NULL.  Usually it is not a good idea to pass NULL for exists, since interpretting the other values sometimes requires that you know whether the file existed or not.  Except for dirContents, it is pretty cheap to compute any of these things as loing as one of them must be computed. */
 
+CF_PRIVATE SInt32 _CFGetCachedPathProperties(char *path, Boolean *exists, SInt32 *posixMode);
+CF_PRIVATE SInt32 _CFGetCachedFileProperties(CFURLRef pathURL, Boolean *exists, SInt32 *posixMode);
+    /* Like the two above, but answered from a short-lived cache of recent results when possible; see _CFInvalidatePathPropertiesCache() in CFPriv.h */
+
 
 /* ==================== Simple path manipulation ==================== */
 
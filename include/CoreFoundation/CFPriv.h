@@ -40,6 +40,8 @@
 #include <CoreFoundation/CFLocale.h>
 #include <CoreFoundation/CFDate.h>
 #include <CoreFoundation/CFSet.h>
+#include <CoreFoundation/CFStream.h>
+#include <CoreFoundation/CFStringTokenizer.h>
 #include <math.h>
 
 
@@ -86,6 +88,17 @@ CF_EXPORT CFURLRef _CFURLCreateFromPropertyListRepresentation(CFAllocatorRef all
 
 CF_EXPORT void CFPreferencesFlushCaches(void);
 
+/* Write-behind for preferences: with a quiet period above 0, changes made
+   with CFPreferencesSetValue() are written, in the binary format, once the
+   domain has not been changed for that long, so many sets cost one write.
+   Synchronizing a domain still writes its changes before it returns, and
+   whatever is waiting at exit is written then.  0, the default, writes only
+   on synchronize.  _CFPreferencesFlushWriteBehind() writes everything still
+   waiting; turning write-behind off does the same.
+*/
+CF_EXPORT void _CFPreferencesSetWriteBehindInterval(CFTimeInterval quietPeriod);
+CF_EXPORT void _CFPreferencesFlushWriteBehind(void);
+
 
 
 #if TARGET_OS_WIN32
@@ -151,13 +164,55 @@ CFURLRef _CFURLCreateFromComponents(CFAllocatorRef alloc, CFURLComponentDecompos
 #define CFURLCopyComponents _CFURLCopyComponents
 #define CFURLCreateFromComponents _CFURLCreateFromComponents
 
+/* Returns the character range of component, without separators, in the string url was created from, or {kCFNotFound, 0}; nothing is allocated. That is the string CFURLGetString(url) returns only when no characters in it had to be escaped; otherwise CFURLGetString() returns an escaped copy, and the range does not apply to it. When the creation string's characters are stored as Latin-1, *bytes is set to the component's first character in that storage, which stays valid as long as url does; otherwise *bytes is set to NULL. */
+CF_EXPORT
+CFRange _CFURLGetComponentRangeNoCopy(CFURLRef url, CFURLComponentType component, const UInt8 **bytes);
+
+/* Sizes the process-wide cache that lets CFURLCreateWithString() and UTF-8 CFURLCreateWithBytes() return an already created, shared URL for a string they have seen before. Only absolute URLs that are not file URLs are shared. The cache is off (limit 0) by default; setting 0 again empties it. */
+CF_EXPORT
+void _CFURLSetInterningCacheLimit(CFIndex limit);
+
+/* Reports the interning cache's lookups that found a URL, lookups that did not, entries evicted to stay within the limit, and entries currently held. Any pointer may be NULL. */
+CF_EXPORT
+void _CFURLGetInterningCacheStatistics(CFIndex *hits, CFIndex *misses, CFIndex *evictions, CFIndex *count);
+
 
 
 CF_EXPORT Boolean _CFStringGetFileSystemRepresentation(CFStringRef string, UInt8 *buffer, CFIndex maxBufLen);
 
+/* CF briefly remembers whether recently probed paths exist and what their modes are. Call this after creating, removing or changing the type of a file by other means than CF so that the next probe sees the change; NULL forgets every path. */
+CF_EXPORT void _CFInvalidatePathPropertiesCache(const char *path);
+
 /* If this is publicized, we might need to create a GetBytesPtr type function as well. */
 CF_EXPORT CFStringRef _CFStringCreateWithBytesNoCopy(CFAllocatorRef alloc, const UInt8 *bytes, CFIndex numBytes, CFStringEncoding encoding, Boolean externalFormat, CFAllocatorRef contentsDeallocator);
 
+/* Splitting a string into fields in one pass. Fields are separated by any member of delimiterSet or, if that is NULL, by any of the strings in delimiterStrings (the longest wins where several match); n delimiters in range make n + 1 fields, empty ones included. */
+typedef Boolean (*_CFStringFieldCallBack)(CFStringRef string, CFRange field, void *context);	// Return false to stop
+
+/* Calls callBack with each field's range in string, in order, and returns the number of fields reported. */
+CF_EXPORT CFIndex _CFStringEnumerateFields(CFStringRef string, CFRange range, CFCharacterSetRef delimiterSet, CFArrayRef delimiterStrings, _CFStringFieldCallBack callBack, void *context);
+
+/* Stores the ranges of the first maxFields fields in fields and returns how many fields there are in all; fields may be NULL to only count them. */
+CF_EXPORT CFIndex _CFStringGetFieldRanges(CFStringRef string, CFRange range, CFCharacterSetRef delimiterSet, CFArrayRef delimiterStrings, CFRange *fields, CFIndex maxFields);
+
+/* Returns the fields as strings. With shareStorage, fields of an immutable CFString point into its storage and keep it alive instead of being copied; for other strings the fields are copies. */
+CF_EXPORT CFArrayRef _CFStringCreateArrayOfFields(CFAllocatorRef alloc, CFStringRef string, CFRange range, CFCharacterSetRef delimiterSet, CFArrayRef delimiterStrings, Boolean shareStorage);
+
+/* Stores the ranges of up to maxCount tokens of the tokenizer's range that start at or after index, and their attributes in types if that is not NULL; returns how many were stored. Call again from the end of the last one to continue. kCFStringTokenizerUnitWord reports only words, not the spaces and punctuation between them. This moves the tokenizer's current token. */
+CF_EXPORT CFIndex _CFStringTokenizerGetTokens(CFStringTokenizerRef tokenizer, CFIndex index, CFRange *ranges, CFStringTokenizerTokenType *types, CFIndex maxCount);
+
+/* A tokenizer like CFStringTokenizerCreate() would make, reusing one given back with _CFStringTokenizerReturnToPool() for the same options and locale when there is one. */
+CF_EXPORT CFStringTokenizerRef _CFStringTokenizerCreateFromPool(CFStringRef string, CFRange range, CFOptionFlags options, CFLocaleRef locale);
+
+/* Releases tokenizer, keeping it for _CFStringTokenizerCreateFromPool() if nothing else holds on to it. */
+CF_EXPORT void _CFStringTokenizerReturnToPool(CFStringTokenizerRef tokenizer);
+
+/* Returns bytes that order strings, compared with memcmp() and then by length, as ICU's collator for the locale does at the strength and case level CFStringCompareWithOptionsAndLocale() with kCFCompareLocalized sets up for the options. Only kCFCompareCaseInsensitive, kCFCompareDiacriticInsensitive, kCFCompareNumerically and kCFCompareForcedOrdering are honoured; other flags, such as kCFCompareNonliteral and kCFCompareWidthInsensitive, are ignored. The order can differ from CFStringCompareWithOptionsAndLocale()'s for strings that hit the special cases it applies on top of the collator, and for those flags. A NULL locale means the current one. Returns NULL if no collator is available for the locale. */
+CF_EXPORT CFDataRef _CFStringCreateCollationKey(CFAllocatorRef alloc, CFStringRef string, CFOptionFlags options, CFLocaleRef locale);
+
+/* Sorts the strings in range of array into the order _CFStringCreateCollationKey() gives, which is not always that of CFStringCompareWithOptionsAndLocale() (see above); strings with equal keys keep their order. The keys of large arrays are computed on several threads. */
+CF_EXPORT void _CFArraySortStringsWithLocale(CFMutableArrayRef array, CFRange range, CFOptionFlags options, CFLocaleRef locale);
+
 /* These return NULL on MacOS 8 */
 // This one leaks the returned string in order to be thread-safe.
 // CF cannot help you in this matter if you continue to use this SPI.
@@ -608,6 +663,21 @@ CF_EXPORT bool _CFPropertyListCreateSingleValue(CFAllocatorRef allocator, CFData
 // Returns a subset of the property list, only including the keyPaths in the CFSet. If the top level object is not a dictionary, you will get back an empty dictionary as the result.
 CF_EXPORT bool _CFPropertyListCreateFiltered(CFAllocatorRef allocator, CFDataRef data, CFOptionFlags option, CFSetRef keyPaths, CFPropertyListRef *value, CFErrorRef *error) CF_AVAILABLE(10_8, 6_0);
 
+typedef CF_ENUM(CFIndex, _CFPropertyListStreamEvent) {
+    _kCFPropertyListStreamEventBeginDictionary = 1,
+    _kCFPropertyListStreamEventEndDictionary,
+    _kCFPropertyListStreamEventBeginArray,
+    _kCFPropertyListStreamEventEndArray,
+    _kCFPropertyListStreamEventKey,
+    _kCFPropertyListStreamEventValue
+};
+
+// keyPath is the colon-separated path of the element the event is about ("" for the top-level object). value is the key for _kCFPropertyListStreamEventKey, the decoded CFString, CFNumber, CFBoolean, CFDate or CFData for _kCFPropertyListStreamEventValue, and NULL otherwise; retain it to keep it past the callback. Return false to stop reading.
+typedef bool (*_CFPropertyListStreamCallBack)(_CFPropertyListStreamEvent event, CFStringRef keyPath, CFTypeRef value, void *info);
+
+// Reads an XML property list from an opened stream a chunk at a time and reports it to callback as events instead of building it in memory; only the text of one key or value is held at a time. keyPaths selects what is reported the same way as _CFPropertyListCreateFiltered, and everything else is skipped without being decoded. Binary and OpenStep property lists are not supported. Returns false with an error if the document is malformed or the stream fails; true if it was read to the end or the callback stopped it.
+CF_EXPORT bool _CFPropertyListReadStream(CFAllocatorRef allocator, CFReadStreamRef stream, CFOptionFlags option, CFSetRef keyPaths, _CFPropertyListStreamCallBack callback, void *info, CFErrorRef *error);
+
 #if (TARGET_OS_MAC && !(TARGET_OS_EMBEDDED || TARGET_OS_IPHONE)) || (TARGET_OS_EMBEDDED || TARGET_OS_IPHONE) || TARGET_OS_WIN32
 
 // Returns a subset of a bundle's Info.plist. The keyPaths follow the same rules as above CFPropertyList function. This function takes platform and product keys into account.
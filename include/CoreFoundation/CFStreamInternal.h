@@ -67,6 +67,11 @@ struct _CFStreamCallBacksV1 {
 CF_PRIVATE CFErrorRef _CFErrorFromStreamError(CFAllocatorRef alloc, CFStreamError *err);
 CF_PRIVATE CFStreamError _CFStreamErrorFromError(CFErrorRef error);
 
+// The file stream's gathering write and flush, for _CFWriteStreamWriteVector() and _CFWriteStreamFlush() in CFStream.c
+CF_PRIVATE const struct _CFStreamCallBacks *__CFFileStreamGetCallBacks(void);
+CF_PRIVATE CFIndex __CFFileStreamWriteVector(CFWriteStreamRef stream, const UInt8 *const *buffers, const CFIndex *lengths, CFIndex count, CFStreamError *errorCode, void *info);
+CF_PRIVATE Boolean __CFFileStreamFlush(CFWriteStreamRef stream, CFStreamError *errorCode, void *info);
+
 CF_EXTERN_C_END
 
 #endif /* ! __COREFOUNDATION_CFSTREAMINTERNAL__ */
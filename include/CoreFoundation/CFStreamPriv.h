@@ -194,5 +194,55 @@ CF_EXTERN_C_END
  */
 CF_EXPORT const CFStringRef _kCFStreamPropertyFileNativeHandle CF_AVAILABLE_IOS(5_0);
 
+/*
+ * for CFReadStreamSetProperty on a stream created from a file, before it
+ * is opened.  A CFBooleanRef; when set to kCFBooleanTrue, a read stream
+ * on a large regular file is served from a memory mapping of the file.
+ * Off by default.  Only turn it on for files which cannot be truncated
+ * while they are being read; reading a truncated mapping raises SIGBUS.
+ */
+CF_EXPORT const CFStringRef _kCFStreamPropertyFileMapped;
+
+/*
+ * for CFWriteStreamSetProperty on a stream created from a file or a file
+ * descriptor.  A CFNumberRef giving the size in bytes of a buffer that
+ * small writes are collected in and written out together with writev();
+ * 0, the default, writes every buffer straight through.  Written bytes
+ * reach the file when the buffer would overflow, when the oldest of them
+ * is older than _kCFStreamPropertyFileWriteCoalescingInterval (by a timer
+ * if no write comes along), when kCFStreamPropertyFileCurrentOffset is read
+ * or set, on _CFWriteStreamFlush(), and on close.  Errors are reported by
+ * the call that writes the bytes out, or, for bytes the timer wrote, by the
+ * next write or flush; close reports nothing, so flush first when it
+ * matters.  Only meant for blocking descriptors.
+ */
+CF_EXPORT const CFStringRef _kCFStreamPropertyFileWriteCoalescing;
+
+/*
+ * for CFWriteStreamSetProperty along with the above.  A CFNumberRef with
+ * the age in seconds after which coalesced bytes are written out; 0.5 by
+ * default.
+ */
+CF_EXPORT const CFStringRef _kCFStreamPropertyFileWriteCoalescingInterval;
+
+CF_EXTERN_C_BEGIN
+
+/*
+ * Writes count buffers in order, with a single writev() on file streams.
+ * Returns the number of bytes taken, which like CFWriteStreamWrite() may
+ * be less than the total, or -1 on error.
+ */
+CF_EXPORT
+CFIndex _CFWriteStreamWriteVector(CFWriteStreamRef stream, const UInt8 *const *buffers, const CFIndex *lengths, CFIndex count);
+
+/*
+ * Writes out bytes held back by _kCFStreamPropertyFileWriteCoalescing.
+ * Returns false, and puts the stream in error, if they could not be written.
+ */
+CF_EXPORT
+Boolean _CFWriteStreamFlush(CFWriteStreamRef stream);
+
+CF_EXTERN_C_END
+
 #endif /* ! __COREFOUNDATION_CFSTREAMPRIV__ */
 
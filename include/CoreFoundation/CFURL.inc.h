@@ -39,6 +39,8 @@
  
  Any changes made to the parser are made in this file so that both char and the UniChar strings are parsed exactly the same way.
  
+ The searches for delimiters go through CFURL_FIND_DELIMITER(characterArray, from, to, a, b), which returns the index of the first a or b in [from, to), or to. CFURL.c defines it before each include; for the char variant it is the vectorized byte scanner from CFByteScan.h.
+ 
  */
 
 /*
@@ -72,15 +74,13 @@
     
     // Algorithm is as described in RFC 1808
     // 1: parse the fragment; remainder after left-most "#" is fragment
-    for (idx = base_idx; idx < string_length; idx++) {
-        if ('#' == characterArray[idx]) {
-            flags |= HAS_FRAGMENT;
-            unpackedRanges[fragment_index].location = idx + 1;
-            unpackedRanges[fragment_index].length = string_length - (idx + 1);
-            numRanges ++;
-            string_length = idx;	// remove fragment from parse string
-            break;
-        }
+    idx = CFURL_FIND_DELIMITER(characterArray, base_idx, string_length, '#', '#');
+    if (idx < string_length) {
+        flags |= HAS_FRAGMENT;
+        unpackedRanges[fragment_index].location = idx + 1;
+        unpackedRanges[fragment_index].length = string_length - (idx + 1);
+        numRanges ++;
+        string_length = idx;	// remove fragment from parse string
     }
     // 2: parse the scheme
     for (idx = base_idx; idx < string_length; idx++) {
@@ -150,39 +150,28 @@
         // 3: parse the network location and login
         if (2 <= (string_length - base_idx) && '/' == characterArray[base_idx] && '/' == characterArray[base_idx+1]) {
             CFIndex base = 2 + base_idx, extent;
-            for (idx = base; idx < string_length; idx++) {
-                if ('/' == characterArray[idx] || '?' == characterArray[idx]) {
-                    break;
-                }
-            }
-            extent = idx;
+            extent = CFURL_FIND_DELIMITER(characterArray, base, string_length, '/', '?');
             
             // net_loc parts extend from base to extent (but not including), which might be to end of string
             // net location is "<user>:<password>@<host>:<port>"
             if (extent != base) {
-                for (idx = base; idx < extent; idx++) {
-                    if ('@' == characterArray[idx]) {   // there is a user
-                        CFIndex idx2;
-                        flags |= HAS_USER;
+                idx = CFURL_FIND_DELIMITER(characterArray, base, extent, '@', '@');
+                if (idx < extent) {   // there is a user
+                    CFIndex idx2 = CFURL_FIND_DELIMITER(characterArray, base, idx, ':', ':');
+                    flags |= HAS_USER;
+                    numRanges ++;
+                    unpackedRanges[user_index].location = base;  // base of the user
+                    if (idx2 < idx) {	// found a password separator
+                        flags |= HAS_PASSWORD;
                         numRanges ++;
-                        unpackedRanges[user_index].location = base;  // base of the user
-                        for (idx2 = base; idx2 < idx; idx2++) {
-                            if (':' == characterArray[idx2]) {	// found a password separator
-                                flags |= HAS_PASSWORD;
-                                numRanges ++;
-                                unpackedRanges[password_index].location = idx2+1; // base of the password
-                                unpackedRanges[password_index].length = idx-(idx2+1);  // password extent
-                                unpackedRanges[user_index].length = idx2 - base; // user extent
-                                break;
-                            }
-                        }
-                        if (!(flags & HAS_PASSWORD)) {
-                            // user extends to the '@'
-                            unpackedRanges[user_index].length = idx - base; // user extent
-                        }
-                        base = idx + 1;
-                        break;
+                        unpackedRanges[password_index].location = idx2+1; // base of the password
+                        unpackedRanges[password_index].length = idx-(idx2+1);  // password extent
+                        unpackedRanges[user_index].length = idx2 - base; // user extent
+                    } else {
+                        // user extends to the '@'
+                        unpackedRanges[user_index].length = idx - base; // user extent
                     }
+                    base = idx + 1;
                 }
                 flags |= HAS_HOST;
                 numRanges ++;
@@ -218,27 +207,23 @@
         }
         
         // 4: parse the query; remainder after left-most "?" is query
-        for (idx = base_idx; idx < string_length; idx++) {
-            if ('?' == characterArray[idx]) {
-                flags |= HAS_QUERY;
-                numRanges ++;
-                unpackedRanges[query_index].location = idx + 1;
-                unpackedRanges[query_index].length = string_length - (idx+1);
-                string_length = idx;	// remove query from parse string
-                break;
-            }
+        idx = CFURL_FIND_DELIMITER(characterArray, base_idx, string_length, '?', '?');
+        if (idx < string_length) {
+            flags |= HAS_QUERY;
+            numRanges ++;
+            unpackedRanges[query_index].location = idx + 1;
+            unpackedRanges[query_index].length = string_length - (idx+1);
+            string_length = idx;	// remove query from parse string
         }
         
         // 5: parse the parameters; remainder after left-most ";" is parameters
-        for (idx = base_idx; idx < string_length; idx++) {
-            if (';' == characterArray[idx]) {
-                flags |= HAS_PARAMETERS;
-                numRanges ++;
-                unpackedRanges[parameters_index].location = idx + 1;
-                unpackedRanges[parameters_index].length = string_length - (idx+1);
-                string_length = idx;	// remove parameters from parse string
-                break;
-            }
+        idx = CFURL_FIND_DELIMITER(characterArray, base_idx, string_length, ';', ';');
+        if (idx < string_length) {
+            flags |= HAS_PARAMETERS;
+            numRanges ++;
+            unpackedRanges[parameters_index].location = idx + 1;
+            unpackedRanges[parameters_index].length = string_length - (idx+1);
+            string_length = idx;	// remove parameters from parse string
         }
         
         // 6: parse the path; it's whatever's left between string_length & base_idx
@@ -255,13 +240,7 @@
             unpackedRanges[path_index] = pathRg;
             
             if (pathRg.length > 0) {
-                Boolean sawPercent = FALSE;
-                for (idx = pathRg.location; idx < string_length; idx++) {
-                    if ('%' == characterArray[idx]) {
-                        sawPercent = TRUE;
-                        break;
-                    }
-                }
+                Boolean sawPercent = (CFURL_FIND_DELIMITER(characterArray, pathRg.location, string_length, '%', '%') < string_length);
 #if DEPLOYMENT_TARGET_MACOSX || DEPLOYMENT_TARGET_EMBEDDED || DEPLOYMENT_TARGET_EMBEDDED_MINI
                 if (pathRg.length > 6 && characterArray[pathRg.location] == '/' && characterArray[pathRg.location + 1] == '.' && characterArray[pathRg.location + 2] == 'f' && characterArray[pathRg.location + 3] == 'i' && characterArray[pathRg.location + 4] == 'l' && characterArray[pathRg.location + 5] == 'e' && characterArray[pathRg.location + 6] == '/') {
                     flags |= PATH_HAS_FILE_ID;
@@ -0,0 +1,234 @@
+//
+//  mkzonetab.c
+//  CoreFoundation
+//
+//  Generates _zone_tab.c, the compiled-in copy of the Olson zoneinfo
+//  database used by CFTimeZone when TZDIR is not available.
+//
+//  Usage: mkzonetab [<zoneinfo-dir>] > _zone_tab.c
+//
+//  This is a host tool; it only depends on libc:
+//      cc -o mkzonetab tools/mkzonetab.c && ./mkzonetab /usr/share/zoneinfo > _zone_tab.c
+//
+
+/*
+ The generated file contains three read-only tables:
+
+    __CFZoneTabNames   all zone names, NUL-terminated and sorted by strcmp()
+    __CFZoneTabIndex   one { name, offset, length } entry per name, in the same order
+    __CFZoneTabData    the TZif payloads, back to back
+
+ Names are looked up by binary search over the index, so no table has to be
+ built at runtime and nothing is touched besides the pages holding the index
+ and the requested payload. Zones which are links to one another (US/Eastern
+ and America/New_York, say) have byte-identical payloads; those are stored
+ once and shared by all of their index entries.
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *name;
+    uint8_t *bytes;
+    size_t length;
+    size_t offset;
+    int unique;
+} zone_t;
+
+static zone_t *zones = NULL;
+static size_t zoneCount = 0;
+static size_t zoneCapacity = 0;
+
+static void die(const char *what, const char *path) {
+    fprintf(stderr, "mkzonetab: %s: %s: %s\n", what, path, strerror(errno));
+    exit(1);
+}
+
+static void addZone(const char *root, const char *name) {
+    char path[2 * PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE *f = fopen(path, "rb");
+    if (!f) die("cannot open", path);
+    if (zoneCount == zoneCapacity) {
+        zoneCapacity = zoneCapacity ? zoneCapacity * 2 : 1024;
+        zones = realloc(zones, zoneCapacity * sizeof(zone_t));
+    }
+    zone_t *z = &zones[zoneCount++];
+    memset(z, 0, sizeof(*z));
+    z->name = strdup(name);
+    size_t capacity = 4096;
+    z->bytes = malloc(capacity);
+    for (;;) {
+        size_t got = fread(z->bytes + z->length, 1, capacity - z->length, f);
+        z->length += got;
+        if (got == 0) break;
+        if (z->length == capacity) {
+            capacity *= 2;
+            z->bytes = realloc(z->bytes, capacity);
+        }
+    }
+    if (ferror(f)) die("cannot read", path);
+    fclose(f);
+}
+
+static void walk(const char *root, const char *subdir) {
+    char path[2 * PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s%s", root, *subdir ? "/" : "", subdir);
+    DIR *dir = opendir(path);
+    if (!dir) die("cannot open directory", path);
+    struct dirent *dp;
+    while ((dp = readdir(dir))) {
+        if (dp->d_name[0] == '.') continue;
+        char name[PATH_MAX], full[2 * PATH_MAX];
+        struct stat sb;
+        snprintf(name, sizeof(name), "%s%s%s", subdir, *subdir ? "/" : "", dp->d_name);
+        snprintf(full, sizeof(full), "%s/%s", root, name);
+        if (stat(full, &sb) != 0) die("cannot stat", full);
+        if (S_ISDIR(sb.st_mode)) {
+            walk(root, name);
+        } else if (S_ISREG(sb.st_mode)) {
+            addZone(root, name);
+        }
+    }
+    closedir(dir);
+}
+
+static int compareZones(const void *a, const void *b) {
+    return strcmp(((const zone_t *)a)->name, ((const zone_t *)b)->name);
+}
+
+// Emits the bytes as C string literal pieces; octal escapes are always three
+// digits wide so that a following digit can never extend them.
+static void emitBytes(const uint8_t *bytes, size_t length) {
+    size_t column = 0;
+    for (size_t idx = 0; idx < length; idx++) {
+        uint8_t c = bytes[idx];
+        if (column == 0) fputs("    \"", stdout);
+        if (c == '\\' || c == '"' || c == '?') {
+            printf("\\%c", c);
+            column += 2;
+        } else if (0x20 <= c && c < 0x7F) {
+            putchar(c);
+            column += 1;
+        } else {
+            printf("\\%03o", c);
+            column += 4;
+        }
+        if (72 <= column || idx + 1 == length) {
+            fputs("\"\n", stdout);
+            column = 0;
+        }
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    const char *root = (1 < argc) ? argv[1] : "/usr/share/zoneinfo";
+    walk(root, "");
+    if (zoneCount == 0) {
+        fprintf(stderr, "mkzonetab: no zones found in %s\n", root);
+        return 1;
+    }
+    qsort(zones, zoneCount, sizeof(zone_t), compareZones);
+
+    size_t dataSize = 0;
+    for (size_t idx = 0; idx < zoneCount; idx++) {
+        zone_t *z = &zones[idx];
+        z->unique = 1;
+        for (size_t jdx = 0; jdx < idx; jdx++) {
+            if (zones[jdx].unique && zones[jdx].length == z->length && memcmp(zones[jdx].bytes, z->bytes, z->length) == 0) {
+                z->offset = zones[jdx].offset;
+                z->unique = 0;
+                break;
+            }
+        }
+        if (z->unique) {
+            z->offset = dataSize;
+            dataSize += z->length;
+        }
+    }
+
+    printf("//\n");
+    printf("//  _zone_tab.c\n");
+    printf("//  CoreFoundation\n");
+    printf("//\n");
+    printf("//  Copyright (c) 2014 Apportable. All rights reserved.\n");
+    printf("//\n\n");
+    printf("/*\n");
+    printf("This is a derived version of the public domain Olson Database;\n");
+    printf("originally authored by Arthur David Olson 2009-05-17,\n");
+    printf("modified by Paul Eggert 1996-08-05\n\n");
+    printf("This file is generated by tools/mkzonetab.c; do not edit it by hand.\n");
+    printf("*/\n\n");
+    printf("#include <CoreFoundation/CFBase.h>\n");
+    printf("#include <string.h>\n\n");
+    printf("#define __CFZoneTabCount %lu\n", (unsigned long)zoneCount);
+    printf("#define __CFZoneTabDataSize %lu\n\n", (unsigned long)dataSize);
+
+    printf("static const char __CFZoneTabNames[] =\n");
+    size_t nameOffset = 0;
+    size_t *nameOffsets = malloc(zoneCount * sizeof(size_t));
+    for (size_t idx = 0; idx < zoneCount; idx++) {
+        nameOffsets[idx] = nameOffset;
+        nameOffset += strlen(zones[idx].name) + 1;
+        printf("    \"%s\\000\"%s\n", zones[idx].name, (idx + 1 == zoneCount) ? ";" : "");
+    }
+    printf("\n");
+
+    printf("static const struct {\n");
+    printf("    uint32_t name;\n");
+    printf("    uint32_t offset;\n");
+    printf("    uint32_t length;\n");
+    printf("} __CFZoneTabIndex[__CFZoneTabCount] = {\n");
+    for (size_t idx = 0; idx < zoneCount; idx++) {
+        printf("    { %lu, %lu, %lu },\n", (unsigned long)nameOffsets[idx], (unsigned long)zones[idx].offset, (unsigned long)zones[idx].length);
+    }
+    printf("};\n\n");
+
+    printf("static const uint8_t __CFZoneTabData[__CFZoneTabDataSize] =\n");
+    for (size_t idx = 0; idx < zoneCount; idx++) {
+        if (!zones[idx].unique) continue;
+        printf("    /* %s */\n", zones[idx].name);
+        emitBytes(zones[idx].bytes, zones[idx].length);
+    }
+    printf("    ;\n\n");
+
+    printf("const uint8_t *_TimeZoneDataGet(const char *key, CFIndex *len)\n");
+    printf("{\n");
+    printf("    CFIndex lo = 0, hi = __CFZoneTabCount - 1;\n");
+    printf("    if (key == NULL)\n");
+    printf("    {\n");
+    printf("        return NULL;\n");
+    printf("    }\n");
+    printf("    while (lo <= hi)\n");
+    printf("    {\n");
+    printf("        CFIndex mid = lo + (hi - lo) / 2;\n");
+    printf("        int cmp = strcmp(key, __CFZoneTabNames + __CFZoneTabIndex[mid].name);\n");
+    printf("        if (cmp < 0)\n");
+    printf("        {\n");
+    printf("            hi = mid - 1;\n");
+    printf("        }\n");
+    printf("        else if (0 < cmp)\n");
+    printf("        {\n");
+    printf("            lo = mid + 1;\n");
+    printf("        }\n");
+    printf("        else\n");
+    printf("        {\n");
+    printf("            if (len)\n");
+    printf("            {\n");
+    printf("                *len = __CFZoneTabIndex[mid].length;\n");
+    printf("            }\n");
+    printf("            return __CFZoneTabData + __CFZoneTabIndex[mid].offset;\n");
+    printf("        }\n");
+    printf("    }\n");
+    printf("    return NULL;\n");
+    printf("}\n");
+    return 0;
+}